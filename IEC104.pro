@@ -10,13 +10,39 @@ SOURCES += main.cpp \
     mainwindow.cpp \
     iec104_class.cpp \
     logmsg.cpp \
-    qiec104.cpp
+    qiec104.cpp \
+    pointmodel.cpp \
+    bdtrfwd.cpp \
+    alloccnt.cpp \
+    timerwheel.cpp \
+    pointtable.cpp \
+    squnpack.cpp \
+    cp56time.cpp \
+    apdurec.cpp \
+    latency.cpp \
+    metrics.cpp
 HEADERS += mainwindow.h \
     iec104_types.h \
     bdtr.h \
     iec104_class.h \
     logmsg.h \
-    qiec104.h
+    qiec104.h \
+    pointmodel.h \
+    bdtrfwd.h \
+    alloccnt.h \
+    spscring.h \
+    timerwheel.h \
+    pointtable.h \
+    squnpack.h \
+    cp56time.h \
+    apdurec.h \
+    latency.h \
+    metrics.h
 FORMS += mainwindow.ui
 OTHER_FILES += \
     qtester104.ini
+
+win32: LIBS += -lws2_32
+
+# count heap allocations in debug builds, see alloccnt.h
+CONFIG(debug, debug|release): DEFINES += IEC104_COUNT_ALLOCS
@@ -0,0 +1,83 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "alloccnt.h"
+
+#ifdef IEC104_COUNT_ALLOCS
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+static std::atomic<unsigned long long> allocations( 0 );
+
+// the array and nothrow forms of new end up here too
+void * operator new( size_t sz )
+{
+    allocations.fetch_add( 1, std::memory_order_relaxed );
+    void * p = malloc( sz ? sz : 1 );
+    if ( p == NULL )
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete( void * p ) noexcept
+{
+    free( p );
+}
+
+// C++14 calls this form when the size is known
+void operator delete( void * p, size_t ) noexcept
+{
+    free( p );
+}
+
+bool allocCountEnabled()
+{
+    return true;
+}
+
+unsigned long long allocCount()
+{
+    return allocations.load( std::memory_order_relaxed );
+}
+
+#else
+
+bool allocCountEnabled()
+{
+    return false;
+}
+
+unsigned long long allocCount()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef ALLOCCNT_H
+#define ALLOCCNT_H
+
+// Heap allocation counter, used to check that the protocol hot paths do not allocate.
+// Counting is active only when compiled with IEC104_COUNT_ALLOCS defined (the global
+// operator new is replaced), otherwise allocCount() always returns 0.
+
+bool allocCountEnabled(); // true if allocations are being counted
+unsigned long long allocCount(); // number of heap allocations made by the process so far
+
+#endif // ALLOCCNT_H
@@ -0,0 +1,445 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <string.h>
+#include <chrono>
+#include "apdurec.h"
+
+static const unsigned PcapMagicNs = 0xA1B23C4D;
+static const unsigned PcapMagicUs = 0xA1B2C3D4;
+enum { LINK_ETHERNET = 1, LINK_RAW = 101, LINK_LINUX_SLL = 113, LINK_IPV4 = 228 };
+
+static const unsigned MasterIp = 0x0AFFFFFE; // 10.255.255.254
+static const unsigned short MasterPort = 49152;
+static const unsigned short IEC104Port = 2404;
+static const int HeadersSize = 16 + 20 + 20; // pcap record, IPv4, TCP
+
+struct TPcapHeader {
+    unsigned magic;
+    unsigned short major, minor;
+    int thiszone;
+    unsigned sigfigs;
+    unsigned snaplen;
+    unsigned linktype;
+};
+
+static unsigned char * put16( unsigned char * p, unsigned v ) // network order
+{
+    p[0] = v >> 8; p[1] = v;
+    return p + 2;
+}
+
+static unsigned char * put32( unsigned char * p, unsigned v ) // network order
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+    return p + 4;
+}
+
+TApduRecorder::TApduRecorder()
+{
+    mFile = NULL;
+    mLen = 0;
+    mBufFrames = 0;
+    mDue = false;
+    mWriteNs = 0;
+    mBytes = 0;
+    mMaxBytes = 0;
+    mFrames = 0;
+    mDropped = 0;
+}
+
+TApduRecorder::~TApduRecorder()
+{
+    close();
+}
+
+long long TApduRecorder::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+bool TApduRecorder::open( const char * filename )
+{
+    close();
+    std::lock_guard<std::mutex> wlock( mWriteMutex );
+    std::lock_guard<std::mutex> lock( mMutex );
+    mFile = fopen( filename, "wb" );
+    if ( mFile == NULL )
+      return false;
+
+    TPcapHeader h;
+    h.magic = PcapMagicNs;
+    h.major = 2;
+    h.minor = 4;
+    h.thiszone = 0;
+    h.sigfigs = 0;
+    h.snaplen = 65535;
+    h.linktype = LINK_RAW;
+    mBuf.resize( BufSize );
+    mOut.resize( BufSize );
+    memcpy( &mBuf[0], &h, sizeof( h ) );
+    mLen = sizeof( h );
+    mBufFrames = 0;
+    mDue = false;
+    mBytes = 0;
+    mWriteNs = nowNs();
+    mSeq[0].clear();
+    mSeq[1].clear();
+    return true;
+}
+
+void TApduRecorder::close()
+{
+    std::lock_guard<std::mutex> wlock( mWriteMutex );
+    if ( mFile == NULL )
+      return;
+    write();
+    std::lock_guard<std::mutex> lock( mMutex );
+    fclose( mFile );
+    mFile = NULL;
+}
+
+void TApduRecorder::setMaxBytes( unsigned long long max )
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    mMaxBytes = max;
+}
+
+void TApduRecorder::flush()
+{
+    std::lock_guard<std::mutex> wlock( mWriteMutex );
+    if ( mFile != NULL )
+      write();
+}
+
+void TApduRecorder::write()
+{
+    size_t len;
+    unsigned long long frames;
+    {
+    std::lock_guard<std::mutex> lock( mMutex );
+    mDue = false;
+    mWriteNs = nowNs();
+    if ( mLen == 0 )
+      return;
+    mBuf.swap( mOut );
+    len = mLen;
+    frames = mBufFrames;
+    mBytes += len; // counted now, so that record() respects mMaxBytes during the write
+    mLen = 0;
+    mBufFrames = 0;
+    }
+
+    // record() goes on filling mBuf meanwhile
+    size_t n = fwrite( &mOut[0], 1, len, mFile );
+    if ( n == len && fflush( mFile ) == 0 )
+      return;
+
+    std::lock_guard<std::mutex> lock( mMutex );
+    mBytes -= len - n;
+    mFrames -= frames;
+    mDropped += frames;
+}
+
+void TApduRecorder::record( unsigned session, int dir, const void * apdu, int sz )
+{
+    long long ns = nowNs();
+    std::lock_guard<std::mutex> lock( mMutex );
+    if ( mFile == NULL || sz <= 0 || sz > 255 )
+      return;
+
+    if ( mMaxBytes > 0 && mBytes + mLen + HeadersSize + sz > mMaxBytes )
+      {
+      mDropped++;
+      return;
+      }
+    if ( mLen + HeadersSize + sz > BufSize )
+      {
+      mDropped++; // flush() is late
+      mDue = true;
+      return;
+      }
+
+    // tcp sequence numbers, so that the streams look contiguous
+    session &= 0xFFFFFF;
+    if ( session >= mSeq[dir].size() )
+      {
+      mSeq[0].resize( session + 1, 1 );
+      mSeq[1].resize( session + 1, 1 );
+      }
+    unsigned seq = mSeq[dir][session];
+    unsigned ack = mSeq[!dir][session];
+    mSeq[dir][session] += sz;
+    unsigned rtuIp = 0x0A000000 + session + 1;
+    unsigned len = 40 + sz;
+
+    unsigned char * p = &mBuf[mLen];
+    unsigned rec[4] = { (unsigned)( ns / 1000000000 ), (unsigned)( ns % 1000000000 ), len, len };
+    memcpy( p, rec, sizeof( rec ) );
+    p += sizeof( rec );
+
+    unsigned char * ip = p;
+    *p++ = 0x45; // IPv4, 20 bytes header
+    *p++ = 0;
+    p = put16( p, len );
+    p = put16( p, 0 ); // id
+    p = put16( p, 0x4000 ); // don't fragment
+    *p++ = 64; // ttl
+    *p++ = 6; // tcp
+    p = put16( p, 0 ); // checksum, below
+    p = put32( p, dir == RX ? rtuIp : MasterIp );
+    p = put32( p, dir == RX ? MasterIp : rtuIp );
+    unsigned sum = 0;
+    for ( int i = 0; i < 20; i += 2 )
+      sum += ip[i] << 8 | ip[i + 1];
+    sum = ( sum & 0xFFFF ) + ( sum >> 16 );
+    sum += sum >> 16;
+    put16( ip + 10, ~sum & 0xFFFF );
+
+    p = put16( p, dir == RX ? IEC104Port : MasterPort );
+    p = put16( p, dir == RX ? MasterPort : IEC104Port );
+    p = put32( p, seq );
+    p = put32( p, ack );
+    *p++ = 0x50; // 20 bytes header
+    *p++ = 0x18; // PSH ACK
+    p = put16( p, 65535 ); // window
+    p = put16( p, 0 ); // checksum not computed
+    p = put16( p, 0 ); // urgent
+
+    memcpy( p, apdu, sz );
+    mLen += HeadersSize + sz;
+    mBufFrames++;
+    mFrames++;
+    if ( mLen >= BufSize / 2 || ns - mWriteNs > 1000000000LL )
+      mDue = true;
+}
+
+TApduReader::TApduReader()
+{
+    mFile = NULL;
+    mSwap = false;
+    mNano = false;
+    mLinkType = 0;
+    mCur = -1;
+    mCurNs = 0;
+    mSkipped = 0;
+}
+
+TApduReader::~TApduReader()
+{
+    close();
+}
+
+unsigned TApduReader::get32( const unsigned char * p ) const
+{
+    unsigned v;
+    memcpy( &v, p, 4 );
+    if ( mSwap )
+      v = ( v >> 24 ) | ( ( v >> 8 ) & 0xFF00 ) | ( ( v << 8 ) & 0xFF0000 ) | ( v << 24 );
+    return v;
+}
+
+bool TApduReader::open( const char * filename )
+{
+    close();
+    mFile = fopen( filename, "rb" );
+    if ( mFile == NULL )
+      return false;
+
+    unsigned char h[sizeof( TPcapHeader )];
+    if ( fread( h, 1, sizeof( h ), mFile ) != sizeof( h ) )
+      {
+      close();
+      return false;
+      }
+    unsigned magic;
+    memcpy( &magic, h, 4 );
+    mSwap = false;
+    if ( magic == PcapMagicNs || magic == PcapMagicUs )
+      mNano = magic == PcapMagicNs;
+    else
+      {
+      mSwap = true;
+      magic = get32( h );
+      if ( magic != PcapMagicNs && magic != PcapMagicUs )
+        {
+        close();
+        return false;
+        }
+      mNano = magic == PcapMagicNs;
+      }
+
+    mLinkType = get32( h + 20 ) & 0xFFFF;
+    if ( mLinkType != LINK_ETHERNET && mLinkType != LINK_RAW && mLinkType != LINK_LINUX_SLL && mLinkType != LINK_IPV4 )
+      {
+      close();
+      return false;
+      }
+
+    mConns.clear();
+    mStreams.clear();
+    mCur = -1;
+    mSkipped = 0;
+    return true;
+}
+
+void TApduReader::close()
+{
+    if ( mFile != NULL )
+      fclose( mFile );
+    mFile = NULL;
+}
+
+bool TApduReader::readPacket()
+{
+    for ( ;; )
+      {
+      unsigned char rec[16];
+      if ( mFile == NULL || fread( rec, 1, sizeof( rec ), mFile ) != sizeof( rec ) )
+        return false;
+      unsigned incl = get32( rec + 8 );
+      if ( incl > 262144 )
+        return false; // corrupt
+      mPkt.resize( incl );
+      if ( incl > 0 && fread( &mPkt[0], 1, incl, mFile ) != incl )
+        return false;
+      long long ns = (long long)get32( rec ) * 1000000000 + get32( rec + 4 ) * ( mNano ? 1 : 1000 );
+
+      // to the IPv4 header
+      const unsigned char * p = incl > 0 ? &mPkt[0] : NULL;
+      int n = incl;
+      int ethertype = 0x0800;
+      if ( mLinkType == LINK_ETHERNET || mLinkType == LINK_LINUX_SLL )
+        {
+        int off = mLinkType == LINK_ETHERNET ? 12 : 14;
+        if ( n < off + 2 )
+          {
+          mSkipped++;
+          continue;
+          }
+        ethertype = p[off] << 8 | p[off + 1];
+        if ( ethertype == 0x8100 && n >= off + 6 ) // vlan tag
+          {
+          off += 4;
+          ethertype = p[off] << 8 | p[off + 1];
+          }
+        p += off + 2;
+        n -= off + 2;
+        }
+      if ( ethertype != 0x0800 || n < 20 || ( p[0] >> 4 ) != 4 || p[9] != 6 )
+        {
+        mSkipped++;
+        continue;
+        }
+      int ihl = ( p[0] & 0x0F ) * 4;
+      int total = p[2] << 8 | p[3];
+      if ( total < n )
+        n = total; // ethernet padding
+      if ( n < ihl + 20 )
+        {
+        mSkipped++;
+        continue;
+        }
+      unsigned src = p[12] << 24 | p[13] << 16 | p[14] << 8 | p[15];
+      unsigned dst = p[16] << 24 | p[17] << 16 | p[18] << 8 | p[19];
+      const unsigned char * tcp = p + ihl;
+      unsigned short sport = tcp[0] << 8 | tcp[1];
+      unsigned short dport = tcp[2] << 8 | tcp[3];
+      int doff = ( tcp[12] >> 4 ) * 4;
+      int payload = n - ihl - doff;
+      if ( payload <= 0 )
+        continue; // handshake, pure acks
+      if ( sport != IEC104Port && dport != IEC104Port )
+        {
+        mSkipped++;
+        continue;
+        }
+
+      // the connection, the RTU is the side of port 2404
+      int dir = sport == IEC104Port ? TApduRecorder::RX : TApduRecorder::TX;
+      TConn c;
+      c.rtuIp = dir == TApduRecorder::RX ? src : dst;
+      c.rtuPort = dir == TApduRecorder::RX ? sport : dport;
+      c.masterIp = dir == TApduRecorder::RX ? dst : src;
+      c.masterPort = dir == TApduRecorder::RX ? dport : sport;
+      size_t s;
+      for ( s = 0; s < mConns.size(); s++ )
+        if ( mConns[s].rtuIp == c.rtuIp && mConns[s].rtuPort == c.rtuPort &&
+             mConns[s].masterIp == c.masterIp && mConns[s].masterPort == c.masterPort )
+          break;
+      if ( s == mConns.size() )
+        {
+        mConns.push_back( c );
+        mStreams.resize( mStreams.size() + 2 );
+        mStreams[2 * s].head = mStreams[2 * s + 1].head = 0;
+        }
+
+      TStream & st = mStreams[2 * s + dir];
+      st.buf.erase( st.buf.begin(), st.buf.begin() + st.head );
+      st.head = 0;
+      const unsigned char * data = tcp + doff;
+      st.buf.insert( st.buf.end(), data, data + payload );
+      mCur = 2 * s + dir;
+      mCurNs = ns;
+      return true;
+      }
+}
+
+bool TApduReader::next( TApduFrame & f )
+{
+    for ( ;; )
+      {
+      if ( mCur >= 0 )
+        {
+        TStream & st = mStreams[mCur];
+        while ( st.buf.size() - st.head >= 2 )
+          {
+          const unsigned char * p = &st.buf[st.head];
+          if ( p[0] != 0x68 || p[1] < 4 )
+            {
+            mSkipped++;
+            st.head++;
+            continue;
+            }
+          int sz = p[1] + 2;
+          if ( st.buf.size() - st.head < (size_t)sz )
+            break;
+          st.head += sz;
+          f.session = mCur / 2;
+          f.dir = mCur % 2;
+          f.timeNs = mCurNs;
+          f.data = p;
+          f.sz = sz;
+          return true;
+          }
+        }
+      if ( !readPacket() )
+        return false;
+      }
+}
@@ -0,0 +1,144 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef APDUREC_H
+#define APDUREC_H
+
+// Binary capture of the APDUs of IEC104 sessions, as a pcap file (nanosecond time stamps, LINKTYPE_RAW).
+// Each frame is wrapped in synthesized IPv4/TCP headers, so Wireshark decodes the capture as IEC 60870-5-104:
+// the RTU of session s is 10.0.0.0 + s + 1 port 2404, the master is 10.255.255.254 port 49152.
+// Frames are appended to a memory buffer, recording a frame costs a clock read and a copy, never file I/O:
+// the owner calls flush() out of the receive path (e.g. in TReactor104::onLoop) when due(), half a buffer or
+// a second after the last write. flush() swaps the buffers and writes without blocking record(); frames
+// arriving while the buffer is full, or lost by a write error, are counted as dropped.
+// record() is thread safe, the sessions of a reactor pool may share a recorder.
+// TApduReader reads back these captures and also plain pcap captures of IEC104 traffic (ethernet, linux
+// cooked or raw IPv4 link), reassembling the APDUs of each TCP stream (retransmitted segments are not detected).
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class TApduRecorder
+{
+public:
+    enum { RX, TX }; // direction: received from the RTU, sent to the RTU
+
+    TApduRecorder();
+    ~TApduRecorder();
+
+    bool open( const char * filename ); // creates (truncates) the file, false if it can't be written
+    void close();
+    bool isOpen() const { return mFile != NULL; }
+    void setMaxBytes( unsigned long long max ); // stop recording when the file reaches max bytes, 0 = no limit (default)
+
+    void record( unsigned session, int dir, const void * apdu, int sz );
+    bool due() const { return mDue.load( std::memory_order_relaxed ); } // buffer half full or a second old
+    void flush(); // write the buffered frames now, from one thread at a time with close()
+
+    unsigned long long getFrames() const { return mFrames; }
+    unsigned long long getDropped() const { return mDropped; } // frames not recorded: file full or write error
+
+    static long long nowNs(); // system clock, ns since the epoch (UTC)
+
+private:
+    TApduRecorder( const TApduRecorder & );
+    TApduRecorder & operator=( const TApduRecorder & );
+
+    void write(); // swaps the buffers and writes, mWriteMutex held
+
+    static const size_t BufSize = 1 << 20;
+
+    std::mutex mWriteMutex; // file I/O, taken before mMutex
+    std::mutex mMutex; // buffer and counters
+    FILE * mFile; // changed with both mutexes held
+    std::vector <unsigned char> mBuf; // being filled by record()
+    std::vector <unsigned char> mOut; // being written by flush()
+    size_t mLen;
+    unsigned long long mBufFrames; // frames in mBuf
+    std::atomic<bool> mDue;
+    long long mWriteNs; // time of the last write
+    unsigned long long mBytes; // file size
+    unsigned long long mMaxBytes;
+    unsigned long long mFrames;
+    unsigned long long mDropped;
+    std::vector <unsigned> mSeq[2]; // next tcp sequence number of each session, by direction
+};
+
+// an APDU of a capture, data is valid until the next call to TApduReader::next()
+struct TApduFrame {
+    unsigned session; // TCP connection, numbered in order of appearance
+    int dir; // TApduRecorder::RX or TX
+    long long timeNs; // since the epoch
+    const unsigned char * data;
+    int sz;
+};
+
+class TApduReader
+{
+public:
+    TApduReader();
+    ~TApduReader();
+
+    bool open( const char * filename ); // false if not a pcap file of a supported link type
+    void close();
+    bool next( TApduFrame & f ); // next APDU in capture order, false at the end of the file
+    int sessionCount() const { return (int)mConns.size(); }
+    unsigned long long getSkipped() const { return mSkipped; } // packets that are not IEC104 over IPv4/TCP, bytes out of frame
+
+private:
+    TApduReader( const TApduReader & );
+    TApduReader & operator=( const TApduReader & );
+
+    bool readPacket(); // appends the payload of the next packet to its stream, false at the end of the file
+    unsigned get32( const unsigned char * p ) const;
+
+    struct TConn {
+        unsigned rtuIp, masterIp;
+        unsigned short rtuPort, masterPort;
+    };
+    struct TStream {
+        std::vector <unsigned char> buf;
+        size_t head;
+    };
+
+    FILE * mFile;
+    bool mSwap; // file written with the other byte order
+    bool mNano; // time stamps in ns (else us)
+    unsigned mLinkType;
+    std::vector <unsigned char> mPkt;
+    std::vector <TConn> mConns;
+    std::vector <TStream> mStreams; // 2 per connection, by direction
+    int mCur; // stream of the last packet read, -1 = none
+    long long mCurNs;
+    unsigned long long mSkipped;
+};
+
+#endif // APDUREC_H
@@ -0,0 +1,325 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <string.h>
+#include <chrono>
+#include "bdtrfwd.h"
+#include "bdtr.h"
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#define closesocket_ closesocket
+#else
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#define closesocket_ close
+#endif
+
+// the point records start after COD, NRPT and ORIG, the same for every message type
+static const int HeaderSize = 3;
+
+TBdtrForwarder::TBdtrForwarder()
+{
+    mPool = new unsigned char[PoolSize * MaxDatagram];
+    mCount = 0;
+    mFirstUs = 0;
+    mNumDest = 0;
+    mOrig = 0;
+    mMaxDelayUs = 500;
+    mPointsSent = 0;
+    mDatagramsSent = 0;
+    mSendCalls = 0;
+    mSendErrors = 0;
+    mPointsPending = 0;
+    mSock = mOwnSock = socket( AF_INET, SOCK_DGRAM, 0 );
+}
+
+TBdtrForwarder::~TBdtrForwarder()
+{
+    flush();
+    closesocket_( mOwnSock );
+    delete[] mPool;
+}
+
+bool TBdtrForwarder::bindPort( unsigned short port )
+{
+    mSock = mOwnSock;
+    int on = 1;
+    setsockopt( mOwnSock, SOL_SOCKET, SO_REUSEADDR, (const char *)&on, sizeof(on) );
+    struct sockaddr_in a;
+    memset( &a, 0, sizeof(a) );
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl( INADDR_ANY );
+    a.sin_port = htons( port );
+    return bind( mOwnSock, (const struct sockaddr *)&a, sizeof(a) ) == 0;
+}
+
+void TBdtrForwarder::useSocket( TSocket s )
+{
+    flush(); // what is pending goes out from the previous socket
+    mSock = s;
+}
+
+long long TBdtrForwarder::nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+bool TBdtrForwarder::addDestination( const char * ip, unsigned short port )
+{
+    if ( mNumDest >= MaxDestinations )
+      return false;
+
+    struct sockaddr_in & a = mDest[mNumDest];
+    memset( &a, 0, sizeof(a) );
+    a.sin_family = AF_INET;
+    a.sin_port = htons( port );
+    if ( inet_pton( AF_INET, ip, &a.sin_addr ) != 1 )
+      return false;
+    mNumDest++;
+    return true;
+}
+
+void TBdtrForwarder::setOrigin( unsigned char orig )
+{
+    mOrig = orig;
+}
+
+void TBdtrForwarder::setMaxDelayUs( int us )
+{
+    mMaxDelayUs = us;
+}
+
+long long TBdtrForwarder::deadline() const
+{
+    return ( mCount > 0 ) ? mFirstUs + mMaxDelayUs : 0;
+}
+
+void TBdtrForwarder::poll()
+{
+    if ( mCount > 0 && nowUs() >= mFirstUs + mMaxDelayUs )
+      flush();
+}
+
+unsigned char * TBdtrForwarder::openDatagram( unsigned char cod, int recsize )
+{
+    if ( mCount > 0 )
+      {
+      unsigned char * d = mPool + ( mCount - 1 ) * MaxDatagram;
+      if ( d[0] == cod && d[1] < 255 && mLen[mCount - 1] + recsize <= MaxDatagram )
+        {
+        d[1]++;
+        mLen[mCount - 1] += recsize;
+        return d + mLen[mCount - 1] - recsize;
+        }
+      }
+
+    if ( mCount >= PoolSize )
+      flush();
+    if ( mCount == 0 )
+      mFirstUs = nowUs();
+
+    unsigned char * d = mPool + mCount * MaxDatagram;
+    d[0] = cod;
+    d[1] = 1;
+    d[2] = mOrig;
+    mLen[mCount] = HeaderSize + recsize;
+    mCount++;
+    return d + HeaderSize;
+}
+
+bool TBdtrForwarder::forward( const iec_obj * obj, int numpoints )
+{
+    unsigned char cod;
+    int recsize;
+    TFA_Qual qfa;
+
+    switch ( obj->type )
+      {
+      case iec104_class::M_DP_TB_1: // duplo com tag
+      case iec104_class::M_SP_TB_1: // simples com tag
+        cod = T_DIG_TAG;
+        recsize = sizeof( A_dig_tag );
+        break;
+      case iec104_class::M_DP_NA_1: // duplo sem tag
+      case iec104_class::M_SP_NA_1: // simples sem tag
+        cod = T_DIG;
+        recsize = sizeof( A_dig );
+        break;
+      case iec104_class::M_ST_NA_1: // tap
+      case iec104_class::M_ME_NB_1: // 11
+        cod = T_ANA;
+        recsize = sizeof( A_ana );
+        break;
+      case iec104_class::M_ME_NA_1: // 9
+        cod = T_NORM;
+        recsize = sizeof( A_ana );
+        break;
+      case iec104_class::M_ME_NC_1: // 13
+        cod = T_FLT;
+        recsize = sizeof( A_float );
+        break;
+      default:
+        return false;
+      }
+    if ( obj->cause == iec104_class::CYCLIC )
+      cod |= T_CIC;
+    if ( obj->cause == iec104_class::SPONTANEOUS )
+      cod |= T_SPONT;
+
+    // a burst that keeps coming must not hold the oldest points
+    poll();
+
+    for ( int cntpnt = 0; cntpnt < numpoints; cntpnt++, obj++ )
+      {
+      unsigned char * rec = openDatagram( cod, recsize );
+
+      // converte o qualificador do IEC para formato A do PABD/BDTR
+      qfa.Byte = 0;
+      qfa.Subst = obj->bl || obj->sb;
+      switch ( cod & T_TIPO )
+        {
+        case T_DIG: // with or without time tag (T_TIME is not in T_TIPO)
+          qfa.Tipo = TFA_TIPODIG;
+          qfa.Falha = obj->iv || obj->nt;
+          if ( obj->type == iec104_class::M_DP_TB_1 || obj->type == iec104_class::M_DP_NA_1 )
+            {
+            qfa.Duplo = obj->dp;
+            }
+          else
+            { // simples para duplo
+            qfa.Estado = !obj->sp;
+            qfa.EstadoH = obj->sp;
+            }
+          if ( cod & T_TIME )
+            {
+            A_dig_tag * p = (A_dig_tag *)rec;
+            qfa.FalhaTag = obj->timetag.iv;
+            p->ID = obj->address;
+            p->UTR = obj->ca;
+            p->STAT = qfa.Byte;
+            p->TAG.ANO = 2000 + obj->timetag.year;
+            p->TAG.MES = obj->timetag.month;
+            p->TAG.DIA = obj->timetag.mday;
+            p->TAG.HORA = obj->timetag.hour;
+            p->TAG.MINUTO = obj->timetag.min;
+            p->TAG.MSEGS = obj->timetag.msec;
+            }
+          else
+            {
+            A_dig * p = (A_dig *)rec;
+            p->ID = obj->address;
+            p->STAT = qfa.Byte;
+            }
+          break;
+        case T_ANA:
+        case T_NORM:
+          {
+          A_ana * p = (A_ana *)rec;
+          qfa.Tipo = TFA_TIPOANA;
+          qfa.Falha = obj->iv || obj->nt || obj->ov;
+          if ( obj->type == iec104_class::M_ST_NA_1 ) // tap
+             qfa.Falha = qfa.Falha || obj->t; // transient = falha
+          p->ID = obj->address;
+          p->STAT = qfa.Byte;
+          p->VALOR = obj->value;
+          }
+          break;
+        case T_FLT:
+          {
+          A_float * p = (A_float *)rec;
+          qfa.Tipo = TFA_TIPOANA;
+          qfa.Falha = obj->iv || obj->nt || obj->ov;
+          p->ID = obj->address;
+          p->STAT = qfa.Byte;
+          p->VALOR = obj->value;
+          }
+          break;
+        }
+      }
+
+    mPointsPending += numpoints;
+    return true;
+}
+
+void TBdtrForwarder::flush()
+{
+    if ( mCount == 0 )
+      return;
+
+    int total = mCount * mNumDest;
+#if defined(__linux__)
+    // every datagram to every destination in one call
+    struct mmsghdr msgs[PoolSize * MaxDestinations];
+    struct iovec iov[PoolSize];
+    int n = 0;
+    for ( int i = 0; i < mCount; i++ )
+      {
+      iov[i].iov_base = mPool + i * MaxDatagram;
+      iov[i].iov_len = mLen[i];
+      for ( int d = 0; d < mNumDest; d++, n++ )
+        {
+        memset( &msgs[n], 0, sizeof(msgs[n]) );
+        msgs[n].msg_hdr.msg_name = &mDest[d];
+        msgs[n].msg_hdr.msg_namelen = sizeof( mDest[d] );
+        msgs[n].msg_hdr.msg_iov = &iov[i];
+        msgs[n].msg_hdr.msg_iovlen = 1;
+        }
+      }
+    for ( int sent = 0; sent < total; )
+      {
+      mSendCalls++;
+      int r = sendmmsg( mSock, msgs + sent, total - sent, 0 );
+      if ( r <= 0 )
+        { // the datagram that failed is skipped
+        mSendErrors++;
+        sent++;
+        continue;
+        }
+      sent += r;
+      mDatagramsSent += r;
+      }
+#else
+    for ( int i = 0; i < mCount; i++ )
+      for ( int d = 0; d < mNumDest; d++ )
+        {
+        mSendCalls++;
+        if ( sendto( mSock, (const char *)( mPool + i * MaxDatagram ), mLen[i], 0, (const struct sockaddr *)&mDest[d], sizeof(mDest[d]) ) < 0 )
+          mSendErrors++;
+        else
+          mDatagramsSent++;
+        }
+    (void)total;
+#endif
+
+    mPointsSent += mPointsPending;
+    mPointsPending = 0;
+    mCount = 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef BDTRFWD_H
+#define BDTRFWD_H
+
+// Forwarding of IEC104 points to BDTR clients by UDP.
+// Points are packed in msg_dig / msg_dig_tag / msg_ana / msg_float datagrams of up to an ethernet MTU, in buffers
+// allocated once. Points go to the last datagram while its code (type, cyclic/spontaneous) does not change,
+// so the order of the points is kept across datagrams. Datagrams are sent, to every destination, with one
+// sendmmsg() call (sendto() per datagram where sendmmsg is not available) when the pool is full, when flush()
+// is called or when the oldest point waits longer than the maximum delay.
+// BDTR peers know the gateway by the source port of its datagrams: send from the socket bound to the BDTR port
+// (useSocket) or bind the forwarder's own socket to it (bindPort), else the datagrams leave from a random port.
+
+#include "iec104_class.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <netinet/in.h>
+#endif
+
+class TBdtrForwarder
+{
+public:
+#ifdef _WIN32
+    typedef SOCKET TSocket;
+#else
+    typedef int TSocket;
+#endif
+
+    TBdtrForwarder();
+    ~TBdtrForwarder();
+
+    bool bindPort( unsigned short port ); // source port of the datagrams (SO_REUSEADDR), false if it can't be bound
+    void useSocket( TSocket s ); // send from s, a udp socket owned (and bound) by the caller
+    TSocket getSocket() const { return mSock; } // for useSocket of another forwarder (sendmmsg is thread safe)
+
+    bool addDestination( const char * ip, unsigned short port ); // up to MaxDestinations, false if ip is not valid
+    void setOrigin( unsigned char orig ); // BDTR origin address of the messages
+    void setMaxDelayUs( int us ); // longest wait of a point before it is sent, default 500 us
+
+    bool forward( const iec_obj * obj, int numpoints ); // objects of one asdu, false if the type is not forwarded to BDTR
+    bool pending() const { return mCount > 0; }
+    long long deadline() const; // steady clock us when the pending points must be sent, 0 if nothing pending
+    void poll(); // flush if the deadline has passed
+    void flush(); // send the pending datagrams now
+
+    static long long nowUs(); // steady clock, us
+
+    unsigned long long getPointsSent() const { return mPointsSent; }
+    unsigned long long getDatagramsSent() const { return mDatagramsSent; } // counted once per destination
+    unsigned long long getSendCalls() const { return mSendCalls; }
+    unsigned long long getSendErrors() const { return mSendErrors; }
+
+    static const int MaxDestinations = 2; // the BDTR host and its dual
+    static const int MaxDatagram = 1472; // udp payload of a 1500 byte ethernet frame
+    static const int PoolSize = 32; // datagrams waiting to be sent
+
+private:
+    TBdtrForwarder( const TBdtrForwarder & );
+    TBdtrForwarder & operator=( const TBdtrForwarder & );
+
+    unsigned char * openDatagram( unsigned char cod, int recsize ); // record space in the last datagram, opens a new one when needed
+
+    unsigned char * mPool; // PoolSize buffers of MaxDatagram bytes
+    int mLen[PoolSize];
+    int mCount; // datagrams in use, the last one is open
+    long long mFirstUs; // time of the oldest pending point
+
+    TSocket mSock;
+    TSocket mOwnSock; // created by the forwarder, closed in the destructor
+    struct sockaddr_in mDest[MaxDestinations];
+    int mNumDest;
+    unsigned char mOrig;
+    int mMaxDelayUs;
+
+    unsigned long long mPointsSent;
+    unsigned long long mDatagramsSent;
+    unsigned long long mSendCalls;
+    unsigned long long mSendErrors;
+    unsigned long long mPointsPending;
+};
+
+#endif // BDTRFWD_H
@@ -0,0 +1,665 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+// Microbenchmarks of the protocol hot paths.
+// Every case is run until --min-time seconds have passed; the report gives ns per operation, ns per object
+// and heap allocations per operation (counted because bench.pro defines IEC104_COUNT_ALLOCS).
+//   bench104 [--filter text] [--min-time s] [--json file]
+// The json file has the layout of Google Benchmark's --benchmark_out, so its compare tools can diff two runs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include "iec104_class.h"
+#include "squnpack.h"
+#include "cp56time.h"
+#include "logmsg.h"
+#include "pointtable.h"
+#include "bdtrfwd.h"
+#include "alloccnt.h"
+#include "latency.h"
+
+using namespace std;
+
+static double nowSec()
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+struct TBenchCase {
+    string name;
+    int objects; // per operation, 0 = not an object path
+    std::function<void()> op;
+};
+
+struct TBenchResult {
+    string name;
+    long long iterations;
+    double nsPerOp;
+    double cpuNsPerOp;
+    double nsPerObject;
+    double allocsPerOp;
+    int objects;
+};
+
+static vector <TBenchCase> cases;
+
+static void add( const string & name, int objects, std::function<void()> op )
+{
+    TBenchCase c;
+    c.name = name;
+    c.objects = objects;
+    c.op = op;
+    cases.push_back( c );
+}
+
+// runs the operation in doubling rounds until mintime has passed
+static TBenchResult run( const TBenchCase & c, double mintime )
+{
+    TBenchResult r;
+    r.name = c.name;
+    r.objects = c.objects;
+
+    // allocations of a warm operation (the first ones may fill caches)
+    for ( int i = 0; i < 16; i++ )
+      c.op();
+    unsigned long long a0 = allocCount();
+    for ( int i = 0; i < 256; i++ )
+      c.op();
+    r.allocsPerOp = ( allocCount() - a0 ) / 256.0;
+
+    long long calls = 0;
+    long long n = 64;
+    clock_t c0 = clock();
+    double t0 = nowSec();
+    double dt;
+    while ( true )
+      {
+      for ( long long i = 0; i < n; i++ )
+        c.op();
+      calls += n;
+      dt = nowSec() - t0;
+      if ( dt >= mintime )
+        break;
+      n *= 2;
+      }
+    double cpu = (double)( clock() - c0 ) / CLOCKS_PER_SEC;
+
+    r.iterations = calls;
+    r.nsPerOp = dt * 1e9 / calls;
+    r.cpuNsPerOp = cpu * 1e9 / calls;
+    r.nsPerObject = c.objects > 0 ? r.nsPerOp / c.objects : 0;
+    return r;
+}
+
+// ---- parseAPDU ----
+
+static const struct {
+    unsigned char type;
+    const char * name;
+    int elemsz; // bytes of an information element, without the address
+} monitorTypes[] = {
+    { iec104_class::M_SP_NA_1, "M_SP_NA_1", 1 },
+    { iec104_class::M_DP_NA_1, "M_DP_NA_1", 1 },
+    { iec104_class::M_ME_NA_1, "M_ME_NA_1", 3 },
+    { iec104_class::M_ME_NB_1, "M_ME_NB_1", 3 },
+    { iec104_class::M_ME_NC_1, "M_ME_NC_1", 5 },
+    { iec104_class::M_SP_TB_1, "M_SP_TB_1", 8 },
+    { iec104_class::M_DP_TB_1, "M_DP_TB_1", 8 },
+    { iec104_class::M_ME_TD_1, "M_ME_TD_1", 10 },
+    { iec104_class::M_ME_TE_1, "M_ME_TE_1", 10 },
+    { iec104_class::M_ME_TF_1, "M_ME_TF_1", 12 },
+};
+
+// most elements of a type in one apdu (253 bytes after the length)
+static int maxElements( int elemsz, bool sq )
+{
+    int room = 253 - 4 - (int)sizeof(iec_unit_id);
+    int num = sq ? ( room - 3 ) / elemsz : room / ( 3 + elemsz );
+    return num > 127 ? 127 : num;
+}
+
+// an asdu of num elements of the given type with pseudo random values and quality bits, returns the apdu size
+static int buildASDU( iec_apdu & apdu, unsigned char type, int elemsz, int num, bool sq )
+{
+    memset( &apdu, 0, sizeof(apdu) );
+    apdu.start = iec104_class::START;
+    apdu.asduh.type = type;
+    apdu.asduh.num = num;
+    apdu.asduh.sq = sq;
+    apdu.asduh.cause = 3;
+    apdu.asduh.ca = 1;
+    unsigned seed = 12345;
+    unsigned char * p = apdu.dados;
+    for ( int j = 0; j < num; j++ )
+      {
+      if ( j == 0 || !sq )
+        {
+        unsigned ioa = 1000 + j;
+        *p++ = ioa; *p++ = ioa >> 8; *p++ = ioa >> 16;
+        }
+      for ( int i = 0; i < elemsz; i++ )
+        {
+        seed = seed * 1103515245 + 12345;
+        *p++ = seed >> 16;
+        }
+      if ( elemsz >= 8 ) // a valid time tag: 2023-11-14 22:13
+        {
+        unsigned char * t = p - 7;
+        t[2] = 13; t[3] = 22; t[4] = 14 | ( 2 << 5 ); t[5] = 11; t[6] = 23;
+        }
+      }
+    int sz = p - (unsigned char *)&apdu;
+    apdu.length = sz - 2;
+    return sz;
+}
+
+// the object decoder followed by the split of the objects to value and quality arrays
+class TBenchSession : public iec104_class
+{
+public:
+    TBenchSession() { mLog.deactivateLog(); setSecondaryAddress( 1 ); }
+    void decode( const iec_apdu * papdu, int sz ) { parseAPDU( papdu, sz, false ); }
+    float value[127];
+    unsigned char quality[127];
+private:
+    void connectTCP() {}
+    void disconnectTCP() {}
+    int readTCP( char *, int ) { return 0; }
+    void sendTCP( char *, int ) {}
+    void dataIndication( iec_obj * obj, int numpoints )
+        {
+        for ( int i = 0; i < numpoints; i++ )
+          {
+          value[i] = obj[i].value;
+          quality[i] = qualityOf( obj[i] );
+          }
+        }
+};
+
+static void addParse()
+{
+    static TBenchSession session;
+    static iec_apdu apdus[sizeof(monitorTypes) / sizeof(monitorTypes[0])][2][3];
+    for ( unsigned t = 0; t < sizeof(monitorTypes) / sizeof(monitorTypes[0]); t++ )
+      for ( int sq = 0; sq < 2; sq++ )
+        {
+        int sizes[3] = { 1, 16, maxElements( monitorTypes[t].elemsz, sq ) };
+        for ( int s = 0; s < 3; s++ )
+          {
+          if ( s == 2 && sizes[2] == sizes[1] )
+            break;
+          iec_apdu * a = &apdus[t][sq][s];
+          int sz = buildASDU( *a, monitorTypes[t].type, monitorTypes[t].elemsz, sizes[s], sq );
+          add( string( "parseAPDU/" ) + monitorTypes[t].name + ( sq ? "/SQ/" : "/NSQ/" ) + to_string( sizes[s] ),
+               sizes[s], [=]() { session.decode( a, sz ); } );
+          }
+        }
+}
+
+// ---- packetReadyTCP: framing of a tcp stream of apdus ----
+
+class TStreamSession : public iec104_class
+{
+public:
+    TStreamSession() : objects( 0 ), mPos( 0 )
+        {
+        mLog.deactivateLog();
+        setSecondaryAddress( 1 );
+        disableSequenceOrderCheck();
+        setW( 127 );
+        }
+    // the stream: count copies of the apdu, read by the session in chunks of up to 4096 bytes
+    void setStream( const iec_apdu & apdu, int sz, int count )
+        {
+        mStream.clear();
+        for ( int i = 0; i < count; i++ )
+          mStream.insert( mStream.end(), (const char *)&apdu, (const char *)&apdu + sz );
+        }
+    void receive() { mPos = 0; onConnectTCP(); packetReadyTCP(); }
+    unsigned long long objects;
+private:
+    void connectTCP() {}
+    void disconnectTCP() {}
+    int readTCP( char * buf, int szmax )
+        {
+        int n = (int)mStream.size() - (int)mPos;
+        if ( n > szmax )
+          n = szmax;
+        memcpy( buf, &mStream[mPos], n );
+        mPos += n;
+        return n;
+        }
+    void sendTCP( char *, int ) {}
+    void dataIndication( iec_obj *, int numpoints ) { objects += numpoints; }
+    vector <char> mStream;
+    size_t mPos;
+};
+
+static void addFraming()
+{
+    static TStreamSession frames, data, timed;
+    static TLatencyStats stats;
+    static iec_apdu apdu;
+
+    // control frames only: the cost of framing
+    memset( &apdu, 0, sizeof(apdu) );
+    apdu.start = iec104_class::START;
+    apdu.length = 4;
+    apdu.NS = iec104_class::TESTFRCON;
+    frames.setStream( apdu, 6, 1000 );
+    add( "packetReadyTCP/TESTFRCON/1000", 1000, []() { frames.receive(); } ); // objects: frames
+
+    // a stream of small measurement asdus, as in a busy substation
+    int sz = buildASDU( apdu, iec104_class::M_ME_NC_1, 5, 10, false );
+    data.setStream( apdu, sz, 200 );
+    data.receive();
+    if ( data.objects != 10 * 200 )
+      fprintf( stderr, "packetReadyTCP: %llu objects decoded of 2000\n", data.objects );
+    add( "packetReadyTCP/M_ME_NC_1/NSQ/10x200", 10 * 200, []() { data.receive(); } );
+
+    // the same with the stages of every frame timed, see latency.h
+    timed.setStream( apdu, sz, 200 );
+    timed.setLatencyStats( &stats );
+    add( "packetReadyTCP/M_ME_NC_1/NSQ/10x200/latency", 10 * 200, []() { timed.receive(); } );
+}
+
+// ---- sendCommand: encoding and transmission of a command, acknowledged by an S-frame ----
+
+class TCommandSession : public iec104_class
+{
+public:
+    TCommandSession() : mNS( 0 )
+        {
+        mLog.deactivateLog();
+        setSecondaryAddress( 1 );
+        TxOk = true;
+        }
+    void command( iec_obj & obj )
+        {
+        check( sendCommand( &obj ) );
+        ack();
+        }
+    void command( iec_cmdtpl & tpl )
+        {
+        check( sendCommand( &tpl, 1 ) );
+        ack();
+        }
+    void batch( iec_cmdtpl * tpl, int n )
+        {
+        beginCommandBatch();
+        for ( int i = 0; i < n; i++ )
+          check( sendCommand( &tpl[i], 1 ) );
+        endCommandBatch();
+        ack();
+        }
+    // a command not sent would make the case time nothing
+    static void check( bool sent )
+        {
+        if ( !sent )
+          {
+          fprintf( stderr, "sendCommand: command not sent\n" );
+          exit( 1 );
+          }
+        }
+    // the slave acknowledges what was sent, so the k window never fills
+    void ack()
+        {
+        unsigned char s[6] = { iec104_class::START, 4, 1, 0, 0, 0 };
+        unsigned short nr = mNS + 2;
+        memcpy( s + 4, &nr, 2 );
+        parseAPDU( (const iec_apdu *)s, 6 );
+        }
+private:
+    void connectTCP() {}
+    void disconnectTCP() {}
+    int readTCP( char *, int ) { return 0; }
+    void sendTCP( char * data, int sz )
+        {
+        // the NS of the last I-frame written
+        for ( int i = 0; i < sz; i += (unsigned char)data[i + 1] + 2 )
+          if ( data[i + 1] > 4 )
+            mNS = ( (const iec_apdu *)( data + i ) )->NS;
+        }
+    void dataIndication( iec_obj *, int ) {}
+    unsigned short mNS;
+};
+
+static void addCommands()
+{
+    static TCommandSession session;
+    static const struct {
+        unsigned char type;
+        const char * name;
+    } commandTypes[] = {
+        { iec104_class::C_SC_NA_1, "C_SC_NA_1" },
+        { iec104_class::C_DC_NA_1, "C_DC_NA_1" },
+        { iec104_class::C_SC_TA_1, "C_SC_TA_1" },
+        { iec104_class::C_DC_TA_1, "C_DC_TA_1" },
+    };
+    for ( unsigned i = 0; i < sizeof(commandTypes) / sizeof(commandTypes[0]); i++ )
+      {
+      unsigned char type = commandTypes[i].type;
+      add( string( "sendCommand/" ) + commandTypes[i].name, 1, [=]() {
+          iec_obj obj;
+          memset( &obj, 0, sizeof(obj) );
+          obj.type = type;
+          obj.address = 5000;
+          obj.scs = 1;
+          session.command( obj );
+          } );
+
+      // encoded once by prepareCommand
+      static iec_cmdtpl tpl[sizeof(commandTypes) / sizeof(commandTypes[0])];
+      session.prepareCommand( &tpl[i], 5000, type );
+      iec_cmdtpl * t = &tpl[i];
+      add( string( "sendCommand/template/" ) + commandTypes[i].name, 1, [=]() { session.command( *t ); } );
+
+      // a burst of commands to different points written at once
+      static const int burst = 12; // the default k
+      static iec_cmdtpl burstTpl[sizeof(commandTypes) / sizeof(commandTypes[0])][burst];
+      for ( int j = 0; j < burst; j++ )
+        session.prepareCommand( &burstTpl[i][j], 5000 + j, type );
+      iec_cmdtpl * b = burstTpl[i];
+      add( string( "sendCommand/batch/" ) + commandTypes[i].name + "/12", burst, [=]() { session.batch( b, burst ); } );
+      }
+}
+
+// ---- TLogMsg ----
+
+static void addLog()
+{
+    static TLogMsg on, off;
+    on.activateLog();
+    off.deactivateLog();
+    static const unsigned char frame[25] = { 0x68, 0x17, 0x02, 0x00, 0x04, 0x00, 0x0D, 0x01, 0x03, 0x00, 0x01, 0x00 };
+    add( "TLogMsg/pushEvent/inactive", 0, []() { off.pushEvent( 0, "    CA %u TYPE %u CAUSE %d SQ %u NUM %u", 1, 13, 3, 0, 1 ); } );
+    add( "TLogMsg/pushEvent+pullMsg", 0, []() {
+        on.pushEvent( 0, "    CA %u TYPE %u CAUSE %d SQ %u NUM %u", 1, 13, 3, 0, 1 );
+        on.pullMsg();
+        } );
+    add( "TLogMsg/pushDump+pullMsg", 0, []() {
+        on.pushDump( 0, "--> %03d: ", 25, frame, 25 );
+        on.pullMsg();
+        } );
+}
+
+// ---- BDTR forwarding: packing of decoded objects in datagrams (no destination, nothing is sent) ----
+
+static void addBdtr()
+{
+    static TBdtrForwarder fwd;
+    static iec_obj digital[127], tagged[127], analog[127];
+    TCp56Time conv;
+    for ( int i = 0; i < 127; i++ )
+      {
+      memset( &digital[i], 0, sizeof(iec_obj) );
+      digital[i].type = iec104_class::M_SP_NA_1;
+      digital[i].cause = 3;
+      digital[i].address = 1000 + i;
+      digital[i].sp = i & 1;
+      tagged[i] = digital[i];
+      tagged[i].type = iec104_class::M_SP_TB_1;
+      conv.fromUs( 1700000000000000LL + i * 3500LL, tagged[i].timetag );
+      analog[i] = digital[i];
+      analog[i].type = iec104_class::M_ME_NC_1;
+      analog[i].value = i * 0.5f;
+      }
+    add( "BDTR/forward/M_SP_NA_1/127", 127, []() { fwd.forward( digital, 127 ); } );
+    add( "BDTR/forward/M_SP_TB_1/127", 127, []() { fwd.forward( tagged, 127 ); } );
+    add( "BDTR/forward/M_ME_NC_1/127", 127, []() { fwd.forward( analog, 127 ); } );
+}
+
+// ---- point table: update by the protocol, refresh of the points view ----
+
+static void addPointTable()
+{
+    static TPointTable table( 20000 );
+    static iec_obj obj[127];
+    static unsigned base = 0;
+    static unsigned changed[1024];
+    for ( int i = 0; i < 127; i++ )
+      {
+      memset( &obj[i], 0, sizeof(iec_obj) );
+      obj[i].type = iec104_class::M_ME_NC_1;
+      obj[i].cause = 3;
+      obj[i].ca = 1;
+      }
+    // 127 points of 10000, a new value each time
+    auto next = []() {
+        for ( int i = 0; i < 127; i++ )
+          {
+          obj[i].address = ( base + i ) % 10000;
+          obj[i].value += 1;
+          }
+        base += 127;
+        };
+    add( "TPointTable/update/127", 127, [=]() { next(); table.update( obj, 127 ); } );
+    // what the 10 Hz refresh of MainWindow does with the changed points
+    add( "TPointTable/update+pullChanged+readSlot/127", 127, [=]() {
+        next();
+        table.update( obj, 127 );
+        TPointData pd;
+        unsigned n;
+        while ( ( n = table.pullChanged( changed, 1024 ) ) > 0 )
+          for ( unsigned i = 0; i < n; i++ )
+            table.readSlot( changed[i], pd );
+        } );
+}
+
+// ---- sequenced asdu unpack kernels ----
+
+typedef void (*TUnpack)( const unsigned char *, int, float *, unsigned char * );
+
+static void addUnpack( const char * name, unsigned char type, int elemsz, TUnpack scalar, TUnpack vector )
+{
+    static float value[127];
+    static unsigned char quality[127];
+    static iec_apdu apdus[3];
+    static TBenchSession session;
+    static int used = 0;
+    iec_apdu * a = &apdus[used++];
+    int num = maxElements( elemsz, true );
+    int sz = buildASDU( *a, type, elemsz, num, true );
+
+    // the kernels must agree with the object decoder
+    session.decode( a, sz );
+    for ( int k = 0; k < 2; k++ )
+      {
+      ( k ? vector : scalar )( a->dados + 3, num, value, quality );
+      if ( memcmp( value, session.value, num * sizeof(float) ) != 0 || memcmp( quality, session.quality, num ) != 0 )
+        fprintf( stderr, "%s %s kernel: MISMATCH with the object decoder\n", name, k ? "vector" : "scalar" );
+      }
+
+    add( string( "sqUnpack/" ) + name + "/scalar", num, [=]() { scalar( a->dados + 3, num, value, quality ); } );
+    add( string( "sqUnpack/" ) + name + "/" + sqUnpackIsa(), num, [=]() { vector( a->dados + 3, num, value, quality ); } );
+}
+
+// ---- cp56time2a conversion, time tags of an SOE burst: 127 objects of one day, a few ms apart ----
+
+static void addCp56()
+{
+    static iec_obj obj[127];
+    static long long us[127];
+    static TCp56Time conv;
+    static cp56time2a t;
+    static const long long t0 = 1700000000000000LL;
+    for ( int i = 0; i < 127; i++ )
+      conv.fromUs( t0 + i * 3500LL, obj[i].timetag );
+
+    add( "cp56/toUs/timegm", 127, []() {
+        for ( int i = 0; i < 127; i++ )
+          {
+          struct tm tm;
+          memset( &tm, 0, sizeof(tm) );
+          tm.tm_year = 100 + obj[i].timetag.year;
+          tm.tm_mon = obj[i].timetag.month - 1;
+          tm.tm_mday = obj[i].timetag.mday;
+          tm.tm_hour = obj[i].timetag.hour;
+          tm.tm_min = obj[i].timetag.min;
+          us[i] = (long long)timegm( &tm ) * 1000000 + obj[i].timetag.msec * 1000LL;
+          }
+        } );
+    add( "cp56/toUs/cached", 127, []() {
+        for ( int i = 0; i < 127; i++ )
+          us[i] = conv.toUs( obj[i].timetag );
+        } );
+    add( "cp56/toUs/batch", 127, []() { conv.toUs( &obj[0].timetag, sizeof(iec_obj), 127, us ); } );
+    add( "cp56/fromUs/gmtime_r", 127, []() {
+        for ( int i = 0; i < 127; i++ )
+          {
+          time_t s = (time_t)( ( t0 + i * 3500LL ) / 1000000 );
+          struct tm tm;
+          gmtime_r( &s, &tm );
+          t.hour = tm.tm_hour;
+          }
+        } );
+    add( "cp56/fromUs/cached", 127, []() {
+        for ( int i = 0; i < 127; i++ )
+          conv.fromUs( t0 + i * 3500LL, t );
+        } );
+
+    conv.toUs( &obj[0].timetag, sizeof(iec_obj), 127, us );
+    if ( us[126] != t0 + 126 * 3500LL / 1000 * 1000 )
+      fprintf( stderr, "cp56 batch conversion: MISMATCH\n" );
+}
+
+static string jsonString( const string & s )
+{
+    string r = "\"";
+    for ( size_t i = 0; i < s.size(); i++ )
+      {
+      if ( s[i] == '"' || s[i] == '\\' )
+        r += '\\';
+      r += s[i];
+      }
+    return r + "\"";
+}
+
+static bool writeJson( const char * filename, const vector <TBenchResult> & results, double mintime )
+{
+    FILE * f = fopen( filename, "w" );
+    if ( f == NULL )
+      return false;
+
+    char date[64];
+    time_t now = time( NULL );
+    struct tm tm;
+    localtime_r( &now, &tm );
+    strftime( date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", &tm );
+
+    fprintf( f, "{\n  \"context\": {\n" );
+    fprintf( f, "    \"date\": \"%s\",\n", date );
+    fprintf( f, "    \"executable\": \"bench104\",\n" );
+    fprintf( f, "    \"vector_isa\": \"%s\",\n", sqUnpackIsa() );
+    fprintf( f, "    \"alloc_counting\": %s,\n", allocCountEnabled() ? "true" : "false" );
+    fprintf( f, "    \"min_time\": %g\n", mintime );
+    fprintf( f, "  },\n  \"benchmarks\": [\n" );
+    for ( size_t i = 0; i < results.size(); i++ )
+      {
+      const TBenchResult & r = results[i];
+      fprintf( f, "    {\n" );
+      fprintf( f, "      \"name\": %s,\n", jsonString( r.name ).c_str() );
+      fprintf( f, "      \"run_name\": %s,\n", jsonString( r.name ).c_str() );
+      fprintf( f, "      \"run_type\": \"iteration\",\n" );
+      fprintf( f, "      \"iterations\": %lld,\n", r.iterations );
+      fprintf( f, "      \"real_time\": %.3f,\n", r.nsPerOp );
+      fprintf( f, "      \"cpu_time\": %.3f,\n", r.cpuNsPerOp );
+      fprintf( f, "      \"time_unit\": \"ns\",\n" );
+      fprintf( f, "      \"objects_per_op\": %d,\n", r.objects );
+      fprintf( f, "      \"ns_per_object\": %.3f,\n", r.nsPerObject );
+      fprintf( f, "      \"allocs_per_op\": %.3f\n", r.allocsPerOp );
+      fprintf( f, "    }%s\n", i + 1 < results.size() ? "," : "" );
+      }
+    fprintf( f, "  ]\n}\n" );
+    return fclose( f ) == 0;
+}
+
+int main( int argc, char * argv[] )
+{
+    const char * filter = "";
+    const char * json = NULL;
+    double mintime = 0.2;
+    for ( int i = 1; i < argc; i++ )
+      {
+      if ( strcmp( argv[i], "--filter" ) == 0 && i + 1 < argc )
+        filter = argv[++i];
+      else if ( strcmp( argv[i], "--json" ) == 0 && i + 1 < argc )
+        json = argv[++i];
+      else if ( strcmp( argv[i], "--min-time" ) == 0 && i + 1 < argc )
+        mintime = atof( argv[++i] );
+      else
+        {
+        printf( "bench104 [--filter text] [--min-time s] [--json file]\n" );
+        return 1;
+        }
+      }
+
+    addFraming();
+    addParse();
+    addCommands();
+    addLog();
+    addBdtr();
+    addPointTable();
+    addUnpack( "M_SP_NA_1", iec104_class::M_SP_NA_1, 1, sqUnpack1Scalar, sqUnpack1 );
+    addUnpack( "M_ME_NB_1", iec104_class::M_ME_NB_1, 3, sqUnpack11Scalar, sqUnpack11 );
+    addUnpack( "M_ME_NC_1", iec104_class::M_ME_NC_1, 5, sqUnpack13Scalar, sqUnpack13 );
+    addCp56();
+
+    if ( !allocCountEnabled() )
+      printf( "allocations not counted: build with IEC104_COUNT_ALLOCS defined\n" );
+    printf( "%-46s %12s %10s %10s %10s %10s\n", "benchmark", "iterations", "ns/op", "ns/obj", "Mobj/s", "allocs/op" );
+
+    vector <TBenchResult> results;
+    for ( size_t i = 0; i < cases.size(); i++ )
+      {
+      if ( strstr( cases[i].name.c_str(), filter ) == NULL )
+        continue;
+      TBenchResult r = run( cases[i], mintime );
+      results.push_back( r );
+      if ( r.objects > 0 )
+        printf( "%-46s %12lld %10.1f %10.2f %10.1f %10.2f\n", r.name.c_str(), r.iterations, r.nsPerOp, r.nsPerObject,
+                1e3 / r.nsPerObject, r.allocsPerOp );
+      else
+        printf( "%-46s %12lld %10.1f %10s %10s %10.2f\n", r.name.c_str(), r.iterations, r.nsPerOp, "-", "-", r.allocsPerOp );
+      fflush( stdout );
+      }
+
+    if ( json != NULL && !writeJson( json, results, mintime ) )
+      {
+      fprintf( stderr, "can't write %s\n", json );
+      return 1;
+      }
+    return 0;
+}
@@ -0,0 +1,12 @@
+# -------------------------------------------------
+# Microbenchmarks of the protocol hot paths (no Qt), run ./bench104 [--filter text] [--json file]
+# build with QMAKE_CXXFLAGS+=-mavx2 to measure the AVX2 kernels
+# -------------------------------------------------
+TEMPLATE = app
+TARGET = bench104
+CONFIG += console
+CONFIG -= qt app_bundle
+include( ../reactor104.pri )
+SOURCES += bench.cpp
+# allocations per operation are reported
+DEFINES += IEC104_COUNT_ALLOCS
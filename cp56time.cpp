@@ -0,0 +1,184 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include "cp56time.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define CP56TIME_SSE2
+#endif
+
+static inline unsigned dayKey( const cp56time2a & t )
+{
+    return t.mday | ( (unsigned)t.month << 8 ) | ( (unsigned)t.year << 16 );
+}
+
+TCp56Time::TCp56Time()
+{
+    mToKey = 0;
+    mToBase = 0;
+    mFromDay = -1;
+    memset( &mFromDate, 0, sizeof(mFromDate) );
+    mLocalOffset = 0;
+    mLocalUntil = 0;
+}
+
+long long TCp56Time::nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+long long TCp56Time::daysFromCivil( int year, unsigned month, unsigned mday )
+{
+    // years start in march, so that the leap day is the last one
+    year -= ( month <= 2 );
+    int era = ( year >= 0 ? year : year - 399 ) / 400;
+    unsigned yoe = (unsigned)( year - era * 400 );
+    unsigned doy = ( 153 * ( month > 2 ? month - 3 : month + 9 ) + 2 ) / 5 + mday - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (long long)era * 146097 + doe - 719468;
+}
+
+long long TCp56Time::toUsNewDay( const cp56time2a & t )
+{
+    if ( t.mday == 0 )
+      return 0; // no time tag
+    mToKey = dayKey( t );
+    mToBase = daysFromCivil( 2000 + t.year, t.month, t.mday ) * US_PER_DAY;
+    return mToBase + ( ( t.hour * 60 + t.min ) * 60000LL + t.msec ) * 1000;
+}
+
+long long TCp56Time::toUs( const cp56time2a & t )
+{
+    if ( dayKey( t ) != mToKey )
+      return toUsNewDay( t );
+    return mToBase + ( ( t.hour * 60 + t.min ) * 60000LL + t.msec ) * 1000;
+}
+
+void TCp56Time::toUs( const cp56time2a * t, int stride, int num, long long * us )
+{
+    const char * p = (const char *)t;
+    int i = 0;
+#if defined(CP56TIME_SSE2)
+    // the fields are gathered 4 at a time, tags of the cached day are then converted together:
+    // us = base + ( hour * 60 + min ) * 60000000 + msec * 1000, the 64 bit products done on even and odd lanes
+    const __m128i k60 = _mm_set1_epi32( 60 );
+    const __m128i kmin = _mm_set1_epi32( 60000000 );
+    const __m128i kms = _mm_set1_epi32( 1000 );
+    for ( ; i + 4 <= num; i += 4, p += 4 * stride )
+      {
+      const cp56time2a & t0 = *(const cp56time2a *)p;
+      const cp56time2a & t1 = *(const cp56time2a *)( p + stride );
+      const cp56time2a & t2 = *(const cp56time2a *)( p + 2 * stride );
+      const cp56time2a & t3 = *(const cp56time2a *)( p + 3 * stride );
+      if ( mToKey == 0 || dayKey( t0 ) != mToKey || dayKey( t1 ) != mToKey || dayKey( t2 ) != mToKey || dayKey( t3 ) != mToKey )
+        {
+        us[i] = toUs( t0 );
+        us[i + 1] = toUs( t1 );
+        us[i + 2] = toUs( t2 );
+        us[i + 3] = toUs( t3 );
+        continue;
+        }
+      __m128i hour = _mm_setr_epi32( t0.hour, t1.hour, t2.hour, t3.hour );
+      __m128i min = _mm_setr_epi32( t0.min, t1.min, t2.min, t3.min );
+      __m128i msec = _mm_setr_epi32( t0.msec, t1.msec, t2.msec, t3.msec );
+      __m128i base = _mm_set1_epi64x( mToBase );
+      __m128i tmin = _mm_add_epi32( _mm_mullo_epi16( hour, k60 ), min ); // < 1440, 16 bit products are enough
+      __m128i even = _mm_add_epi64( base, _mm_add_epi64( _mm_mul_epu32( tmin, kmin ), _mm_mul_epu32( msec, kms ) ) );
+      __m128i odd = _mm_add_epi64( base, _mm_add_epi64( _mm_mul_epu32( _mm_srli_epi64( tmin, 32 ), kmin ),
+                                                        _mm_mul_epu32( _mm_srli_epi64( msec, 32 ), kms ) ) );
+      _mm_storeu_si128( (__m128i *)( us + i ), _mm_unpacklo_epi64( even, odd ) );
+      _mm_storeu_si128( (__m128i *)( us + i + 2 ), _mm_unpackhi_epi64( even, odd ) );
+      }
+#endif
+    for ( ; i < num; i++, p += stride )
+      us[i] = toUs( *(const cp56time2a *)p );
+}
+
+void TCp56Time::fromUs( long long us, cp56time2a & t )
+{
+    long long day = us / US_PER_DAY;
+    long long rem = us - day * US_PER_DAY;
+    if ( rem < 0 )
+      {
+      day--;
+      rem += US_PER_DAY;
+      }
+
+    if ( day != mFromDay )
+      { // civil from days
+      long long z = day + 719468;
+      long long era = ( z >= 0 ? z : z - 146096 ) / 146097;
+      unsigned doe = (unsigned)( z - era * 146097 );
+      unsigned yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365;
+      unsigned doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );
+      unsigned mp = ( 5 * doy + 2 ) / 153;
+      unsigned mday = doy - ( 153 * mp + 2 ) / 5 + 1;
+      unsigned month = mp < 10 ? mp + 3 : mp - 9;
+      long long year = yoe + era * 400 + ( month <= 2 );
+
+      memset( &mFromDate, 0, sizeof(mFromDate) );
+      mFromDate.year = (unsigned)( ( year % 100 + 100 ) % 100 );
+      mFromDate.month = month;
+      mFromDate.mday = mday;
+      mFromDate.wday = (unsigned)( ( ( day + 3 ) % 7 + 7 ) % 7 ) + 1; // 1970-01-01 was a thursday
+      mFromDay = day;
+      }
+
+    t = mFromDate;
+    unsigned ms = (unsigned)( rem / 1000 );
+    t.hour = ms / 3600000;
+    ms %= 3600000;
+    t.min = ms / 60000;
+    t.msec = ms % 60000;
+}
+
+void TCp56Time::localNow( cp56time2a & t )
+{
+    long long now = nowUs();
+
+    if ( now >= mLocalUntil )
+      { // the offset can change (summer time) only at some quarter of an hour: check it again at the next one
+      time_t s = (time_t)( now / 1000000 );
+      struct tm lt;
+#ifdef _WIN32
+      localtime_s( &lt, &s );
+#else
+      localtime_r( &s, &lt );
+#endif
+      long long local = daysFromCivil( lt.tm_year + 1900, lt.tm_mon + 1, lt.tm_mday ) * 86400 + lt.tm_hour * 3600 + lt.tm_min * 60 + lt.tm_sec;
+      mLocalOffset = ( local - (long long)s ) * 1000000;
+      mLocalUntil = ( (long long)s / 900 + 1 ) * 900 * 1000000;
+      }
+
+    fromUs( now + mLocalOffset, t );
+}
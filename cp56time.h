@@ -0,0 +1,74 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef CP56TIME_H
+#define CP56TIME_H
+
+// CP56Time2a <-> microseconds since the epoch.
+// The fields of a time tag are a wall clock time (the slave's), they are converted as if they were UTC, so that the
+// result is a plain count of microseconds with the same calendar fields. localNow() gives the local wall clock.
+// Time tags of a burst almost always fall on the same day: the converter remembers the base (midnight) of the last
+// day in each direction, so most conversions are a few multiply-adds. A converter is used by a single thread.
+
+#include "iec104_types.h"
+
+class TCp56Time
+{
+public:
+    TCp56Time();
+
+    // time tag to us, 0 if the tag is empty (day of month 0)
+    long long toUs( const cp56time2a & t );
+    // num time tags stride bytes apart (e.g. &obj[0].timetag, sizeof(iec_obj)), 4 at a time by SSE2 for tags of the cached day
+    void toUs( const cp56time2a * t, int stride, int num, long long * us );
+    // us to time tag (iv and su cleared, day of week 1=monday..7=sunday)
+    void fromUs( long long us, cp56time2a & t );
+    // local wall clock time now, as a time tag
+    void localNow( cp56time2a & t );
+
+    static long long nowUs(); // system clock, us since the epoch (UTC)
+    static long long daysFromCivil( int year, unsigned month, unsigned mday ); // days since 1970-01-01, proleptic gregorian
+
+    static const long long US_PER_DAY = 86400000000LL;
+
+private:
+    long long toUsNewDay( const cp56time2a & t );
+
+    // toUs: last day seen
+    unsigned mToKey;        // mday | month << 8 | year << 16, 0 = none
+    long long mToBase;      // us of its midnight
+    // fromUs: last day seen
+    long long mFromDay;     // days since the epoch, -1 = none
+    cp56time2a mFromDate;   // its date fields
+    // localNow: offset of the local time to UTC, valid until mLocalUntil (us, UTC)
+    long long mLocalOffset;
+    long long mLocalUntil;
+};
+
+#endif // CP56TIME_H
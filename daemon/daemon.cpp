@@ -0,0 +1,355 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+
+// Headless gateway: the RTUs of the ini file ([RTU1] .. [RTUn], keys of qtester104.ini) are polled by one
+// epoll reactor and every point received is forwarded to BDTR, as QTester104 does, without Qt nor a display.
+// One thread and no GUI state, so one instance per substation group is cheap.
+// BDTR settings, section [BDTR] of the same file:
+//   HOST=127.0.0.1   DUAL_HOST= (default REDUNDANCIA/IP_OUTRO_IHM of ./ihm.ini)   PORT=65280   ORIG=0
+//   SRC_PORT=65281 (source port of the datagrams, the port QTester104 sends from; 0 = any)
+// -j n runs the RTUs in a pool of n reactor threads pinned to cpus (0 = one per cpu, see reactorpool.h), for
+// hundreds of RTUs; each thread forwards its points with its own buffers, from the same BDTR socket.
+// -w file.pcap records every APDU of every RTU (see apdurec.h), for replay104.
+// -l times the received frames by stage (see latency.h), the histograms are printed on SIGUSR1 and at exit.
+// -m port|path serves the counters of the RTUs (see metrics.h) to Prometheus on a loopback port or unix socket.
+// Commands and the dual machine keepalive are handled by the GUI only.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "reactor104.h"
+#include "reactorpool.h"
+#include "bdtrfwd.h"
+#include "inifile.h"
+#include "apdurec.h"
+#include "latency.h"
+#include "metrics.h"
+#include "metricsrv.h"
+
+using namespace std;
+
+static volatile sig_atomic_t latencyRequested = 0; // SIGUSR1
+
+// the points of the sessions of one reactor to BDTR, called in the reactor thread: a pool has one per worker
+class TBdtrSink : public TPointSink
+{
+public:
+    TBdtrSink( bool verbose, TApduRecorder * rec ) : mRec( rec ), mVerbose( verbose ) {}
+    TBdtrForwarder & forwarder() { return mFwd; }
+
+    void pointIndication( TSession104 * session, iec_obj * obj, int numpoints )
+    {
+        if ( !mFwd.forward( obj, numpoints ) && mVerbose )
+          printf( "%s: type %u not forwarded to BDTR\n", session->getName().c_str(), (unsigned)obj->type );
+    }
+
+    void connectionIndication( TSession104 * session, bool connected )
+    {
+        printf( "%s: %s\n", session->getName().c_str(), connected ? "connected" : "disconnected" );
+        fflush( stdout );
+    }
+
+    // the points of all the events of this wakeup go out together
+    void flush()
+    {
+        if ( mFwd.pending() )
+          mFwd.flush();
+
+        // the capture is written here, not in the receive path
+        if ( mRec->due() )
+          mRec->flush();
+    }
+
+private:
+    TBdtrForwarder mFwd;
+    TApduRecorder * mRec;
+    bool mVerbose;
+};
+
+static void printLatency( const vector <TSession104 *> & sessions )
+{
+    for ( size_t i = 0; i < sessions.size(); i++ )
+      if ( sessions[i]->getLatencyStats() != NULL )
+        printf( "%s latency:\n%s", sessions[i]->getName().c_str(), sessions[i]->getLatencyStats()->report().c_str() );
+    fflush( stdout );
+}
+
+// the log of each session has a single reader: the reactor thread, or the main thread with a pool
+static void printLogs( const vector <TSession104 *> & sessions )
+{
+    for ( size_t i = 0; i < sessions.size(); i++ )
+      while ( sessions[i]->mLog.haveMsg() )
+        printf( "%s: %s\n", sessions[i]->getName().c_str(), sessions[i]->mLog.pullMsg().c_str() );
+    fflush( stdout );
+}
+
+// single reactor, run in the main thread
+class TDaemon104 : public TReactor104
+{
+public:
+    TDaemon104( bool verbose ) : mVerbose( verbose ) {}
+
+    int loadSessions( const char * filename ) // loadIni, and the list of the sessions for the prints
+    {
+        int n = loadIni( filename );
+        for ( int i = 0; i < n; i++ )
+          mList.push_back( session( i ) );
+        return n;
+    }
+    const vector <TSession104 *> & sessionList() { return mList; }
+
+protected:
+    void onLoop( int /*nevents*/ )
+    {
+        if ( latencyRequested )
+          {
+          latencyRequested = 0;
+          printLatency( mList );
+          }
+
+        if ( mVerbose )
+          printLogs( mList );
+    }
+
+private:
+    vector <TSession104 *> mList;
+    bool mVerbose;
+};
+
+static TDaemon104 * daemon104 = NULL;
+
+static void onSignal( int )
+{
+    if ( daemon104 )
+      daemon104->stop(); // only an atomic store and an eventfd write
+}
+
+static void onLatencySignal( int )
+{
+    latencyRequested = 1; // epoll_wait returns with EINTR, onLoop prints
+}
+
+int main( int argc, char * argv[] )
+{
+    const char * ininame = "./qtester104.ini";
+    const char * capture = NULL;
+    const char * metrics = NULL;
+    bool verbose = false;
+    bool timing = false;
+    int workers = -1; // -1 = single reactor
+    for ( int i = 1; i < argc; i++ )
+      {
+      if ( strcmp( argv[i], "-v" ) == 0 )
+        verbose = true;
+      else if ( strcmp( argv[i], "-l" ) == 0 )
+        timing = true;
+      else if ( strcmp( argv[i], "-w" ) == 0 && i + 1 < argc )
+        capture = argv[++i];
+      else if ( strcmp( argv[i], "-m" ) == 0 && i + 1 < argc )
+        metrics = argv[++i];
+      else if ( strcmp( argv[i], "-j" ) == 0 && i + 1 < argc )
+        workers = atoi( argv[++i] );
+      else
+        ininame = argv[i];
+      }
+
+    TIniFile ini;
+    if ( !ini.load( ininame ) )
+      {
+      fprintf( stderr, "can't read %s\n", ininame );
+      return 1;
+      }
+
+    TDaemon104 * d = NULL;
+    TReactorPool * pool = NULL;
+    vector <TSession104 *> sessions;
+    int nsessions;
+    if ( workers < 0 )
+      {
+      d = new TDaemon104( verbose );
+      nsessions = d->loadSessions( ininame );
+      sessions = d->sessionList();
+      }
+    else
+      {
+      pool = new TReactorPool( workers );
+      nsessions = pool->loadIni( ininame );
+      for ( int i = 0; i < nsessions; i++ )
+        sessions.push_back( pool->session( i ) );
+      }
+    if ( nsessions <= 0 )
+      {
+      fprintf( stderr, "no [RTU1] section in %s\n", ininame );
+      return 1;
+      }
+
+    TApduRecorder rec;
+    if ( capture != NULL && !rec.open( capture ) )
+      {
+      fprintf( stderr, "can't write %s\n", capture );
+      return 1;
+      }
+
+    // a sink (with its forwarder) per reactor, all sending from the socket of the first one
+    TIniFile ihm;
+    ihm.load( "./ihm.ini" ); // optional
+    string host = ini.value( "BDTR/HOST", "127.0.0.1" );
+    string dual = ini.value( "BDTR/DUAL_HOST", ihm.value( "REDUNDANCIA/IP_OUTRO_IHM" ) );
+    int port = ini.intValue( "BDTR/PORT", 65280 );
+    int srcport = ini.intValue( "BDTR/SRC_PORT", 65281 );
+    vector <TBdtrSink *> sinks;
+    for ( int w = 0; w < ( pool ? pool->workerCount() : 1 ); w++ )
+      {
+      TBdtrSink * sink = new TBdtrSink( verbose, &rec );
+      TBdtrForwarder & fwd = sink->forwarder();
+      fwd.setOrigin( ini.intValue( "BDTR/ORIG", 0 ) );
+      if ( w > 0 )
+        fwd.useSocket( sinks[0]->forwarder().getSocket() );
+      else if ( srcport > 0 && !fwd.bindPort( srcport ) )
+        fprintf( stderr, "can't bind BDTR source port %d, sending from any port\n", srcport );
+      if ( !fwd.addDestination( host.c_str(), port ) )
+        {
+        fprintf( stderr, "invalid BDTR host %s\n", host.c_str() );
+        return 1;
+        }
+      if ( dual != "" && !fwd.addDestination( dual.c_str(), port ) && w == 0 )
+        fprintf( stderr, "invalid BDTR dual host %s, ignored\n", dual.c_str() );
+      if ( pool )
+        pool->worker( w )->setPointSink( sink );
+      else
+        d->setPointSink( sink );
+      sinks.push_back( sink );
+      }
+
+    vector <TLatencyStats> latency( timing ? nsessions : 0 );
+    for ( int i = 0; i < nsessions; i++ )
+      {
+      if ( timing )
+        sessions[i]->setLatencyStats( &latency[i] );
+      if ( verbose )
+        sessions[i]->mLog.activateLog();
+      if ( rec.isOpen() )
+        sessions[i]->setRecorder( &rec, i );
+      }
+
+    TMetricsServer msrv;
+    if ( metrics != NULL )
+      {
+      vector <TMetricsSource> sources;
+      for ( int i = 0; i < nsessions; i++ )
+        {
+        TMetricsSource src = { sessions[i]->getName(), &sessions[i]->getCounters(), sessions[i]->getLatencyStats() };
+        sources.push_back( src );
+        }
+      if ( !msrv.start( metrics, [sources]() { string out; writePrometheus( out, sources ); return out; } ) )
+        {
+        fprintf( stderr, "metrics %s: %s\n", metrics, msrv.getError().c_str() );
+        return 1;
+        }
+      }
+
+    signal( SIGPIPE, SIG_IGN );
+    printf( "iec104d: %d RTUs, BDTR %s:%d%s%s", nsessions, host.c_str(), port, dual != "" ? " and " : "", dual.c_str() );
+    if ( pool )
+      printf( ", %d reactor threads", pool->workerCount() );
+    printf( "\n" );
+    fflush( stdout );
+
+    if ( pool )
+      {
+      // the workers inherit the blocked signals, the main thread takes them and reads the logs
+      sigset_t sigs;
+      sigemptyset( &sigs );
+      sigaddset( &sigs, SIGINT );
+      sigaddset( &sigs, SIGTERM );
+      sigaddset( &sigs, SIGUSR1 );
+      pthread_sigmask( SIG_BLOCK, &sigs, NULL );
+      pool->start();
+      struct timespec tick = { 0, 100000000 };
+      for ( ;; )
+        {
+        int sig = sigtimedwait( &sigs, NULL, &tick );
+        if ( sig == SIGINT || sig == SIGTERM )
+          break;
+        if ( sig == SIGUSR1 )
+          printLatency( sessions );
+        if ( verbose )
+          printLogs( sessions );
+        }
+      pool->stop();
+      }
+    else
+      {
+      daemon104 = d;
+      struct sigaction sa;
+      memset( &sa, 0, sizeof( sa ) );
+      sa.sa_handler = onSignal;
+      sigaction( SIGINT, &sa, NULL );
+      sigaction( SIGTERM, &sa, NULL );
+      sa.sa_handler = onLatencySignal;
+      sigaction( SIGUSR1, &sa, NULL );
+      d->startAll();
+      d->run();
+      daemon104 = NULL;
+      }
+    msrv.stop();
+
+    unsigned long long points = 0, datagrams = 0;
+    for ( size_t i = 0; i < sinks.size(); i++ )
+      {
+      sinks[i]->forwarder().flush();
+      points += sinks[i]->forwarder().getPointsSent();
+      datagrams += sinks[i]->forwarder().getDatagramsSent();
+      }
+    printf( "iec104d: %llu points sent in %llu datagrams\n", points, datagrams );
+    if ( pool )
+      printf( "iec104d: %llu connection attempts taken over by idle threads\n", pool->stolenCount() );
+    if ( rec.isOpen() )
+      {
+      rec.close();
+      printf( "iec104d: %llu APDUs recorded in %s", rec.getFrames(), capture );
+      if ( rec.getDropped() > 0 )
+        printf( ", %llu dropped", rec.getDropped() );
+      printf( "\n" );
+      }
+    if ( timing )
+      printLatency( sessions );
+
+    // the reactors first, their sessions refer to the sinks and the recorder
+    delete d;
+    delete pool;
+    for ( size_t i = 0; i < sinks.size(); i++ )
+      delete sinks[i];
+    return 0;
+}
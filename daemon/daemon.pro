@@ -0,0 +1,9 @@
+# -------------------------------------------------
+# Headless IEC104 to BDTR gateway (no Qt), run ./iec104d [qtester104.ini] [-v] [-l] [-j workers] [-w capture.pcap] [-m port|path]
+# -------------------------------------------------
+TEMPLATE = app
+TARGET = iec104d
+CONFIG += console
+CONFIG -= qt app_bundle
+include( ../reactor104.pri )
+SOURCES += daemon.cpp
@@ -29,11 +29,13 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <time.h>
-#include <string>
-#include <sstream>
 
 #include "iec104_class.h"
+#include "pointtable.h"
+#include "squnpack.h"
+#include "alloccnt.h"
+#include "apdurec.h"
+#include "latency.h"
 
 using namespace std;
 
@@ -43,20 +45,70 @@ iec104_class::iec104_class()
 
     Port = 2404;
 
-    msg_supervisory = true;
     seq_order_check = true;
     connectedTCP = false;
 
-    tout_startdtact = -1;
-    tout_supervisory = -1;
-    tout_testfr = -1;
-    tout_gi = -1;
+    wheel = &ownWheel;
+    tmConnect.setCallback( onTimer, this, TM_CONNECT );
+    tmStartDT.setCallback( onTimer, this, TM_STARTDT );
+    tmAck.setCallback( onTimer, this, TM_ACK );
+    tmT2.setCallback( onTimer, this, TM_T2 );
+    tmT3.setCallback( onTimer, this, TM_T3 );
+    tmGI.setCallback( onTimer, this, TM_GI );
+    t0 = 5000;
+    t1 = 15000;
+    t2 = 10000;
+    t3 = 10000;
+    reconnect = false;
     VS = 0;
     VR = 0;
+    VA = 0;
+    k = 12;
+    w = 8;
+    rx_unack = 0;
+    txpend_head = 0;
+    txpend_cnt = 0;
+    txlen = 0;
+    txhold = 0;
+    cmdTimeValid = false;
+    rxhead = 0;
+    rxtail = 0;
     TxOk = false;
     masterAddress = 0;
     slaveAddress = 0;
     GIObjectCnt = 0;
+    DecodedAsduCnt = 0;
+    DecodeAllocCnt = 0;
+    pointTable = NULL;
+    recorder = NULL;
+    recorderSession = 0;
+    latency = NULL;
+    latencyNsPerTick = 1;
+    latencyReadTicks = 0;
+    latencyFrameTicks = 0;
+    latencyDecodedTicks = 0;
+    rxKernelNs = 0;
+    batchMax = 0;
+    batch.count = 0;
+    batchAddress = NULL;
+    batchValue = NULL;
+    batchQuality = NULL;
+    batchTime = NULL;
+}
+
+iec104_class::~iec104_class()
+{
+    // the wheel may be shared and outlive this connection
+    wheel->stop( &tmConnect );
+    wheel->stop( &tmStartDT );
+    wheel->stop( &tmAck );
+    wheel->stop( &tmT2 );
+    wheel->stop( &tmT3 );
+    wheel->stop( &tmGI );
+    delete[] batchAddress;
+    delete[] batchValue;
+    delete[] batchQuality;
+    delete[] batchTime;
 }
 
 void iec104_class::disableSequenceOrderCheck()
@@ -64,6 +116,167 @@ void iec104_class::disableSequenceOrderCheck()
     seq_order_check = false;
 }
 
+unsigned long long iec104_class::getDecodedAsduCount()
+{
+    return DecodedAsduCnt;
+}
+
+unsigned long long iec104_class::getDecodeAllocCount()
+{
+    return DecodeAllocCnt;
+}
+
+void iec104_class::setBatchIndication( int maxpoints )
+{
+    delete[] batchAddress;
+    delete[] batchValue;
+    delete[] batchQuality;
+    delete[] batchTime;
+    batchAddress = NULL;
+    batchValue = NULL;
+    batchQuality = NULL;
+    batchTime = NULL;
+    batch.count = 0;
+    batchMax = 0;
+
+    if ( maxpoints <= 0 )
+      return;
+    if ( maxpoints < asdu_maxobj )
+      maxpoints = asdu_maxobj;
+
+    batchAddress = new unsigned int[maxpoints];
+    batchValue = new float[maxpoints];
+    batchQuality = new unsigned char[maxpoints];
+    batchTime = new long long[maxpoints];
+    batch.address = batchAddress;
+    batch.value = batchValue;
+    batch.quality = batchQuality;
+    batch.time = batchTime;
+    batchMax = maxpoints;
+}
+
+unsigned char iec104_class::qualityOf( const iec_obj & obj )
+{
+    unsigned char q = ( obj.iv ? QDS_IV : 0 ) | ( obj.nt ? QDS_NT : 0 ) | ( obj.sb ? QDS_SB : 0 ) | ( obj.bl ? QDS_BL : 0 );
+    switch ( obj.type )
+      {
+      case M_SP_NA_1:
+      case M_SP_TB_1:
+      case M_DP_NA_1:
+      case M_DP_TB_1:
+        break; // the ov bit shares its place with the point state
+      default:
+        if ( obj.ov )
+          q |= QDS_OV;
+        break;
+      }
+    return q;
+}
+
+void iec104_class::setPointTable( TPointTable * pt )
+{
+    pointTable = pt;
+}
+
+TPointTable * iec104_class::getPointTable()
+{
+    return pointTable;
+}
+
+void iec104_class::setRecorder( TApduRecorder * rec, unsigned session )
+{
+    recorder = rec;
+    recorderSession = session;
+}
+
+void iec104_class::setLatencyStats( TLatencyStats * ls )
+{
+    if ( ls != NULL )
+      latencyNsPerTick = TLatencyClock::nsPerTick();
+    latency = ls;
+}
+
+TLatencyStats * iec104_class::getLatencyStats()
+{
+    return latency;
+}
+
+const TSessionCounters & iec104_class::getCounters()
+{
+    return counters;
+}
+
+void iec104_class::latencyRecord( int stage, unsigned long long from, unsigned long long to )
+{
+    // ticks of different cores may disagree slightly
+    latency->stage[stage].record( to > from ? (unsigned long long)( ( to - from ) * latencyNsPerTick ) : 0 );
+}
+
+// the end of delivery is read with the next clock read (the next frame extracted, the next read or the end of
+// packetReadyTCP), so that a frame costs two clock reads
+void iec104_class::latencyDelivered( unsigned long long now )
+{
+    latencyRecord( TLatencyStats::DELIVER, latencyDecodedTicks, now );
+    latencyDecodedTicks = 0;
+}
+
+// counts an apdu by format: the first control octet ends in 0 for I, 01 for S, 11 for U
+void iec104_class::countFrame( int dir, const unsigned char * data, int sz )
+{
+    if ( !( data[2] & 1 ) )
+      counters.iFrames[dir].add();
+    else if ( !( data[2] & 2 ) )
+      counters.sFrames[dir].add();
+    else
+      counters.uFrames[dir].add();
+    counters.bytes[dir].add( sz );
+}
+
+void iec104_class::sendAPDU( char * data, int sz )
+{
+    countFrame( TSessionCounters::TX, (const unsigned char *)data, sz );
+    if ( recorder != NULL )
+      recorder->record( recorderSession, TApduRecorder::TX, data, sz );
+    if ( txhold > 0 )
+      {
+      if ( txlen + sz > txbuf_size )
+        {
+        sendTCP( txbuf, txlen );
+        txlen = 0;
+        }
+      memcpy( txbuf + txlen, data, sz );
+      txlen += sz;
+      return;
+      }
+    sendTCP( data, sz );
+}
+
+void iec104_class::holdTx()
+{
+    txhold++;
+}
+
+void iec104_class::releaseTx()
+{
+    if ( txhold > 0 && --txhold == 0 && txlen > 0 )
+      {
+      sendTCP( txbuf, txlen );
+      txlen = 0;
+      }
+}
+
+void iec104_class::beginCommandBatch()
+{
+    holdTx();
+    cmdTimeValid = false;
+}
+
+void iec104_class::endCommandBatch()
+{
+    releaseTx();
+    cmdTimeValid = false;
+}
+
 int iec104_class::getPortTCP()
 {
     return Port;
@@ -74,6 +287,84 @@ void iec104_class::setPortTCP( unsigned port )
     Port = port;
 }
 
+void iec104_class::setK( int kk )
+{
+    if ( kk < 1 )
+      kk = 1;
+    if ( kk > k_max )
+      kk = k_max;
+    k = kk;
+}
+
+int iec104_class::getK()
+{
+    return k;
+}
+
+void iec104_class::setW( int ww )
+{
+    if ( ww < 1 )
+      ww = 1;
+    if ( ww > k_max )
+      ww = k_max;
+    w = ww;
+}
+
+int iec104_class::getW()
+{
+    return w;
+}
+
+void iec104_class::setTimerWheel( TTimerWheel * tw )
+{
+    wheel = ( tw != NULL ) ? tw : &ownWheel;
+}
+
+TTimerWheel * iec104_class::getTimerWheel()
+{
+    return wheel;
+}
+
+void iec104_class::setT0( unsigned ms )
+{
+    t0 = ms;
+}
+
+unsigned iec104_class::getT0()
+{
+    return t0;
+}
+
+void iec104_class::setT1( unsigned ms )
+{
+    t1 = ms;
+}
+
+unsigned iec104_class::getT1()
+{
+    return t1;
+}
+
+void iec104_class::setT2( unsigned ms )
+{
+    t2 = ms;
+}
+
+unsigned iec104_class::getT2()
+{
+    return t2;
+}
+
+void iec104_class::setT3( unsigned ms )
+{
+    t3 = ms;
+}
+
+unsigned iec104_class::getT3()
+{
+    return t3;
+}
+
 void iec104_class::setSecondaryIP(char * ip)
 {
     strncpy( slaveIP, ip, 20 );
@@ -110,6 +401,19 @@ void iec104_class::onConnectTCP()
     TxOk = false;
     VS = 0;
     VR = 0;
+    VA = 0;
+    rx_unack = 0;
+    txpend_head = 0;
+    txpend_cnt = 0;
+    txlen = 0;
+    rxhead = 0;
+    rxtail = 0;
+    counters.connects.add();
+    counters.connected.set( 1 );
+    counters.unacked.set( 0 );
+    counters.txQueued.set( 0 );
+    counters.rxUnacked.set( 0 );
+    wheel->stop( &tmConnect );
     mLog.pushMsg("*** TCP CONNECT!");
     sendStartDTACT();
 }
@@ -117,73 +421,96 @@ void iec104_class::onConnectTCP()
 void iec104_class::onDisconnectTCP()
 {
     connectedTCP = false;
-    tout_startdtact = -1;
-    tout_supervisory = -1;
-    tout_gi = -1;
+    wheel->stop( &tmStartDT );
+    wheel->stop( &tmAck );
+    wheel->stop( &tmT2 );
+    wheel->stop( &tmT3 );
+    wheel->stop( &tmGI );
     TxOk = false;
+    rxhead = 0;
+    rxtail = 0;
+    if ( txpend_cnt > 0 )
+      mLog.pushEvent( 0, "*** %d QUEUED I-FRAMES DISCARDED", txpend_cnt );
+    txpend_cnt = 0;
+    txlen = 0; // held frames of the closed connection
+    rx_unack = 0;
+    VA = VS;
+    counters.disconnects.add();
+    counters.connected.set( 0 );
+    counters.unacked.set( 0 );
+    counters.txQueued.set( 0 );
+    counters.rxUnacked.set( 0 );
     mLog.pushMsg("*** TCP DISCONNECT!");
+    if ( reconnect )
+      wheel->start( &tmConnect, t0 );
 }
 
-void iec104_class::onTimerSecond()
+void iec104_class::startConnecting()
 {
-    iec_apdu apdu;
-    static unsigned int cnts = 1;
+    reconnect = true;
+    if ( !connectedTCP )
+      {
+      wheel->start( &tmConnect, t0 );
+      connectTCP();
+      }
+}
 
-    cnts++;
+void iec104_class::stopConnecting()
+{
+    reconnect = false;
+    wheel->stop( &tmConnect );
+}
 
-    if ( ! (cnts % 5) )
-        if ( !connectedTCP )
-            connectTCP();
+void iec104_class::onTimer( void * ctx, int id )
+{
+    iec104_class * p = (iec104_class *)ctx;
+    iec_apdu apdu;
 
-    if (connectedTCP)
+    switch ( id )
     {
-        if ( tout_startdtact > 0 )
-            tout_startdtact--;
-        if ( tout_startdtact==0 )  // timeout of startdtact: retry
-            sendStartDTACT();
-
-        if ( tout_gi > 0 )
+    case TM_CONNECT:
+        if ( !p->connectedTCP && p->reconnect )
           {
-            tout_gi--;
-            if ( tout_gi == 0 )
-              solicitGI();
+          p->wheel->start( &p->tmConnect, p->t0 );
+          p->connectTCP();
           }
-
-
-        if (msg_supervisory)
-        {
-        if (tout_supervisory > 0)
-          tout_supervisory--;
-        if (tout_supervisory > 0)
-          tout_supervisory--;
-
-        if (tout_supervisory == 0)
+        break;
+    case TM_STARTDT: // timeout of startdtact: retry
+        if ( p->connectedTCP )
           {
-           tout_supervisory = -1;
-           sendSupervisory();
+          p->counters.startdtTimeouts.add();
+          p->sendStartDTACT();
           }
-        }
-
-    }
-
-    // if connected and no data received, send TESTFRACT
-    if ( connectedTCP && TxOk )
-    {
-        if ( tout_testfr > 0 )
+        break;
+    case TM_ACK: // oldest sent I-frame not acknowledged in t1: close the connection
+        if ( p->connectedTCP )
           {
-            tout_testfr--;
-            if ( tout_testfr == 0 )
-            {
-                apdu.start = START;
-                apdu.length = 4;
-                apdu.NS = TESTFRACT;
-                apdu.NR = 0;
-                sendTCP((char *)&apdu, 6);
-                mLog.pushMsg("<-- TESTFRACT");
-            }
+          p->counters.t1Expiries.add();
+          p->mLog.pushMsg( "*** T1 TIMEOUT, I-FRAME NOT ACKNOWLEDGED" );
+          p->disconnectTCP();
+          }
+        break;
+    case TM_T2:
+        if ( p->connectedTCP )
+          p->sendSupervisory();
+        break;
+    case TM_T3: // connected and no data received, send TESTFRACT
+        if ( p->connectedTCP && p->TxOk )
+          {
+          apdu.start = START;
+          apdu.length = 4;
+          apdu.NS = TESTFRACT;
+          apdu.NR = 0;
+          p->sendAPDU((char *)&apdu, 6);
+          p->mLog.pushMsg("<-- TESTFRACT");
+          p->wheel->start( &p->tmT3, p->t3 );
           }
+        break;
+    case TM_GI:
+        if ( p->connectedTCP )
+          p->solicitGI();
+        break;
     }
-
 }
 
 void iec104_class::solicitGI()
@@ -192,8 +519,6 @@ void iec104_class::solicitGI()
 
     wapdu.start = START;
     wapdu.length = 0x0E;
-    wapdu.NS = VS;
-    wapdu.NR = VR;
     wapdu.asduh.type = INTERROGATION;
     wapdu.asduh.num = 1;
     wapdu.asduh.sq = 0;
@@ -206,8 +531,7 @@ void iec104_class::solicitGI()
     wapdu.dados[1] = 0x00;
     wapdu.dados[2] = 0x00;
     wapdu.dados[3] = 0x14;
-    sendTCP((char *)&wapdu, 16);
-    VS += 2;
+    sendIFrame( &wapdu );
     mLog.pushMsg( "<-- INTERROGATION " );
 }
 
@@ -217,8 +541,6 @@ void iec104_class::confTestCommand()
 
     wapdu.start = START;
     wapdu.length = 22;
-    wapdu.NS = VS;
-    wapdu.NR = VR;
     wapdu.asduh.type = C_TS_TA_1;
     wapdu.asduh.num = 1;
     wapdu.asduh.sq = 0;
@@ -227,21 +549,13 @@ void iec104_class::confTestCommand()
     wapdu.asduh.pn = 0;
     wapdu.asduh.oa = masterAddress;
     wapdu.asduh.ca = slaveAddress;
-    time_t tm1 = time( NULL );
-    tm *agora = localtime( &tm1 );
 
     wapdu.asdu107.ioa16 = 0;
     wapdu.asdu107.ioa8 = 0;
     wapdu.asdu107.tsc = 0;
-    wapdu.asdu107.time.year = agora->tm_year % 100;
-    wapdu.asdu107.time.month = agora->tm_mon;
-    wapdu.asdu107.time.mday = agora->tm_mday;
-    wapdu.asdu107.time.hour = agora->tm_hour;
-    wapdu.asdu107.time.min = agora->tm_min;
-    wapdu.asdu107.time.msec = agora->tm_sec * 1000;
+    cp56.localNow( wapdu.asdu107.time );
 
-    sendTCP( (char *)&wapdu, 22+2 );
-    VS += 2;
+    sendIFrame( &wapdu );
 
     mLog.pushMsg( "<-- TEST COMMAND CONF " );
 }
@@ -254,122 +568,284 @@ void iec104_class::sendStartDTACT()
     apdu.length=4;
     apdu.NS=STARTDTACT;
     apdu.NR=0;
-    sendTCP((char *)&apdu, 6);
+    sendAPDU((char *)&apdu, 6);
     mLog.pushMsg("<-- STARTDTACT");
-    tout_startdtact=t1_startdtact;
+    wheel->start( &tmStartDT, t1 );
 }
 
 // tcp packet ready to be read from connection with the iec104 slave
 void iec104_class::packetReadyTCP()
 {
-    static bool broken_msg=false;
-    static iec_apdu apdu;
-    unsigned char * br;
-    br = (unsigned char*)&apdu;
+    receiveAPDUs();
+    if ( latencyDecodedTicks != 0 )
+      latencyDelivered( TLatencyClock::ticks() );
+    flushBatch(); // what was decoded from this read
+}
+
+void iec104_class::receiveAPDUs()
+{
     int bytesrec;
-    unsigned char byt;
+    int space;
+    int avail;
+    unsigned char * br;
     unsigned char len;
 
-    while (true) {
+    while ( true ) {
 
-      if (!broken_msg)
+      // move the remaining partial frame to the beginning of the buffer, so that apdus are always contiguous
+      if ( rxhead > 0 )
         {
-        // look for a START
-        do {
-            bytesrec=readTCP((char*)br, 1);
-            if (bytesrec==0) return;
-            byt = br[0];
-        } while (byt != START);
-        bytesrec=readTCP( (char*)br+1, 1); // length of apdu
-        if (bytesrec==0) return;
+        memmove( rxbuf, rxbuf + rxhead, rxtail - rxhead );
+        rxtail -= rxhead;
+        rxhead = 0;
         }
 
-      len = br[1];
-      if ( len < 4 ) // apdu length must be >= 4
+      if ( latencyDecodedTicks != 0 )
+        latencyDelivered( TLatencyClock::ticks() );
+
+      // read all that is available (up to the free space) in one call
+      space = rxbuf_size - rxtail;
+      bytesrec = readTCP( (char*)rxbuf + rxtail, space );
+      if ( bytesrec <= 0 )
+        return;
+      if ( latency != NULL )
         {
-        broken_msg=false;
-        mLog.pushMsg("--> ERROR: INVALID FRAME");
-        continue;
+        latencyReadTicks = TLatencyClock::ticks();
+        if ( rxKernelNs != 0 )
+          {
+          long long ns = TLatencyClock::realtimeNs() - rxKernelNs;
+          latency->stage[TLatencyStats::KERNEL].record( ns > 0 ? ns : 0 );
+          rxKernelNs = 0;
+          }
         }
+      rxtail += bytesrec;
 
-      bytesrec=readTCP((char*)br+2, len); // read the remaining of the apdu
-      if (bytesrec==0)
-         {
-         mLog.pushMsg("--> Broken apdu");
-         broken_msg=true;
-         return;
-         }
-
-      if ( apdu.asduh.ca != slaveAddress && len>4 )
+      // extract every complete apdu from the buffer
+      while ( ( avail = rxtail - rxhead ) >= 2 )
         {
-        broken_msg=false;
-        mLog.pushMsg("--> ASDU WITH UNEXPECTED ORIGIN! Ignoring...");
-        // continue;
-        }
+        br = rxbuf + rxhead;
+
+        if ( br[0] != START )
+          { // look for a START
+          unsigned char * pst = (unsigned char *)memchr( br, START, avail );
+          rxhead = ( pst == NULL ) ? rxtail : pst - rxbuf;
+          continue;
+          }
 
-      broken_msg=false;
+        len = br[1];
+        if ( len < 4 || len > 253 ) // apdu length must be >= 4 and <= 253
+          {
+          mLog.pushMsg("--> ERROR: INVALID FRAME");
+          counters.invalidFrames.add();
+          rxhead++;
+          continue;
+          }
 
-      if (mLog.isLogging())
-        {
-        char buflog[5000];
+        if ( avail < len + 2 ) // incomplete apdu, wait for the rest
+          break;
+
+        rxhead += len + 2;
+        countFrame( TSessionCounters::RX, br, len + 2 );
 
-        sprintf (buflog, "--> %03d: ", (int)len+2);
-        for (int i=0; i< len+2 && i<25 ; i++) // log up to 25 caracteres
-           sprintf (buflog+strlen(buflog), "%02x ", br[i]);
-        mLog.pushMsg(buflog);
+        mLog.pushDump( 0, "--> %03d: ", len + 2, br, len + 2 ); // log up to 25 caracteres
+
+        if ( recorder != NULL )
+          recorder->record( recorderSession, TApduRecorder::RX, br, len + 2 );
+
+        // the apdu is processed directly from the receive buffer, without copying
+        if ( latency != NULL )
+          {
+          latencyFrameTicks = TLatencyClock::ticks();
+          if ( latencyDecodedTicks != 0 )
+            latencyDelivered( latencyFrameTicks );
+          latencyRecord( TLatencyStats::EXTRACT, latencyReadTicks, latencyFrameTicks );
+          }
+        userprocAPDU( (const iec_apdu *)br, len + 2 );
+        parseAPDU( (const iec_apdu *)br, len + 2 );
+        latencyFrameTicks = 0;
+
+        if ( !connectedTCP ) // connection closed while processing (e.g. sequence error)
+          return;
         }
 
-      userprocAPDU( &apdu, len + 2 );
-      parseAPDU( &apdu, len + 2 );
-      break;
+      if ( bytesrec < space ) // the socket had less than the free space: nothing more to read
+        return;
       }
+}
 
-/*
-    char buf[5000];
-    buf[0]=0;
+// text for the cause of a command indication
+static const char * commandCauseText( unsigned cause )
+{
+    if ( cause == iec104_class::ACTCONFIRM )
+        return "ACTIVATION CONFIRMATION ";
+    if ( cause == iec104_class::ACTTERM )
+        return "ACTIVATION TERMINATION ";
+    return "";
+}
 
-    sprintf(buf+strlen(buf), "--> ");
-    bytesrec=readTCP((char*)br,2); // start and length
-    if ( br[0]== START) // valid frames must begin with START
-    {
-        bytesrec=readTCP((char*)br+2,br[1]); // read the remaining of the frame
-        sprintf (buf+strlen(buf), "%03d: ", bytesrec+2);
-        int i=0;
-        for (; i< bytesrec+2 && i<25 ; i++) // prints up to 25 chars
-            sprintf (buf+strlen(buf), "%02x ", br[i]);
-        mLog.pushMsg(buf);
-        buf[0]=0;
-        parseAPDU(&apdu, bytesrec+2);
-    }
+// ---- monitor direction decoding ---------------------------------------------
+// Each information element type is described by a value layout and a time tag layout.
+// iec_decode is instantiated once per type from the table below, so each type gets its own tight loop.
+// To support a new type, add one line to the table.
+
+// single point: value is the sp bit
+struct iec_val_sp {
+    template <class T> static inline void get( iec_obj & o, const T & e )
+        { o.value = e.sp; o.sp = e.sp; }
+};
+
+// double point: value is the dp bits
+struct iec_val_dp {
+    template <class T> static inline void get( iec_obj & o, const T & e )
+        { o.value = e.dp; o.dp = e.dp; }
+};
+
+// step position: value with transient flag, overflow in the quality descriptor
+struct iec_val_vti {
+    template <class T> static inline void get( iec_obj & o, const T & e )
+        { o.value = e.mv; o.t = e.t; o.ov = e.ov; }
+};
+
+// measured value (normalized, scaled or float), overflow in the quality descriptor
+struct iec_val_mv {
+    template <class T> static inline void get( iec_obj & o, const T & e )
+        { o.value = e.mv; o.ov = e.ov; }
+};
+
+// no time tag
+struct iec_time_none {
+    template <class T> static inline void get( iec_obj &, const T & ) {}
+};
+
+// CP56Time2a time tag
+struct iec_time_cp56 {
+    template <class T> static inline void get( iec_obj & o, const T & e )
+        {
+        o.timetag.mday = e.time.mday;
+        o.timetag.month = e.time.month;
+        o.timetag.year = e.time.year;
+        o.timetag.hour = e.time.hour;
+        o.timetag.min = e.time.min;
+        o.timetag.msec = e.time.msec;
+        o.timetag.iv = e.time.iv;
+        }
+};
+
+// decode the information objects of one asdu into piecarr, returns the number of objects or -1 if the size is inconsistent
+template <class T, class VAL, class TIME>
+static int iec_decode( const iec_apdu * papdu, int sz, iec_obj * piecarr )
+{
+    const unsigned char * pdata = papdu->dados;
+    int datasz = sz - (int)( pdata - (const unsigned char *)papdu );
+    int num = papdu->asduh.num;
+    unsigned int addr24;
+
+    if ( papdu->asduh.sq )
+      {
+      // sequence: one address followed by num elements
+      if ( datasz < 3 + num * (int)sizeof(T) )
+        return -1;
+      addr24 = pdata[0] | ( (unsigned)pdata[1] << 8 ) | ( (unsigned)pdata[2] << 16 );
+      const T * pelem = (const T *)( pdata + 3 );
+      for ( int i=0; i<num; i++, pelem++, addr24++ )
+         {
+         iec_obj & o = piecarr[i];
+         memset( &o, 0, sizeof(o) );
+         o.address = addr24;
+         o.ca = papdu->asduh.ca;
+         o.cause = papdu->asduh.cause;
+         o.pn = papdu->asduh.pn;
+         o.type = papdu->asduh.type;
+         VAL::get( o, *pelem );
+         o.bl = pelem->bl;
+         o.nt = pelem->nt;
+         o.sb = pelem->sb;
+         o.iv = pelem->iv;
+         TIME::get( o, *pelem );
+         }
+      }
     else
-    {
-        mLog.pushMsg("--> ERROR: INVALID FRAME");
-        bytesrec=readTCP((char*)br,sizeof(apdu)); // consider garbage the remaining data from the frame
-    }
-*/
+      {
+      // no sequence: each element has its own address
+      if ( datasz < num * ( 3 + (int)sizeof(T) ) )
+        return -1;
+      for ( int i=0; i<num; i++, pdata += 3 + sizeof(T) )
+         {
+         const T * pelem = (const T *)( pdata + 3 );
+         iec_obj & o = piecarr[i];
+         memset( &o, 0, sizeof(o) );
+         o.address = pdata[0] | ( (unsigned)pdata[1] << 8 ) | ( (unsigned)pdata[2] << 16 );
+         o.ca = papdu->asduh.ca;
+         o.cause = papdu->asduh.cause;
+         o.pn = papdu->asduh.pn;
+         o.type = papdu->asduh.type;
+         VAL::get( o, *pelem );
+         o.bl = pelem->bl;
+         o.nt = pelem->nt;
+         o.sb = pelem->sb;
+         o.iv = pelem->iv;
+         TIME::get( o, *pelem );
+         }
+      }
+
+    return num;
 }
 
-void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
+typedef int (*iec_decoder)( const iec_apdu * papdu, int sz, iec_obj * piecarr );
+
+static const struct {
+    unsigned char type;
+    iec_decoder decode;
+} iec_decoders[] = {
+    { iec104_class::M_SP_NA_1, iec_decode< iec_type1,  iec_val_sp,  iec_time_none > },
+    { iec104_class::M_DP_NA_1, iec_decode< iec_type3,  iec_val_dp,  iec_time_none > },
+    { iec104_class::M_ST_NA_1, iec_decode< iec_type5,  iec_val_vti, iec_time_none > },
+    { iec104_class::M_ME_NA_1, iec_decode< iec_type9,  iec_val_mv,  iec_time_none > },
+    { iec104_class::M_ME_NB_1, iec_decode< iec_type11, iec_val_mv,  iec_time_none > },
+    { iec104_class::M_ME_NC_1, iec_decode< iec_type13, iec_val_mv,  iec_time_none > },
+    { iec104_class::M_SP_TB_1, iec_decode< iec_type30, iec_val_sp,  iec_time_cp56 > },
+    { iec104_class::M_DP_TB_1, iec_decode< iec_type31, iec_val_dp,  iec_time_cp56 > },
+    { iec104_class::M_ST_TB_1, iec_decode< iec_type32, iec_val_vti, iec_time_cp56 > },
+    { iec104_class::M_ME_TD_1, iec_decode< iec_type34, iec_val_mv,  iec_time_cp56 > },
+    { iec104_class::M_ME_TE_1, iec_decode< iec_type35, iec_val_mv,  iec_time_cp56 > },
+    { iec104_class::M_ME_TF_1, iec_decode< iec_type36, iec_val_mv,  iec_time_cp56 > },
+};
+
+// decoders indexed by type, NULL if the type is not decoded to objects
+static struct iec_decoder_index {
+    iec_decoder bytype[256];
+    iec_decoder_index()
+        {
+        memset( bytype, 0, sizeof(bytype) );
+        for ( unsigned i=0; i<sizeof(iec_decoders)/sizeof(iec_decoders[0]); i++ )
+           bytype[iec_decoders[i].type] = iec_decoders[i].decode;
+        }
+} iec_decoders_bytype;
+
+void iec104_class::parseAPDU(const iec_apdu * papdu, int sz, bool accountandrespond)
 {
     iec_apdu wapdu;      // buffer to assemble apdu to send
-    string qs, qsa;
-    stringstream oss;
     unsigned short VR_NEW;
     
     if ( papdu->start!=START )
     { // invalid frame
         mLog.pushMsg("--> ERROR: NO START IN FRAME");
+        counters.invalidFrames.add();
         return;
     }
 
     if ( papdu->asduh.ca != slaveAddress && sz>6)
     { // invalid frame
         mLog.pushMsg("--> ASDU WITH UNEXPECTED ORIGIN! Ignoring...");
+        counters.unexpectedCA.add();
         return;
     }
 
     if (sz==6)
     { // Control messages
+        if ( accountandrespond && TxOk )
+          wheel->start( &tmT3, t3 );
+
         if ( accountandrespond )
         switch ( papdu->NS )
         {
@@ -379,7 +855,7 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
             wapdu.length=4;
             wapdu.NS=STARTDTCON;
             wapdu.NR=0;
-            sendTCP((char *)&wapdu, 6);
+            sendAPDU((char *)&wapdu, 6);
             mLog.pushMsg("<-- STARTDTCON");
             break;
             
@@ -389,15 +865,16 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
             wapdu.length=4;
             wapdu.NS=TESTFRCON;
             wapdu.NR=0;
-            sendTCP((char *)&wapdu, 6);
+            sendAPDU((char *)&wapdu, 6);
             mLog.pushMsg("<-- TESTFRCON");
             break;
             
         case STARTDTCON:
             mLog.pushMsg("    STARTDTCON");
-            tout_startdtact=-1; // flag confirmation of STARTDT, not to timeout
+            wheel->stop( &tmStartDT ); // confirmation of STARTDT, not to timeout
             TxOk=true;
-            tout_gi=10;
+            wheel->start( &tmGI, gi_delay );
+            wheel->start( &tmT3, t3 );
             break;
             
         case STOPDTACT:
@@ -416,8 +893,8 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
             break;
             
         case SUPERVISORY:
-            mLog.pushMsg("    SUPERVISORY");
-            // do what?
+            mLog.pushEvent( 0, "    SUPERVISORY %x", papdu->NR );
+            ackReceived( papdu->NR );
             break;
 
         default: // error
@@ -437,6 +914,7 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
           {
             // sequence error, must close and reopen connection
             mLog.pushMsg("*** SEQUENCE ERROR! **************************");
+            counters.seqErrors.add();
             if ( seq_order_check )
               {
               disconnectTCP();
@@ -445,578 +923,64 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
           }
 
         VR = VR_NEW + 2;
+        rx_unack++;
+        counters.rxUnacked.set( rx_unack );
+
+        if ( !ackReceived( papdu->NR ) )
+          return;
         }
 
-        oss.str("");
-        oss << "    CA "
-                << (unsigned)papdu->asduh.ca
-                << " TYPE "
-                << (unsigned)papdu->asduh.type
-                << " CAUSE "
-                << (int) papdu->asduh.cause
-                << " SQ "
-                << (unsigned)papdu->asduh.sq
-                << " NUM "
-                << (unsigned)papdu->asduh.num;
-        mLog.pushMsg((char*)oss.str().c_str());
+        mLog.pushEvent( 0, "    CA %u TYPE %u CAUSE %d SQ %u NUM %u",
+                        papdu->asduh.ca, papdu->asduh.type, papdu->asduh.cause, papdu->asduh.sq, papdu->asduh.num );
         
-        switch (papdu->asduh.type)
-        {
-        case M_SP_NA_1:	// 1: DIGITAL SINGLE
-            {
-                unsigned int addr24=0;
-                iec_type1 *pobj;
-                iec_obj *piecarr = new iec_obj [papdu->asduh.num];
-                if (papdu->asduh.cause==20)
-                   GIObjectCnt+=papdu->asduh.num;
-
-                for ( int i=0; i<papdu->asduh.num; i++ )
-                   {
-                     if ( papdu->asduh.sq )
-                        {
-                        pobj =  &papdu->sq1.obj[i];
-                        if (i==0)
-                          addr24 = papdu->sq1.ioa16 + ((unsigned)papdu->sq1.ioa8 << 16);
-                        else
-                          addr24++;
-                        }
-                     else
-                        {
-                        pobj =  &papdu->nsq1[i].obj;
-                        addr24 = papdu->nsq1[i].ioa16 + ((unsigned)papdu->nsq1[i].ioa8 << 16);
-                        }
-
-                      piecarr[i].address=addr24;
-                      piecarr[i].ca=papdu->asduh.ca;
-                      piecarr[i].cause=papdu->asduh.cause;
-                      piecarr[i].pn=papdu->asduh.pn;
-                      piecarr[i].type=papdu->asduh.type;
-                      piecarr[i].value=pobj->sp;
-                      piecarr[i].sp=pobj->sp;
-                      piecarr[i].bl=pobj->bl;
-                      piecarr[i].nt=pobj->nt;
-                      piecarr[i].sb=pobj->sb;
-                      piecarr[i].iv=pobj->iv;
-                   }
-                dataIndication(piecarr, papdu->asduh.num);
-                delete[] piecarr;
-            }
-            break;
-        case M_DP_NA_1:	// 3: DIGITAL DOUBLE
-            {
-                unsigned int addr24=0;
-                iec_type3 *pobj;
-                iec_obj *piecarr = new iec_obj [papdu->asduh.num];
-                if (papdu->asduh.cause==20)
-                   GIObjectCnt+=papdu->asduh.num;
-
-                for ( int i=0; i<papdu->asduh.num; i++ )
-                   {
-                     if ( papdu->asduh.sq )
-                        {
-                        pobj =  &papdu->sq3.obj[i];
-                        if (i==0)
-                          addr24 = papdu->sq3.ioa16 + ((unsigned)papdu->sq3.ioa8 << 16);
-                        else
-                          addr24++;
-                        }
-                     else
-                        {
-                        pobj =  &papdu->nsq3[i].obj;
-                        addr24 = papdu->nsq3[i].ioa16 + ((unsigned)papdu->nsq3[i].ioa8 << 16);
-                        }
-
-                      piecarr[i].address=addr24;
-                      piecarr[i].ca=papdu->asduh.ca;
-                      piecarr[i].cause=papdu->asduh.cause;
-                      piecarr[i].pn=papdu->asduh.pn;
-                      piecarr[i].type=papdu->asduh.type;
-                      piecarr[i].value=pobj->dp;
-                      piecarr[i].dp=pobj->dp;
-                      piecarr[i].bl=pobj->bl;
-                      piecarr[i].nt=pobj->nt;
-                      piecarr[i].sb=pobj->sb;
-                      piecarr[i].iv=pobj->iv;
-                   }
-                dataIndication(piecarr, papdu->asduh.num);
-                delete[] piecarr;
-            }
-            break;
-        case M_ST_NA_1:	// 5: step position
+        iec_decoder decode = iec_decoders_bytype.bytype[papdu->asduh.type];
+        if ( decode != NULL )
+        { // monitor direction information objects, decoded by the kernel of the type
+            // objects are decoded to the session arena (num has 7 bits, it always fits), no allocation is made
+            unsigned long long allocs = allocCount();
+            int num = decode( papdu, sz, objarena );
+            DecodeAllocCnt += allocCount() - allocs;
+            DecodedAsduCnt++;
+            if ( num < 0 )
             {
-                unsigned int addr24=0;
-                iec_type5 *pobj;
-                iec_obj *piecarr = new iec_obj [papdu->asduh.num];
-                if (papdu->asduh.cause==20)
-                   GIObjectCnt+=papdu->asduh.num;
-
-                for ( int i=0; i<papdu->asduh.num; i++ )
-                   {
-                     if ( papdu->asduh.sq )
-                        {
-                        pobj =  &papdu->sq5.obj[i];
-                        if (i==0)
-                          addr24 = papdu->sq5.ioa16 + ((unsigned)papdu->sq5.ioa8 << 16);
-                        else
-                          addr24++;
-                        }
-                     else
-                        {
-                        pobj =  &papdu->nsq5[i].obj;
-                        addr24 = papdu->nsq5[i].ioa16 + ((unsigned)papdu->nsq5[i].ioa8 << 16);
-                        }
-
-                      piecarr[i].address=addr24;
-                      piecarr[i].ca=papdu->asduh.ca;
-                      piecarr[i].cause=papdu->asduh.cause;
-                      piecarr[i].pn=papdu->asduh.pn;
-                      piecarr[i].type=papdu->asduh.type;
-                      piecarr[i].value=pobj->mv;
-                      piecarr[i].t=pobj->t;
-                      piecarr[i].ov=pobj->ov;
-                      piecarr[i].bl=pobj->bl;
-                      piecarr[i].nt=pobj->nt;
-                      piecarr[i].sb=pobj->sb;
-                      piecarr[i].iv=pobj->iv;
-                   }
-                dataIndication(piecarr, papdu->asduh.num);
-                delete[] piecarr;
-            }
-            break;
-        case M_ME_NA_1:	// 9: ANALOGIC NORMALIZED
-            {
-                unsigned int addr24=0;
-                iec_type9 *pobj;
-                iec_obj *piecarr = new iec_obj [papdu->asduh.num];
-                if (papdu->asduh.cause==20)
-                   GIObjectCnt+=papdu->asduh.num;
-
-                for ( int i=0; i<papdu->asduh.num; i++ )
-                   {
-                     if ( papdu->asduh.sq )
-                        {
-                        pobj =  &papdu->sq9.obj[i];
-                        if (i==0)
-                          addr24 = papdu->sq9.ioa16 + ((unsigned)papdu->sq9.ioa8 << 16);
-                        else
-                          addr24++;
-                        }
-                     else
-                        {
-                        pobj =  &papdu->nsq9[i].obj;
-                        addr24 = papdu->nsq9[i].ioa16 + ((unsigned)papdu->nsq9[i].ioa8 << 16);
-                        }
-
-                      piecarr[i].address=addr24;
-                      piecarr[i].ca=papdu->asduh.ca;
-                      piecarr[i].cause=papdu->asduh.cause;
-                      piecarr[i].pn=papdu->asduh.pn;
-                      piecarr[i].type=papdu->asduh.type;
-                      piecarr[i].value=pobj->mv;
-                      piecarr[i].ov=pobj->ov;
-                      piecarr[i].bl=pobj->bl;
-                      piecarr[i].nt=pobj->nt;
-                      piecarr[i].sb=pobj->sb;
-                      piecarr[i].iv=pobj->iv;
-                   }
-                dataIndication(piecarr, papdu->asduh.num);
-                delete[] piecarr;
-            }
-            break;
-        case M_ME_NB_1:	// 11: ANALOGIC CONVERTED
-            {
-                unsigned int addr24=0;
-                iec_type11 *pobj;
-                iec_obj *piecarr = new iec_obj [papdu->asduh.num];
-                if (papdu->asduh.cause==20)
-                   GIObjectCnt+=papdu->asduh.num;
-
-                for ( int i=0; i<papdu->asduh.num; i++ )
-                   {
-                     if ( papdu->asduh.sq )
-                        {
-                        pobj =  &papdu->sq11.obj[i];
-                        if (i==0)
-                          addr24 = papdu->sq11.ioa16 + ((unsigned)papdu->sq11.ioa8 << 16);
-                        else
-                          addr24++;
-                        }
-                     else
-                        {
-                        pobj =  &papdu->nsq11[i].obj;
-                        addr24 = papdu->nsq11[i].ioa16 + ((unsigned)papdu->nsq11[i].ioa8 << 16);
-                        }
-
-                      piecarr[i].address=addr24;
-                      piecarr[i].ca=papdu->asduh.ca;
-                      piecarr[i].cause=papdu->asduh.cause;
-                      piecarr[i].pn=papdu->asduh.pn;
-                      piecarr[i].type=papdu->asduh.type;
-                      piecarr[i].value=pobj->mv;
-                      piecarr[i].ov=pobj->ov;
-                      piecarr[i].bl=pobj->bl;
-                      piecarr[i].nt=pobj->nt;
-                      piecarr[i].sb=pobj->sb;
-                      piecarr[i].iv=pobj->iv;
-                   }
-                dataIndication(piecarr, papdu->asduh.num);
-                delete[] piecarr;
-            }
-            break;
-        case M_ME_NC_1:	// 13: ANALOGIC FLOATING POINT
-            {
-                unsigned int addr24=0;
-                iec_type13 *pobj;
-                iec_obj *piecarr = new iec_obj [papdu->asduh.num];
-                if (papdu->asduh.cause==20)
-                   GIObjectCnt+=papdu->asduh.num;
-
-                for ( int i=0; i<papdu->asduh.num; i++ )
-                   {
-                     if ( papdu->asduh.sq )
-                        {
-                        pobj =  &papdu->sq13.obj[i];
-                        if (i==0)
-                          addr24 = papdu->sq13.ioa16 + ((unsigned)papdu->sq13.ioa8 << 16);
-                        else
-                          addr24++;
-                        }
-                     else
-                        {
-                        pobj =  &papdu->nsq13[i].obj;
-                        addr24 = papdu->nsq13[i].ioa16 + ((unsigned)papdu->nsq13[i].ioa8 << 16);
-                        }
-
-                      piecarr[i].address=addr24;
-                      piecarr[i].ca=papdu->asduh.ca;
-                      piecarr[i].cause=papdu->asduh.cause;
-                      piecarr[i].pn=papdu->asduh.pn;
-                      piecarr[i].type=papdu->asduh.type;
-                      piecarr[i].value=pobj->mv;
-                      piecarr[i].ov=pobj->ov;
-                      piecarr[i].bl=pobj->bl;
-                      piecarr[i].nt=pobj->nt;
-                      piecarr[i].sb=pobj->sb;
-                      piecarr[i].iv=pobj->iv;
-                   }
-                dataIndication(piecarr, papdu->asduh.num);
-                delete[] piecarr;
-            }
-            break;
-        case M_SP_TB_1:	// 30:  DIGITAL SINGLE WITH LONG TIME TAG
-            {
-                unsigned int addr24=0;
-                iec_type30 *pobj;
-                iec_obj *piecarr = new iec_obj [papdu->asduh.num];
-                if (papdu->asduh.cause==20)
-                   GIObjectCnt+=papdu->asduh.num;
-
-                for ( int i=0; i<papdu->asduh.num; i++ )
-                   {
-                     if ( papdu->asduh.sq )
-                        {
-                        pobj =  &papdu->sq30.obj[i];
-                        if (i==0)
-                          addr24 = papdu->sq30.ioa16 + ((unsigned)papdu->sq30.ioa8 << 16);
-                        else
-                          addr24++;
-                        }
-                     else
-                        {
-                        pobj =  &papdu->nsq30[i].obj;
-                        addr24 = papdu->nsq30[i].ioa16 + ((unsigned)papdu->nsq30[i].ioa8 << 16);
-                        }
-
-                      piecarr[i].address=addr24;
-                      piecarr[i].ca=papdu->asduh.ca;
-                      piecarr[i].cause=papdu->asduh.cause;
-                      piecarr[i].pn=papdu->asduh.pn;
-                      piecarr[i].type=papdu->asduh.type;
-                      piecarr[i].value=pobj->sp;
-                      piecarr[i].sp=pobj->sp;
-                      piecarr[i].bl=pobj->bl;
-                      piecarr[i].nt=pobj->nt;
-                      piecarr[i].sb=pobj->sb;
-                      piecarr[i].iv=pobj->iv;
-                      piecarr[i].timetag.mday=pobj->time.mday;
-                      piecarr[i].timetag.month=pobj->time.month;
-                      piecarr[i].timetag.year=pobj->time.year;
-                      piecarr[i].timetag.hour=pobj->time.hour;
-                      piecarr[i].timetag.min=pobj->time.min;
-                      piecarr[i].timetag.msec=pobj->time.msec;
-                      piecarr[i].timetag.iv=pobj->time.iv;
-                   }
-                dataIndication(piecarr, papdu->asduh.num);
-                delete[] piecarr;
-            }
-            break;
-        case M_DP_TB_1:	// 31: DIGITAL DOUBLE WITH LONG TIME TAG
-            {
-                unsigned int addr24=0;
-                iec_type31 *pobj;
-                iec_obj *piecarr = new iec_obj [papdu->asduh.num];
-                if (papdu->asduh.cause==20)
-                   GIObjectCnt+=papdu->asduh.num;
-
-                for ( int i=0; i<papdu->asduh.num; i++ )
-                   {
-                     if ( papdu->asduh.sq )
-                        {
-                        pobj =  &papdu->sq31.obj[i];
-                        if (i==0)
-                          addr24 = papdu->sq31.ioa16 + ((unsigned)papdu->sq31.ioa8 << 16);
-                        else
-                          addr24++;
-                        }
-                     else
-                        {
-                        pobj =  &papdu->nsq31[i].obj;
-                        addr24 = papdu->nsq31[i].ioa16 + ((unsigned)papdu->nsq31[i].ioa8 << 16);
-                        }
-
-                      piecarr[i].address=addr24;
-                      piecarr[i].ca=papdu->asduh.ca;
-                      piecarr[i].cause=papdu->asduh.cause;
-                      piecarr[i].pn=papdu->asduh.pn;
-                      piecarr[i].type=papdu->asduh.type;
-                      piecarr[i].value=pobj->dp;
-                      piecarr[i].dp=pobj->dp;
-                      piecarr[i].bl=pobj->bl;
-                      piecarr[i].nt=pobj->nt;
-                      piecarr[i].sb=pobj->sb;
-                      piecarr[i].iv=pobj->iv;
-                      piecarr[i].timetag.mday=pobj->time.mday;
-                      piecarr[i].timetag.month=pobj->time.month;
-                      piecarr[i].timetag.year=pobj->time.year;
-                      piecarr[i].timetag.hour=pobj->time.hour;
-                      piecarr[i].timetag.min=pobj->time.min;
-                      piecarr[i].timetag.msec=pobj->time.msec;
-                      piecarr[i].timetag.iv=pobj->time.iv;
-                   }
-                dataIndication(piecarr, papdu->asduh.num);
-                delete[] piecarr;
+                mLog.pushMsg("--> ERROR: ASDU SIZE DOES NOT MATCH NUMBER OF OBJECTS");
+                counters.sizeErrors.add();
             }
-            break;
-        case M_ST_TB_1:	// 32: TAP WITH TIME TAG
+            else
+            if ( num > 0 ) // an asdu without objects leaves objarena as it was: nothing to deliver
             {
-                unsigned int addr24=0;
-                iec_type32 *pobj;
-                iec_obj *piecarr = new iec_obj [papdu->asduh.num];
+                counters.objects[papdu->asduh.type].add( num );
+                if ( latency != NULL && latencyFrameTicks != 0 )
+                  {
+                  latencyDecodedTicks = TLatencyClock::ticks();
+                  latencyRecord( TLatencyStats::DECODE, latencyFrameTicks, latencyDecodedTicks );
+                  }
                 if (papdu->asduh.cause==20)
-                   GIObjectCnt+=papdu->asduh.num;
-
-                for ( int i=0; i<papdu->asduh.num; i++ )
-                   {
-                     if ( papdu->asduh.sq )
-                        {
-                        pobj =  &papdu->sq32.obj[i];
-                        if (i==0)
-                          addr24 = papdu->sq32.ioa16 + ((unsigned)papdu->sq32.ioa8 << 16);
-                        else
-                          addr24++;
-                        }
-                     else
-                        {
-                        pobj =  &papdu->nsq32[i].obj;
-                        addr24 = papdu->nsq32[i].ioa16 + ((unsigned)papdu->nsq32[i].ioa8 << 16);
-                        }
-
-                      piecarr[i].address=addr24;
-                      piecarr[i].ca=papdu->asduh.ca;
-                      piecarr[i].cause=papdu->asduh.cause;
-                      piecarr[i].pn=papdu->asduh.pn;
-                      piecarr[i].type=papdu->asduh.type;
-                      piecarr[i].value=pobj->mv;
-                      piecarr[i].t=pobj->t;
-                      piecarr[i].ov=pobj->ov;
-                      piecarr[i].bl=pobj->bl;
-                      piecarr[i].nt=pobj->nt;
-                      piecarr[i].sb=pobj->sb;
-                      piecarr[i].iv=pobj->iv;
-                      piecarr[i].timetag.mday=pobj->time.mday;
-                      piecarr[i].timetag.month=pobj->time.month;
-                      piecarr[i].timetag.year=pobj->time.year;
-                      piecarr[i].timetag.hour=pobj->time.hour;
-                      piecarr[i].timetag.min=pobj->time.min;
-                      piecarr[i].timetag.msec=pobj->time.msec;
-                      piecarr[i].timetag.iv=pobj->time.iv;
-                   }
-                dataIndication(piecarr, papdu->asduh.num);
-                delete[] piecarr;
+                   GIObjectCnt+=num;
+                if ( pointTable != NULL )
+                  pointTable->update( objarena, num );
+                if ( batchMax > 0 )
+                  appendBatch( papdu, objarena, num );
+                dataIndication(objarena, num);
             }
-            break;
+        }
+        else
+        switch (papdu->asduh.type)
+        {
         case M_BO_NA_1:	//7
             mLog.pushMsg("!!! TYPE NOT IMPLEMENTED");
             break;
         case M_BO_TB_1:	//33
             mLog.pushMsg("!!! TYPE NOT IMPLEMENTED");
             break;
-        case M_ME_TD_1:	//34 MEASURED VALUE, NORMALIZED WITH TIME TAG
-            {
-                unsigned int addr24=0;
-                iec_type34 *pobj;
-                iec_obj *piecarr = new iec_obj [papdu->asduh.num];
-                if (papdu->asduh.cause==20)
-                   GIObjectCnt+=papdu->asduh.num;
-
-                for ( int i=0; i<papdu->asduh.num; i++ )
-                   {
-                     if ( papdu->asduh.sq )
-                        {
-                        pobj =  &papdu->sq34.obj[i];
-                        if (i==0)
-                          addr24 = papdu->sq34.ioa16 + ((unsigned)papdu->sq34.ioa8 << 16);
-                        else
-                          addr24++;
-                        }
-                     else
-                        {
-                        pobj =  &papdu->nsq34[i].obj;
-                        addr24 = papdu->nsq34[i].ioa16 + ((unsigned)papdu->nsq34[i].ioa8 << 16);
-                        }
-
-                      piecarr[i].address=addr24;
-                      piecarr[i].ca=papdu->asduh.ca;
-                      piecarr[i].cause=papdu->asduh.cause;
-                      piecarr[i].pn=papdu->asduh.pn;
-                      piecarr[i].type=papdu->asduh.type;
-                      piecarr[i].value=pobj->mv;
-                      piecarr[i].ov=pobj->ov;
-                      piecarr[i].bl=pobj->bl;
-                      piecarr[i].nt=pobj->nt;
-                      piecarr[i].sb=pobj->sb;
-                      piecarr[i].iv=pobj->iv;
-                      piecarr[i].timetag.mday=pobj->time.mday;
-                      piecarr[i].timetag.month=pobj->time.month;
-                      piecarr[i].timetag.year=pobj->time.year;
-                      piecarr[i].timetag.hour=pobj->time.hour;
-                      piecarr[i].timetag.min=pobj->time.min;
-                      piecarr[i].timetag.msec=pobj->time.msec;
-                      piecarr[i].timetag.iv=pobj->time.iv;
-                   }
-                dataIndication(piecarr, papdu->asduh.num);
-                delete[] piecarr;
-            }
-            break;
-        case M_ME_TE_1:	//35 MEASURED VALUE, SCALED WITH TIME TAG
-            {
-                unsigned int addr24=0;
-                iec_type35 *pobj;
-                iec_obj *piecarr = new iec_obj [papdu->asduh.num];
-                if (papdu->asduh.cause==20)
-                   GIObjectCnt+=papdu->asduh.num;
-
-                for ( int i=0; i<papdu->asduh.num; i++ )
-                   {
-                     if ( papdu->asduh.sq )
-                        {
-                        pobj =  &papdu->sq35.obj[i];
-                        if (i==0)
-                          addr24 = papdu->sq35.ioa16 + ((unsigned)papdu->sq35.ioa8 << 16);
-                        else
-                          addr24++;
-                        }
-                     else
-                        {
-                        pobj =  &papdu->nsq35[i].obj;
-                        addr24 = papdu->nsq35[i].ioa16 + ((unsigned)papdu->nsq35[i].ioa8 << 16);
-                        }
-
-                      piecarr[i].address=addr24;
-                      piecarr[i].ca=papdu->asduh.ca;
-                      piecarr[i].cause=papdu->asduh.cause;
-                      piecarr[i].pn=papdu->asduh.pn;
-                      piecarr[i].type=papdu->asduh.type;
-                      piecarr[i].value=pobj->mv;
-                      piecarr[i].ov=pobj->ov;
-                      piecarr[i].bl=pobj->bl;
-                      piecarr[i].nt=pobj->nt;
-                      piecarr[i].sb=pobj->sb;
-                      piecarr[i].iv=pobj->iv;
-                      piecarr[i].timetag.mday=pobj->time.mday;
-                      piecarr[i].timetag.month=pobj->time.month;
-                      piecarr[i].timetag.year=pobj->time.year;
-                      piecarr[i].timetag.hour=pobj->time.hour;
-                      piecarr[i].timetag.min=pobj->time.min;
-                      piecarr[i].timetag.msec=pobj->time.msec;
-                      piecarr[i].timetag.iv=pobj->time.iv;
-                   }
-                dataIndication(piecarr, papdu->asduh.num);
-                delete[] piecarr;
-            }
-            break;
-        case M_ME_TF_1:	//36 MEASURED VALUE, FLOATING POINT WITH TIME TAG
-            {
-                unsigned int addr24=0;
-                iec_type36 *pobj;
-                iec_obj *piecarr = new iec_obj [papdu->asduh.num];
-                if (papdu->asduh.cause==20)
-                   GIObjectCnt+=papdu->asduh.num;
-
-                for ( int i=0; i<papdu->asduh.num; i++ )
-                   {
-                     if ( papdu->asduh.sq )
-                        {
-                        pobj =  &papdu->sq36.obj[i];
-                        if (i==0)
-                          addr24 = papdu->sq36.ioa16 + ((unsigned)papdu->sq36.ioa8 << 16);
-                        else
-                          addr24++;
-                        }
-                     else
-                        {
-                        pobj =  &papdu->nsq36[i].obj;
-                        addr24 = papdu->nsq36[i].ioa16 + ((unsigned)papdu->nsq36[i].ioa8 << 16);
-                        }
-
-                      piecarr[i].address=addr24;
-                      piecarr[i].ca=papdu->asduh.ca;
-                      piecarr[i].cause=papdu->asduh.cause;
-                      piecarr[i].pn=papdu->asduh.pn;
-                      piecarr[i].type=papdu->asduh.type;
-                      piecarr[i].value=pobj->mv;
-                      piecarr[i].ov=pobj->ov;
-                      piecarr[i].bl=pobj->bl;
-                      piecarr[i].nt=pobj->nt;
-                      piecarr[i].sb=pobj->sb;
-                      piecarr[i].iv=pobj->iv;
-                      piecarr[i].timetag.mday=pobj->time.mday;
-                      piecarr[i].timetag.month=pobj->time.month;
-                      piecarr[i].timetag.year=pobj->time.year;
-                      piecarr[i].timetag.hour=pobj->time.hour;
-                      piecarr[i].timetag.min=pobj->time.min;
-                      piecarr[i].timetag.msec=pobj->time.msec;
-                      piecarr[i].timetag.iv=pobj->time.iv;
-                   }
-                dataIndication(piecarr, papdu->asduh.num);
-                delete[] piecarr;
-            }
-            break;
         case C_SC_NA_1: // SINGLE COMMAND
             {
-            iec_type45 *pobj;
+            const iec_type45 *pobj;
             pobj =  &papdu->nsq45.obj;
 
-            oss.str("");
-            oss << "    ";
-            if (papdu->asduh.cause==ACTCONFIRM)
-                oss << "ACTIVATION CONFIRMATION ";
-            else
-            if (papdu->asduh.cause==ACTTERM)
-                oss << "ACTIVATION TERMINATION ";
-            if (papdu->asduh.pn==POSITIVE)
-                oss << "POSITIVE ";
-            else
-                oss << "NEGATIVE ";
-            oss << "SINGLE COMMAND ADDRESS "
-                    << (unsigned)papdu->nsq45.ioa16 + ((unsigned)papdu->nsq45.ioa8 << 16)
-                    << " SCS "
-                    << (unsigned)pobj->scs
-                    << " QU "
-                    << (int) pobj->qu
-                    << " SE "
-                    << (unsigned)pobj->se;
-            mLog.pushMsg((char*)oss.str().c_str());
+            mLog.pushEvent( 0, "    %s%sSINGLE COMMAND ADDRESS %u SCS %u QU %d SE %u",
+                            commandCauseText( papdu->asduh.cause ), ( papdu->asduh.pn==POSITIVE ) ? "POSITIVE " : "NEGATIVE ",
+                            papdu->nsq45.ioa16 + ((unsigned)papdu->nsq45.ioa8 << 16), pobj->scs, pobj->qu, pobj->se );
 
             // send indication to user
             iec_obj iobj;
@@ -1036,29 +1000,12 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
             break;
         case C_DC_NA_1: // DOUBLE COMMAND
             {
-            iec_type46 *pobj;
+            const iec_type46 *pobj;
             pobj =  &papdu->nsq46.obj;
 
-            oss.str("");
-            oss << "    ";
-            if (papdu->asduh.cause==ACTCONFIRM)
-                oss << "ACTIVATION CONFIRMATION ";
-            else
-            if (papdu->asduh.cause==ACTTERM)
-                oss << "ACTIVATION TERMINATION ";
-            if (papdu->asduh.pn==POSITIVE)
-                oss << "POSITIVE ";
-            else
-                oss << "NEGATIVE ";
-            oss << "DOUBLE COMMAND ADDRESS "
-                    << (unsigned)papdu->nsq46.ioa16 + ((unsigned)papdu->nsq46.ioa8 << 16)
-                    << " DCS "
-                    << (unsigned)pobj->dcs
-                    << " QU "
-                    << (int) pobj->qu
-                    << " SE "
-                    << (unsigned)pobj->se;
-            mLog.pushMsg((char*)oss.str().c_str());
+            mLog.pushEvent( 0, "    %s%sDOUBLE COMMAND ADDRESS %u DCS %u QU %d SE %u",
+                            commandCauseText( papdu->asduh.cause ), ( papdu->asduh.pn==POSITIVE ) ? "POSITIVE " : "NEGATIVE ",
+                            papdu->nsq46.ioa16 + ((unsigned)papdu->nsq46.ioa8 << 16), pobj->dcs, pobj->qu, pobj->se );
 
             // send indication to user
             iec_obj iobj;
@@ -1078,29 +1025,12 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
             break;
         case C_RC_NA_1: // REG.STEP COMMAND
             {
-            iec_type47 *pobj;
+            const iec_type47 *pobj;
             pobj =  &papdu->nsq47.obj;
 
-            oss.str("");
-            oss << "    ";
-            if (papdu->asduh.cause==ACTCONFIRM)
-                oss << "ACTIVATION CONFIRMATION ";
-            else
-            if (papdu->asduh.cause==ACTTERM)
-                oss << "ACTIVATION TERMINATION ";
-            if (papdu->asduh.pn==POSITIVE)
-                oss << "POSITIVE ";
-            else
-                oss << "NEGATIVE ";
-            oss << "STEP REG. COMMAND ADDRESS "
-                    << (unsigned)papdu->nsq47.ioa16 + ((unsigned)papdu->nsq47.ioa8 << 16)
-                    << " RCS "
-                    << (unsigned)pobj->rcs
-                    << " QU "
-                    << (int) pobj->qu
-                    << " SE "
-                    << (unsigned)pobj->se;
-            mLog.pushMsg((char*)oss.str().c_str());
+            mLog.pushEvent( 0, "    %s%sSTEP REG. COMMAND ADDRESS %u RCS %u QU %d SE %u",
+                            commandCauseText( papdu->asduh.cause ), ( papdu->asduh.pn==POSITIVE ) ? "POSITIVE " : "NEGATIVE ",
+                            papdu->nsq47.ioa16 + ((unsigned)papdu->nsq47.ioa8 << 16), pobj->rcs, pobj->qu, pobj->se );
             // send indication to user
             iec_obj iobj;
             iobj.address = papdu->nsq47.ioa16 + ((unsigned)papdu->nsq47.ioa8 << 16);
@@ -1120,29 +1050,12 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
 
         case C_SC_TA_1: // SINGLE COMMAND WITH TIME
             {
-            iec_type58 *pobj;
+            const iec_type58 *pobj;
             pobj =  &papdu->nsq58.obj;
 
-            oss.str("");
-            oss << "    ";
-            if (papdu->asduh.cause==ACTCONFIRM)
-                oss << "ACTIVATION CONFIRMATION ";
-            else
-            if (papdu->asduh.cause==ACTTERM)
-                oss << "ACTIVATION TERMINATION ";
-            if (papdu->asduh.pn==POSITIVE)
-                oss << "POSITIVE ";
-            else
-                oss << "NEGATIVE ";
-            oss << "SINGLE COMMAND ADDRESS "
-                    << (unsigned)papdu->nsq58.ioa16 + ((unsigned)papdu->nsq58.ioa8 << 16)
-                    << " SCS "
-                    << (unsigned)pobj->scs
-                    << " QU "
-                    << (int) pobj->qu
-                    << " SE "
-                    << (unsigned)pobj->se;
-            mLog.pushMsg((char*)oss.str().c_str());
+            mLog.pushEvent( 0, "    %s%sSINGLE COMMAND ADDRESS %u SCS %u QU %d SE %u",
+                            commandCauseText( papdu->asduh.cause ), ( papdu->asduh.pn==POSITIVE ) ? "POSITIVE " : "NEGATIVE ",
+                            papdu->nsq58.ioa16 + ((unsigned)papdu->nsq58.ioa8 << 16), pobj->scs, pobj->qu, pobj->se );
 
             // send indication to user
             iec_obj iobj;
@@ -1162,29 +1075,12 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
             break;
         case C_DC_TA_1: // DOUBLE COMMAND WITH TIME
             {
-            iec_type59 *pobj;
+            const iec_type59 *pobj;
             pobj =  &papdu->nsq59.obj;
 
-            oss.str("");
-            oss << "    ";
-            if (papdu->asduh.cause==ACTCONFIRM)
-                oss << "ACTIVATION CONFIRMATION ";
-            else
-            if (papdu->asduh.cause==ACTTERM)
-                oss << "ACTIVATION TERMINATION ";
-            if (papdu->asduh.pn==POSITIVE)
-                oss << "POSITIVE ";
-            else
-                oss << "NEGATIVE ";
-            oss << "DOUBLE COMMAND ADDRESS "
-                    << (unsigned)papdu->nsq59.ioa16 + ((unsigned)papdu->nsq59.ioa8 << 16)
-                    << " DCS "
-                    << (unsigned)pobj->dcs
-                    << " QU "
-                    << (int) pobj->qu
-                    << " SE "
-                    << (unsigned)pobj->se;
-            mLog.pushMsg((char*)oss.str().c_str());
+            mLog.pushEvent( 0, "    %s%sDOUBLE COMMAND ADDRESS %u DCS %u QU %d SE %u",
+                            commandCauseText( papdu->asduh.cause ), ( papdu->asduh.pn==POSITIVE ) ? "POSITIVE " : "NEGATIVE ",
+                            papdu->nsq59.ioa16 + ((unsigned)papdu->nsq59.ioa8 << 16), pobj->dcs, pobj->qu, pobj->se );
 
             // send indication to user
             iec_obj iobj;
@@ -1204,29 +1100,12 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
             break;
         case C_RC_TA_1: // REG. STEP COMMAND WITH TIME
             {
-            iec_type60 *pobj;
+            const iec_type60 *pobj;
             pobj =  &papdu->nsq60.obj;
 
-            oss.str("");
-            oss << "    ";
-            if (papdu->asduh.cause==ACTCONFIRM)
-                oss << "ACTIVATION CONFIRMATION ";
-            else
-            if (papdu->asduh.cause==ACTTERM)
-                oss << "ACTIVATION TERMINATION ";
-            if (papdu->asduh.pn==POSITIVE)
-                oss << "POSITIVE ";
-            else
-                oss << "NEGATIVE ";
-            oss << "STEP REG. COMMAND ADDRESS "
-                    << (unsigned)papdu->nsq60.ioa16 + ((unsigned)papdu->nsq60.ioa8 << 16)
-                    << " RCS "
-                    << (unsigned)pobj->rcs
-                    << " QU "
-                    << (int) pobj->qu
-                    << " SE "
-                    << (unsigned)pobj->se;
-            mLog.pushMsg((char*)oss.str().c_str());
+            mLog.pushEvent( 0, "    %s%sSTEP REG. COMMAND ADDRESS %u RCS %u QU %d SE %u",
+                            commandCauseText( papdu->asduh.cause ), ( papdu->asduh.pn==POSITIVE ) ? "POSITIVE " : "NEGATIVE ",
+                            papdu->nsq60.ioa16 + ((unsigned)papdu->nsq60.ioa8 << 16), pobj->rcs, pobj->qu, pobj->se );
             // send indication to user
             iec_obj iobj;
             iobj.address = papdu->nsq60.ioa16 + ((unsigned)papdu->nsq60.ioa8 << 16);
@@ -1251,7 +1130,7 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
             if (papdu->asduh.cause==ACTCONFIRM)
             {
                 GIObjectCnt=0;
-                tout_gi=0;
+                wheel->stop( &tmGI );
                 mLog.pushMsg("    INTERROGATION ACT CON ------------------------------------------------------------------------");
                 interrogationActConfIndication();
             }
@@ -1259,10 +1138,7 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
                 if (papdu->asduh.cause==ACTTERM)
                 {
                 mLog.pushMsg("    INTERROGATION ACT TERM ------------------------------------------------------------------------");
-                oss.str("");
-                oss << "    Total objects in GI: "
-                        << GIObjectCnt;
-                mLog.pushMsg((char*)oss.str().c_str());
+                mLog.pushEvent( 0, "    Total objects in GI: %u", GIObjectCnt );
 
                 interrogationActTermIndication();
                 }
@@ -1286,298 +1162,280 @@ void iec104_class::parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond)
         if ( accountandrespond )
         {
 
-            tout_testfr=t3_testfr;
+            wheel->start( &tmT3, t3 );
 
-            if (msg_supervisory)
-            {
-                // will wait t2 seconds or n messages to send supervisory window control
-                if (tout_supervisory<0)
-                    tout_supervisory=t2_supervisory;
-
-                if (tout_supervisory>0)
-                    tout_supervisory--;
-
-                if (tout_supervisory==0)
-                {
-                    tout_supervisory=-1;
-                    sendSupervisory();
-                }
-            }
-            else
+            // acknowledge at once after w received I-frames, else at most t2 seconds later
+            // (an I-frame sent meanwhile also acknowledges them)
+            if ( rx_unack >= w )
                 sendSupervisory();
+            else
+            if ( rx_unack > 0 && !tmT2.isActive() )
+                wheel->start( &tmT2, t2 );
         }
     }
 }
 
+void iec104_class::appendBatch( const iec_apdu * papdu, const iec_obj * obj, int numpoints )
+{
+    if ( batch.count > 0 )
+    if ( obj->type != batch.type || obj->cause != batch.cause || obj->ca != batch.ca || batch.count + numpoints > batchMax )
+      flushBatch();
+
+    if ( batch.count == 0 )
+      {
+      batch.type = obj->type;
+      batch.cause = obj->cause;
+      batch.ca = obj->ca;
+      }
+
+    int n = batch.count;
+
+    // sequenced asdus of the short fixed size types are unpacked straight from the frame by the vector kernels
+    void (*unpack)( const unsigned char *, int, float *, unsigned char * ) = NULL;
+    if ( papdu->asduh.sq )
+    switch ( obj->type )
+      {
+      case M_SP_NA_1: unpack = sqUnpack1; break;
+      case M_ME_NB_1: unpack = sqUnpack11; break;
+      case M_ME_NC_1: unpack = sqUnpack13; break;
+      default: break;
+      }
+    if ( unpack != NULL )
+      {
+      unpack( papdu->dados + 3, numpoints, batchValue + n, batchQuality + n );
+      for ( int i = 0; i < numpoints; i++, n++ )
+        {
+        batchAddress[n] = obj->address + i;
+        batchTime[n] = 0;
+        }
+      batch.count = n;
+      return;
+      }
+
+    if ( obj->type >= M_SP_TB_1 )
+      cp56.toUs( &obj->timetag, sizeof(iec_obj), numpoints, batchTime + n );
+    else
+      memset( batchTime + n, 0, numpoints * sizeof(long long) );
+    for ( int i = 0; i < numpoints; i++, n++ )
+      {
+      batchAddress[n] = obj[i].address;
+      batchValue[n] = obj[i].value;
+      batchQuality[n] = qualityOf( obj[i] );
+      }
+    batch.count = n;
+}
+
+void iec104_class::flushBatch()
+{
+    if ( batch.count == 0 )
+      return;
+    dataIndicationBatch( batch );
+    batch.count = 0;
+}
+
 void iec104_class::sendSupervisory()
 {
-stringstream oss;
 iec_apdu apdu;
 
 apdu.start=START;
 apdu.length=4;
 apdu.NS=SUPERVISORY;
 apdu.NR=VR;
-sendTCP((char *)&apdu, 6);
+sendAPDU((char *)&apdu, 6);
+rx_unack = 0;
+counters.rxUnacked.set( 0 );
+wheel->stop( &tmT2 );
 
-oss.str("");
-oss.setf ( ios::hex, ios::basefield );
-oss << "<-- SUPERVISORY " << VR;
-mLog.pushMsg((char*)(oss.str().c_str()));
+mLog.pushEvent( 0, "<-- SUPERVISORY %x", VR );
 }
 
-bool iec104_class::sendCommand(iec_obj *obj)
+// I-frames are numbered when transmitted; while k frames wait for acknowledgement they are kept in order in txpend
+bool iec104_class::sendIFrame( iec_apdu * apdu )
 {
-iec_apdu apducmd;
-time_t tm1=time(NULL);
-tm *agora=localtime(&tm1);
-stringstream oss;
+if ( txpend_cnt > 0 || unackedCount() >= k )
+  {
+  if ( txpend_cnt >= txpend_max )
+    {
+    mLog.pushMsg( "*** SEND QUEUE FULL, I-FRAME DISCARDED" );
+    return false;
+    }
+  memcpy( &txpend[( txpend_head + txpend_cnt ) % txpend_max], apdu, apdu->length + 2 );
+  txpend_cnt++;
+  counters.txQueued.set( txpend_cnt );
+  mLog.pushEvent( 0, "    K WINDOW FULL, I-FRAME QUEUED (%d)", txpend_cnt );
+  return true;
+  }
 
-obj->cause = ACTIVATION;
-obj->ca = slaveAddress;
+transmitIFrame( apdu );
+return true;
+}
+
+void iec104_class::transmitIFrame( iec_apdu * apdu )
+{
+apdu->NS = VS;
+apdu->NR = VR;
+if ( unackedCount() == 0 )
+  wheel->start( &tmAck, t1 );
+unack_sent[( VS >> 1 ) % k_max] = wheel->now();
+sendAPDU( (char *)apdu, apdu->length + 2 );
+VS += 2;
+counters.unacked.set( unackedCount() );
+
+// the NR of an I-frame acknowledges what was received
+rx_unack = 0;
+counters.rxUnacked.set( 0 );
+wheel->stop( &tmT2 );
+}
 
-switch (obj->type)
+bool iec104_class::ackReceived( unsigned short nr )
+{
+nr &= 0xFFFE;
+
+// nr must be between the oldest unacknowledged and the next to be sent
+if ( (unsigned short)( nr - VA ) > (unsigned short)( VS - VA ) )
   {
-  case C_SC_NA_1:
-    apducmd.start = START;
-    apducmd.length = sizeof(apducmd.NS)+sizeof(apducmd.NR)+sizeof(apducmd.asduh)+sizeof(apducmd.nsq45);
-    apducmd.NS = VS;
-    apducmd.NR = VR;
-    apducmd.asduh.type = obj->type;
-    apducmd.asduh.num = 1;
-    apducmd.asduh.sq = 0;
-    apducmd.asduh.cause = obj->cause;
-    apducmd.asduh.t = 0;
-    apducmd.asduh.pn = 0;
-    apducmd.asduh.oa = masterAddress;
-    apducmd.asduh.ca = obj->ca;
-    apducmd.nsq45.ioa16 = obj->address & 0x0000FFFF;
-    apducmd.nsq45.ioa8 = obj->address >> 16;
-    apducmd.nsq45.obj.scs = obj->scs;
-    apducmd.nsq45.obj.res = 0;
-    apducmd.nsq45.obj.qu = obj->qu;
-    apducmd.nsq45.obj.se = obj->se;
-    sendTCP( (char *)&apducmd, apducmd.length + sizeof(apducmd.start) + sizeof(apducmd.length) );
-    VS+=2;
-
-    oss.str("");
-    oss << "<-- SINGLE COMMAND ADDRESS "
-            << (unsigned)obj->address
-            << " SCS "
-            << (unsigned)obj->scs
-            << " QU "
-            << (int) obj->qu
-            << " SE "
-            << (unsigned)obj->se;
-    mLog.pushMsg((char*)oss.str().c_str());
+  mLog.pushEvent( 0, "*** INVALID NR %x, UNACKNOWLEDGED %x TO %x", nr, VA, VS );
+  counters.invalidNR.add();
+  if ( seq_order_check )
+    {
+    disconnectTCP();
+    return false;
+    }
+  return true;
+  }
 
-    break;
+// time to acknowledge of each frame acknowledged now
+unsigned long long now = wheel->now();
+for ( ; VA != nr; VA += 2 )
+  {
+  counters.ackedFrames.add();
+  counters.ackWaitMs.add( now - unack_sent[( VA >> 1 ) % k_max] );
+  }
+
+// t1 now runs for the oldest frame still unacknowledged
+if ( unackedCount() > 0 )
+  {
+  unsigned long long elapsed = now - unack_sent[( VA >> 1 ) % k_max];
+  wheel->start( &tmAck, ( elapsed < t1 ) ? unsigned( t1 - elapsed ) : 1 );
+  }
+else
+  wheel->stop( &tmAck );
+
+// room in the window: send what was waiting, in one write
+holdTx();
+while ( txpend_cnt > 0 && unackedCount() < k && connectedTCP )
+  {
+  transmitIFrame( &txpend[txpend_head] );
+  txpend_head = ( txpend_head + 1 ) % txpend_max;
+  txpend_cnt--;
+  }
+releaseTx();
+counters.txQueued.set( txpend_cnt );
+counters.unacked.set( unackedCount() );
+
+return true;
+}
+
+// offsets in iec_cmdtpl::frame: the command octet follows the 3 byte address, the time tag follows it
+static const int cmd_octet = 15;
+static const int cmd_size = 16;
+static const int cmd_size_time = cmd_size + sizeof(cp56time2a);
+
+bool iec104_class::prepareCommand( iec_cmdtpl * tpl, unsigned address, unsigned char type )
+{
+iec_apdu apducmd;
+
+tpl->size = 0;
+switch ( type )
+  {
+  case C_SC_NA_1:
   case C_DC_NA_1:
-    apducmd.start = START;
-    apducmd.length = sizeof(apducmd.NS)+sizeof(apducmd.NR)+sizeof(apducmd.asduh)+sizeof(apducmd.nsq46);
-    apducmd.NS = VS;
-    apducmd.NR = VR;
-    apducmd.asduh.type = obj->type;
-    apducmd.asduh.num = 1;
-    apducmd.asduh.sq = 0;
-    apducmd.asduh.cause = obj->cause;
-    apducmd.asduh.t = 0;
-    apducmd.asduh.pn = 0;
-    apducmd.asduh.oa = masterAddress;
-    apducmd.asduh.ca = obj->ca;
-    apducmd.nsq46.ioa16 = obj->address & 0x0000FFFF;
-    apducmd.nsq46.ioa8 = obj->address >> 16;
-    apducmd.nsq46.obj.dcs = obj->dcs;
-    apducmd.nsq46.obj.qu = obj->qu;
-    apducmd.nsq46.obj.se = obj->se;
-    sendTCP( (char *)&apducmd, apducmd.length + sizeof(apducmd.start) + sizeof(apducmd.length) );
-    VS+=2;
-
-    oss.str("");
-    oss << "<-- DOUBLE COMMAND ADDRESS "
-            << (unsigned)obj->address
-            << " DCS "
-            << (unsigned)obj->dcs
-            << " QU "
-            << (int) obj->qu
-            << " SE "
-            << (unsigned)obj->se;
-    mLog.pushMsg((char*)oss.str().c_str());
-    break;
   case C_RC_NA_1:
-    apducmd.start = START;
-    apducmd.length = sizeof(apducmd.NS)+sizeof(apducmd.NR)+sizeof(apducmd.asduh)+sizeof(apducmd.nsq47);
-    apducmd.NS = VS;
-    apducmd.NR = VR;
-    apducmd.asduh.type = obj->type;
-    apducmd.asduh.num = 1;
-    apducmd.asduh.sq = 0;
-    apducmd.asduh.cause = obj->cause;
-    apducmd.asduh.t = 0;
-    apducmd.asduh.pn = 0;
-    apducmd.asduh.oa = masterAddress;
-    apducmd.asduh.ca = obj->ca;
-    apducmd.nsq47.ioa16 = obj->address & 0x0000FFFF;
-    apducmd.nsq47.ioa8 = obj->address >> 16;
-    apducmd.nsq47.obj.rcs = obj->rcs;
-    apducmd.nsq47.obj.qu = obj->qu;
-    apducmd.nsq47.obj.se = obj->se;
-    sendTCP( (char *)&apducmd, apducmd.length + sizeof(apducmd.start) + sizeof(apducmd.length) );
-    VS+=2;
-    oss.str("");
-    oss << "<-- STEP REG. COMMAND ADDRESS "
-            << (unsigned)obj->address
-            << " RCS "
-            << (unsigned)obj->rcs
-            << " QU "
-            << (int) obj->qu
-            << " SE "
-            << (unsigned)obj->se;
-    mLog.pushMsg((char*)oss.str().c_str());
+    tpl->size = cmd_size;
     break;
   case C_SC_TA_1:
-    apducmd.start = START;
-    apducmd.length = sizeof(apducmd.NS)+sizeof(apducmd.NR)+sizeof(apducmd.asduh)+sizeof(apducmd.nsq58);
-    apducmd.NS = VS;
-    apducmd.NR = VR;
-    apducmd.asduh.type = obj->type;
-    apducmd.asduh.num = 1;
-    apducmd.asduh.sq = 0;
-    apducmd.asduh.cause = obj->cause;
-    apducmd.asduh.t = 0;
-    apducmd.asduh.pn = 0;
-    apducmd.asduh.oa = masterAddress;
-    apducmd.asduh.ca = obj->ca;
-    apducmd.nsq58.ioa16 = obj->address & 0x0000FFFF;
-    apducmd.nsq58.ioa8 = obj->address >> 16;
-    apducmd.nsq58.obj.scs = obj->scs;
-    apducmd.nsq58.obj.res = 0;
-    apducmd.nsq58.obj.qu = obj->qu;
-    apducmd.nsq58.obj.se = obj->se;
-    apducmd.nsq58.obj.time.year=agora->tm_year%100;
-    apducmd.nsq58.obj.time.month=agora->tm_mon;
-    apducmd.nsq58.obj.time.mday=agora->tm_mday;
-    apducmd.nsq58.obj.time.hour=agora->tm_hour;
-    apducmd.nsq58.obj.time.min=agora->tm_min;
-    apducmd.nsq58.obj.time.hour=agora->tm_hour;
-    apducmd.nsq58.obj.time.msec=agora->tm_sec*1000;
-    apducmd.nsq58.obj.time.iv=0;
-    apducmd.nsq58.obj.time.su=0;
-    apducmd.nsq58.obj.time.wday=agora->tm_wday;
-    apducmd.nsq58.obj.time.res1=0;
-    apducmd.nsq58.obj.time.res2=0;
-    apducmd.nsq58.obj.time.res3=0;
-    apducmd.nsq58.obj.time.res4=0;
-    sendTCP( (char *)&apducmd, apducmd.length + sizeof(apducmd.start) + sizeof(apducmd.length) );
-    VS+=2;
-
-    oss.str("");
-    oss << "<-- SINGLE COMMAND W/TIME ADDRESS "
-            << (unsigned)obj->address
-            << " SCS "
-            << (unsigned)obj->scs
-            << " QU "
-            << (int) obj->qu
-            << " SE "
-            << (unsigned)obj->se;
-    mLog.pushMsg((char*)oss.str().c_str());
-
-    break;
   case C_DC_TA_1:
-    apducmd.start = START;
-    apducmd.length = sizeof(apducmd.NS)+sizeof(apducmd.NR)+sizeof(apducmd.asduh)+sizeof(apducmd.nsq59);
-    apducmd.NS = VS;
-    apducmd.NR = VR;
-    apducmd.asduh.type = obj->type;
-    apducmd.asduh.num = 1;
-    apducmd.asduh.sq = 0;
-    apducmd.asduh.cause = obj->cause;
-    apducmd.asduh.t = 0;
-    apducmd.asduh.pn = 0;
-    apducmd.asduh.oa = masterAddress;
-    apducmd.asduh.ca = obj->ca;
-    apducmd.nsq59.ioa16 = obj->address & 0x0000FFFF;
-    apducmd.nsq59.ioa8 = obj->address >> 16;
-    apducmd.nsq59.obj.dcs = obj->dcs;
-    apducmd.nsq59.obj.qu = obj->qu;
-    apducmd.nsq59.obj.se = obj->se;
-    apducmd.nsq59.obj.time.year=agora->tm_year%100;
-    apducmd.nsq59.obj.time.month=agora->tm_mon;
-    apducmd.nsq59.obj.time.mday=agora->tm_mday;
-    apducmd.nsq59.obj.time.hour=agora->tm_hour;
-    apducmd.nsq59.obj.time.min=agora->tm_min;
-    apducmd.nsq59.obj.time.hour=agora->tm_hour;
-    apducmd.nsq59.obj.time.msec=agora->tm_sec*1000;
-    apducmd.nsq59.obj.time.iv=0;
-    apducmd.nsq59.obj.time.su=0;
-    apducmd.nsq59.obj.time.wday=agora->tm_wday;
-    apducmd.nsq59.obj.time.res1=0;
-    apducmd.nsq59.obj.time.res2=0;
-    apducmd.nsq59.obj.time.res3=0;
-    apducmd.nsq59.obj.time.res4=0;
-    sendTCP( (char *)&apducmd, apducmd.length + sizeof(apducmd.start) + sizeof(apducmd.length) );
-    VS+=2;
-
-    oss.str("");
-    oss << "<-- DOUBLE COMMAND W/TIME ADDRESS "
-            << (unsigned)obj->address
-            << " DCS "
-            << (unsigned)obj->dcs
-            << " QU "
-            << (int) obj->qu
-            << " SE "
-            << (unsigned)obj->se;
-    mLog.pushMsg((char*)oss.str().c_str());
-    break;
   case C_RC_TA_1:
-    apducmd.start = START;
-    apducmd.length = sizeof(apducmd.NS)+sizeof(apducmd.NR)+sizeof(apducmd.asduh)+sizeof(apducmd.nsq60);
-    apducmd.NS = VS;
-    apducmd.NR = VR;
-    apducmd.asduh.type = obj->type;
-    apducmd.asduh.num = 1;
-    apducmd.asduh.sq = 0;
-    apducmd.asduh.cause = obj->cause;
-    apducmd.asduh.t = 0;
-    apducmd.asduh.pn = 0;
-    apducmd.asduh.oa = masterAddress;
-    apducmd.asduh.ca = obj->ca;
-    apducmd.nsq60.ioa16 = obj->address & 0x0000FFFF;
-    apducmd.nsq60.ioa8 = obj->address >> 16;
-    apducmd.nsq60.obj.rcs = obj->rcs;
-    apducmd.nsq60.obj.qu = obj->qu;
-    apducmd.nsq60.obj.se = obj->se;
-    apducmd.nsq60.obj.time.year=agora->tm_year%100;
-    apducmd.nsq60.obj.time.month=agora->tm_mon;
-    apducmd.nsq60.obj.time.mday=agora->tm_mday;
-    apducmd.nsq60.obj.time.hour=agora->tm_hour;
-    apducmd.nsq60.obj.time.min=agora->tm_min;
-    apducmd.nsq60.obj.time.hour=agora->tm_hour;
-    apducmd.nsq60.obj.time.msec=agora->tm_sec*1000;
-    apducmd.nsq60.obj.time.iv=0;
-    apducmd.nsq60.obj.time.su=0;
-    apducmd.nsq60.obj.time.wday=agora->tm_wday;
-    apducmd.nsq60.obj.time.res1=0;
-    apducmd.nsq60.obj.time.res2=0;
-    apducmd.nsq60.obj.time.res3=0;
-    apducmd.nsq60.obj.time.res4=0;
-    sendTCP( (char *)&apducmd, apducmd.length + sizeof(apducmd.start) + sizeof(apducmd.length) );
-    VS+=2;
-    oss.str("");
-    oss << "<-- STEP REG. COMMAND W/TIME ADDRESS "
-            << (unsigned)obj->address
-            << " RCS "
-            << (unsigned)obj->rcs
-            << " QU "
-            << (int) obj->qu
-            << " SE "
-            << (unsigned)obj->se;
-    mLog.pushMsg((char*)oss.str().c_str());
+    tpl->size = cmd_size_time;
     break;
   default:
     return false;
   }
 
+memset( &apducmd, 0, sizeof(tpl->frame) );
+apducmd.start = START;
+apducmd.length = tpl->size - 2;
+apducmd.asduh.type = type;
+apducmd.asduh.num = 1;
+apducmd.asduh.sq = 0;
+apducmd.asduh.cause = ACTIVATION;
+apducmd.asduh.t = 0;
+apducmd.asduh.pn = 0;
+apducmd.asduh.oa = masterAddress;
+apducmd.asduh.ca = slaveAddress;
+apducmd.nsq45.ioa16 = address & 0x0000FFFF;
+apducmd.nsq45.ioa8 = address >> 16;
+memcpy( tpl->frame, &apducmd, sizeof(tpl->frame) );
+tpl->type = type;
+tpl->ca = slaveAddress;
+tpl->address = address;
 return true;
 }
 
+bool iec104_class::sendCommand( iec_cmdtpl * tpl, unsigned char state, unsigned char qu, bool select )
+{
+static const char * formats[2][3] = {
+    { "<-- SINGLE COMMAND ADDRESS %u SCS %u QU %d SE %u",
+      "<-- DOUBLE COMMAND ADDRESS %u DCS %u QU %d SE %u",
+      "<-- STEP REG. COMMAND ADDRESS %u RCS %u QU %d SE %u" },
+    { "<-- SINGLE COMMAND W/TIME ADDRESS %u SCS %u QU %d SE %u",
+      "<-- DOUBLE COMMAND W/TIME ADDRESS %u DCS %u QU %d SE %u",
+      "<-- STEP REG. COMMAND W/TIME ADDRESS %u RCS %u QU %d SE %u" } };
+iec_apdu apducmd;
+unsigned char * frame = (unsigned char *)&apducmd;
+
+if ( tpl->size == 0 )
+  return false;
+
+memcpy( frame, tpl->frame, sizeof(tpl->frame) ); // constant size: a few moves, no memcpy call
+// scs (1 bit, 1 reserved) or dcs/rcs (2 bits), qu (5 bits), se
+bool single = tpl->type == C_SC_NA_1 || tpl->type == C_SC_TA_1;
+frame[cmd_octet] = ( state & ( single ? 1 : 3 ) ) | ( ( qu & 0x1F ) << 2 ) | ( select ? 0x80 : 0 );
+if ( tpl->size == cmd_size_time )
+  {
+  // the day is cached by cp56, no localtime() call; the commands of a batch share one clock read
+  cp56time2a * time = (cp56time2a *)( frame + cmd_size );
+  if ( txhold == 0 )
+    cp56.localNow( *time );
+  else
+    {
+    if ( !cmdTimeValid )
+      {
+      cp56.localNow( cmdTime );
+      cmdTimeValid = true;
+      }
+    *time = cmdTime;
+    }
+  }
+if ( !sendIFrame( &apducmd ) )
+  return false;
+
+bool timetag = tpl->size == cmd_size_time;
+mLog.pushEvent( 0, formats[timetag][tpl->type - ( timetag ? C_SC_TA_1 : C_SC_NA_1 )],
+                tpl->address, state & ( single ? 1 : 3 ), qu & 0x1F, select ? 1 : 0 );
+return true;
+}
+
+bool iec104_class::sendCommand(iec_obj *obj)
+{
+iec_cmdtpl tpl;
+
+obj->cause = ACTIVATION;
+obj->ca = slaveAddress;
+
+if ( !prepareCommand( &tpl, obj->address, obj->type ) )
+  return false;
+// scs, dcs and rcs share the same bits of obj
+return sendCommand( &tpl, obj->dcs, obj->qu, obj->se );
+}
+
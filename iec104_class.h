@@ -34,6 +34,13 @@
 
 #include "iec104_types.h"
 #include "logmsg.h"
+#include "timerwheel.h"
+#include "cp56time.h"
+#include "metrics.h"
+
+class TPointTable;
+class TApduRecorder;
+class TLatencyStats;
 
 struct iec_obj {
     unsigned int address;       // 3 byte address           3字节地址
@@ -68,6 +75,30 @@ struct iec_obj {
     unsigned char pn :1;        // 0=positive, 1=negative      0 =正，1 =负
 };
 
+// objects of one or more consecutive asdus of the same type, cause and common address, as parallel arrays
+// 一个或多个相同类型、原因和公共地址的连续asdu的对象，以并行数组表示
+struct iec_batch {
+    unsigned char type;         // iec type                 IEC类型
+    unsigned char cause;
+    unsigned short ca;          // common addres of asdu    ASDU地址
+    int count;                  // number of objects        对象数量
+    const unsigned int * address;   // information object addresses                        信息对象地址
+    const float * value;            // values (the state for single and double points)     值
+    const unsigned char * quality;  // quality descriptor bits (iec104_class::QDS_*)       品质描述词
+    const long long * time;         // time tags in us since epoch (fields taken as UTC), 0 if the type has none   时间标签
+};
+
+// a command encoded once by iec104_class::prepareCommand and sent by sendCommand( iec_cmdtpl *, ... ) as often as
+// needed: only NS/NR, the command octet and the time tag are written when it is sent
+// 预编码的命令：发送时只写入NS/NR、命令字节和时间标签
+struct iec_cmdtpl {
+    unsigned char frame[23];    // the apdu, up to the time tag         apdu
+    unsigned char size;         // bytes of frame, 0 = not prepared     字节数
+    unsigned char type;         // C_SC/C_DC/C_RC, with or without time tag
+    unsigned short ca;          // common addres of asdu    ASDU地址
+    unsigned int address;       // information object address
+};
+
 class iec104_class
 {
     public:
@@ -129,15 +160,39 @@ class iec104_class
     static const unsigned int SELECT = 1;
     static const unsigned int EXECUTE = 0;
 
+    // quality descriptor bits (QDS)                                          品质描述词位
+    static const unsigned char QDS_OV = 0x01; // overflow                    溢出
+    static const unsigned char QDS_BL = 0x10; // blocked                     阻止
+    static const unsigned char QDS_SB = 0x20; // substituted                 取代
+    static const unsigned char QDS_NT = 0x40; // not topical                 非当前值
+    static const unsigned char QDS_IV = 0x80; // invalid                     无效
+    static unsigned char qualityOf( const iec_obj & obj ); // QDS bits of a decoded object   解码对象的QDS位
+
     TLogMsg mLog;
 
     // ---- user called funcions, must be called by the user -----------------
     // ---- 用户称为funcions，必须由用户调用 -----------------
     iec104_class(); // user called constructor on derived class                             用户在派生类上调用了构造函数
+    virtual ~iec104_class();
     void onConnectTCP(); // user called, when tcp connected                                 当tcp连接时用户调用
     void onDisconnectTCP(); // user called, when tcp disconnected                           tcp断开连接时，用户调用
-    void onTimerSecond();  // user called, each second timer                                用户呼叫，每秒钟计时器
     void packetReadyTCP(); // user called, when packet ready to be read from tcp connection 当数据包准备从tcp连接读取时，用户调用
+    void startConnecting(); // user called, connect now and retry every t0 while disconnected      用户调用，立即连接，断开时每t0重试
+    void stopConnecting(); // user called, stop retrying the connection                            用户调用，停止重试连接
+
+    // protocol timers run on a timer wheel, the user must advance it ( getTimerWheel()->advance( TTimerWheel::nowMs() ) )
+    // before processing events and when getTimerWheel()->nextExpiry() ms have passed
+    // 协议定时器在时间轮上运行，用户必须在处理事件之前以及经过nextExpiry()毫秒后推进它
+    void setTimerWheel( TTimerWheel * tw ); // share a wheel among connections (NULL = own wheel), call while not connecting   在连接之间共享时间轮
+    TTimerWheel * getTimerWheel();
+    void setT0( unsigned ms ); // connection retry period (default 5000 ms)                                 连接重试周期
+    unsigned getT0();
+    void setT1( unsigned ms ); // timeout of STARTDT and of sent I-frames acknowledgement (default 15000 ms)  STARTDT和发送I帧确认的超时
+    unsigned getT1();
+    void setT2( unsigned ms ); // max delay to acknowledge received I-frames (default 10000 ms)              确认接收I帧的最大延迟
+    unsigned getT2();
+    void setT3( unsigned ms ); // idle time to send a test frame (default 10000 ms)                          发送测试帧的空闲时间
+    unsigned getT3();
 
     void solicitGI();  // General Interrogation     一般审讯
     void setSecondaryIP( char * ip );
@@ -147,35 +202,139 @@ class iec104_class
     void setPrimaryAddress( int addr );
     int getPrimaryAddress();
     void disableSequenceOrderCheck();  // allow sequence out of order           允许顺序混乱
-    bool sendCommand( iec_obj *obj ); // Command, return false if not send      命令，如果不发送，则返回false
+    bool sendCommand( iec_obj *obj ); // Command, return false if not send (not a command type or send queue full)   命令，如果不发送，则返回false
+    bool prepareCommand( iec_cmdtpl * tpl, unsigned address, unsigned char type ); // encode a command to address of the slave once, false if type is not C_SC/C_DC/C_RC   预编码命令
+    // send a prepared command, state is the scs/dcs/rcs; false if the send queue is full (the k window and 64 more frames)
+    // 发送预编码的命令；发送队列满时返回false
+    bool sendCommand( iec_cmdtpl * tpl, unsigned char state, unsigned char qu = 0, bool select = false );
+    // commands (and any frame) sent between these calls are written with one sendTCP at endCommandBatch, the frames
+    // beyond the k window wait in the send queue as usual; time tagged commands of a batch share the same time
+    // 两次调用之间发送的命令在endCommandBatch时一次写入
+    void beginCommandBatch();
+    void endCommandBatch();
     int getPortTCP();
     void setPortTCP( unsigned port );
+    void setK( int k ); // max sent I-frames not yet acknowledged by the slave (1..k_max, default 12)    未被从站确认的最大发送I帧数
+    int getK();
+    void setW( int w ); // acknowledge received I-frames after w of them (1..k_max, default 8)         接收w个I帧后确认
+    int getW();
+    unsigned long long getDecodedAsduCount(); // number of data asdus decoded to objects              解码为对象的数据asdu数量
+    unsigned long long getDecodeAllocCount(); // heap allocations made while decoding (needs IEC104_COUNT_ALLOCS, see alloccnt.h)  解码时的堆分配次数
+    void setBatchIndication( int maxpoints ); // > 0: also deliver decoded objects to dataIndicationBatch, in groups of up to maxpoints (at least 127); 0 = off   批量指示
+    void setPointTable( TPointTable * pt ); // decoded points are also stored in pt (NULL = none), a table takes a single writer thread   解码的点也存入pt
+    TPointTable * getPointTable();
+    void setRecorder( TApduRecorder * rec, unsigned session ); // every apdu sent and received is recorded in rec as session (NULL = off)   每个收发的apdu记录到rec
+    void setLatencyStats( TLatencyStats * ls ); // received frames are timed by stage in ls (NULL = off), see latency.h   接收帧各阶段的延迟记录到ls
+    TLatencyStats * getLatencyStats();
+    const TSessionCounters & getCounters(); // frames, objects, errors and window state, readable from any thread, see metrics.h   会话计数器，任何线程可读
 
     private:
     unsigned short VS;  // sender packet control counter                    发件人数据包控制计数器
     unsigned short VR;  // receiver packet control counter                  接收者数据包控制计数器
+    unsigned short VA;  // oldest sent I-frame not acknowledged by the slave 从站尚未确认的最早发送I帧
     void confTestCommand(); // test command activation confirmation         测试命令激活确认
     void sendStartDTACT(); // send STARTDTACT                               发送STARTDTACT
-    int tout_startdtact; // timeout control                                 超时控制
     void sendSupervisory(); // send supervisory window control frame        发送监控窗口控制框
-    int tout_supervisory;  // countdown to send supervisory window control  倒计时发送监控窗口控件
-    int tout_gi; // countdown to send general interrogation                 倒计时发送一般审讯
-    int tout_testfr; // countdown to send test frame                        倒数发送测试帧
+    bool sendIFrame( iec_apdu * apdu ); // number and send an I-frame, queued while the k window is full, false if the queue is full   编号并发送I帧，k窗口满时排队
+    void transmitIFrame( iec_apdu * apdu );
+    void sendAPDU( char * data, int sz ); // sendTCP, recorded if a recorder is set       发送，设置了记录器时记录
+    void countFrame( int dir, const unsigned char * data, int sz ); // counts a sent or received apdu   计数收发的apdu
+    void holdTx(); // sendAPDU appends to txbuf until the matching releaseTx   暂存发送
+    void releaseTx(); // writes txbuf with one sendTCP                         一次写入txbuf
+    bool ackReceived( unsigned short nr ); // slave acknowledged up to nr, false if nr is invalid          从站确认到nr，nr无效时返回false
+    int unackedCount() { return (unsigned short)( VS - VA ) >> 1; }
     bool connectedTCP; // tcp connection state                              TCP连接状态
     bool seq_order_check; // if set: test message order, disconnect if out of order                     如果设置：测试消息顺序，如果故障则断开连接
     unsigned char masterAddress; // master link address (primary address, originator address, oa)       主链接地址（主地址，发起方地址，oa）
     unsigned short slaveAddress; // slave link address (secondary address, common address of ASDU, ca)  从站链接地址（辅助地址，ASDU的公共地址，ca）
     unsigned Port; // iec104 tcp port (defaults to 2404)                                                iec104 tcp端口（默认为2404）
     char slaveIP[20]; // slave (secondary, RTU) IP address                                              从属（辅助，RTU）IP地址
-    static const int t3_testfr = 10;
-    static const int t2_supervisory = 8;
-    static const int t1_startdtact = 6;
+
+    // timers                                                                                          定时器
+    enum { TM_CONNECT, TM_STARTDT, TM_ACK, TM_T2, TM_T3, TM_GI };
+    static void onTimer( void * ctx, int id );
+    TTimerWheel ownWheel;
+    TTimerWheel * wheel;
+    TWheelTimer tmConnect; // t0: retry connection                          重试连接
+    TWheelTimer tmStartDT; // t1: STARTDTCON not received, retry STARTDTACT 未收到STARTDTCON，重试
+    TWheelTimer tmAck; // t1: oldest sent I-frame not acknowledged, close   最早发送的I帧未确认，关闭
+    TWheelTimer tmT2; // t2: acknowledge received I-frames                  确认接收的I帧
+    TWheelTimer tmT3; // t3: nothing received, send test frame              未收到任何内容，发送测试帧
+    TWheelTimer tmGI; // general interrogation after STARTDTCON            STARTDTCON之后的总召唤
+    unsigned t0, t1, t2, t3; // ms
+    static const unsigned gi_delay = 10000; // ms
+    bool reconnect; // startConnecting() called                            已调用startConnecting()
+
+    // k/w flow control                                                                                流量控制
+    static const int k_max = 256;
+    int k; // max sent I-frames not acknowledged                            最大未确认发送I帧数
+    int w; // received I-frames that trigger an acknowledgement             触发确认的接收I帧数
+    int rx_unack; // I-frames received and not acknowledged yet             已接收但尚未确认的I帧
+    unsigned long long unack_sent[k_max]; // send time (wheel ms) of the unacknowledged I-frames, indexed by sequence number modulo k_max   未确认I帧的发送时间
+    static const int txpend_max = 64;
+    iec_apdu txpend[txpend_max]; // I-frames waiting for room in the k window   等待k窗口空间的I帧
+    int txpend_head;
+    int txpend_cnt;
+
+    // frames held by holdTx, written together   暂存的帧，一起写入
+    static const int txbuf_size = 4096;
+    char txbuf[txbuf_size];
+    int txlen;
+    int txhold; // holdTx nesting, 0 = sendAPDU writes at once
+    cp56time2a cmdTime; // time tag of the commands of the current batch   当前批次命令的时间标签
+    bool cmdTimeValid;
+
+    // receive buffer: all available tcp data is read at once and apdus are extracted in place, partial frames stay for the next call
+    // 接收缓冲区：一次读取所有可用的tcp数据并就地提取apdu，不完整的帧保留到下一次调用
+    static const int rxbuf_size = 4096;
+    unsigned char rxbuf[rxbuf_size + sizeof(iec_apdu)]; // slack after the end: a frame near the end can be viewed as a whole iec_apdu
+    int rxhead; // first byte not consumed yet      第一个尚未处理的字节
+    int rxtail; // end of the received data         接收数据的结尾
+
+    // decoded objects of the current asdu, reused for every asdu: decoding does not allocate
+    // 当前asdu的解码对象，每个asdu重复使用：解码不分配内存
+    static const int asdu_maxobj = 127; // the number of objects field has 7 bits
+    iec_obj objarena[asdu_maxobj];
+    unsigned long long DecodedAsduCnt;
+    unsigned long long DecodeAllocCnt;
+    TPointTable * pointTable; // process image updated after decoding, optional   解码后更新的过程映像，可选
+    TApduRecorder * recorder; // capture of the apdus, optional   apdu捕获，可选
+    unsigned recorderSession;
+
+    // receive path latency, optional   接收路径延迟，可选
+    void latencyRecord( int stage, unsigned long long from, unsigned long long to );
+    void latencyDelivered( unsigned long long now ); // closes the deliver stage of the last decoded frame
+    TLatencyStats * latency;
+    double latencyNsPerTick;
+    unsigned long long latencyReadTicks; // TLatencyClock ticks when the last read returned
+    unsigned long long latencyFrameTicks; // when the frame being parsed was extracted, 0 = not parsed from receiveAPDUs
+    unsigned long long latencyDecodedTicks; // when the objects of the last frame were decoded, 0 = none pending
+    long long rxKernelNs; // kernel receive time of the data of the last read (system clock ns), 0 = unknown
+
+    // batch indication: objects decoded in one packetReadyTCP() call, grouped while type, cause and ca don't change
+    // 批量指示：一次packetReadyTCP()调用中解码的对象，在类型、原因和ca不变时分组
+    void receiveAPDUs();
+    void appendBatch( const iec_apdu * papdu, const iec_obj * obj, int numpoints );
+    void flushBatch();
+    iec_batch batch;
+    int batchMax; // 0 = batch indication off
+    unsigned int * batchAddress;
+    float * batchValue;
+    unsigned char * batchQuality;
+    long long * batchTime;
+    TCp56Time cp56; // time tag conversions, the current day cached   时间标签转换，缓存当天
 
     protected:
-    void parseAPDU(iec_apdu * papdu, int sz, bool accountandrespond = true); // parse APDU, ( accountandrespond == false : process the apdu out of the normal handshake )
+    // parse APDU, ( accountandrespond == false : process the apdu out of the normal handshake )
+    // papdu is a read-only view of the frame, it may point directly into the receive buffer
+    // 解析APDU，papdu是帧的只读视图，可以直接指向接收缓冲区
+    void parseAPDU(const iec_apdu * papdu, int sz, bool accountandrespond = true);
 
-    int msg_supervisory;
+    // called by readTCP: kernel receive time (system clock ns, e.g. from SO_TIMESTAMPING) of the data it returns
+    // 由readTCP调用：返回数据的内核接收时间
+    void setRxKernelTime( long long ns ) { rxKernelNs = ns; }
 
+    TSessionCounters counters; // the session thread writes, any thread reads; txBuffered is left to the derived class   会话计数器
     bool TxOk; // ready to transmit state (STARTDTCON received)             准备发送状态（已收到STARTDTCON）
     unsigned GIObjectCnt; // contador de objetos da GI                      GI对象计数器
 
@@ -197,8 +356,13 @@ class iec104_class
     // ---- virtual funcions, user defined on derived class (not mandatory)---
 
     // user point process, user provided. (on one call must be only objects of one type)
+    // obj points to an internal buffer, reused on the next asdu: copy what must be kept after the call
     // 用户点过程，由用户提供。 （一次调用只能是一种类型的对象）
+    // obj指向内部缓冲区，下一个asdu会重复使用：调用后需要保留的内容必须复制
     virtual void dataIndication( iec_obj * /*obj*/, int /*numpoints*/){};
+    // same objects as parallel arrays, only after setBatchIndication(); the arrays are reused after the call
+    // 相同的对象以并行数组表示，仅在setBatchIndication()之后；调用后数组会被重复使用
+    virtual void dataIndicationBatch( const iec_batch & /*batch*/ ){};
     // inform user that ACTCONFIRM of Interrogation was received from slave
     // 通知用户从接收到了ACTCONFIRM的询问
     virtual void interrogationActConfIndication(){};
@@ -211,9 +375,9 @@ class iec104_class
     // inform user of command termination
     // 通知用户命令终止
     virtual void commandActTermIndication( iec_obj * /*obj*/ ){};
-    // user process APDU
-    // 用户进程APDU
-    virtual void userprocAPDU(iec_apdu * /* papdu */, int /* sz */){};
+    // user process APDU, papdu is a read-only view into the receive buffer, valid only during the call
+    // 用户进程APDU，papdu是接收缓冲区的只读视图，仅在调用期间有效
+    virtual void userprocAPDU(const iec_apdu * /* papdu */, int /* sz */){};
 
     // -------------------------------------------------------------------------
 
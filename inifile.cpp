@@ -0,0 +1,96 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "inifile.h"
+
+using namespace std;
+
+static string trim( const string & s )
+{
+    size_t b = s.find_first_not_of( " \t\r\n" );
+    if ( b == string::npos )
+      return "";
+    size_t e = s.find_last_not_of( " \t\r\n" );
+    return s.substr( b, e - b + 1 );
+}
+
+bool TIniFile::load( const char * filename )
+{
+    FILE * fp = fopen( filename, "r" );
+    if ( fp == NULL )
+      return false;
+
+    char line[1024];
+    string section;
+    while ( fgets( line, sizeof( line ), fp ) != NULL )
+      {
+      string l = trim( line );
+      if ( l.empty() || l[0] == ';' || l[0] == '#' )
+        continue;
+
+      if ( l[0] == '[' )
+        {
+        size_t e = l.find( ']' );
+        section = trim( l.substr( 1, ( e == string::npos ) ? string::npos : e - 1 ) );
+        mValues[section] = ""; // marks the section as present
+        continue;
+        }
+
+      size_t eq = l.find( '=' );
+      if ( eq == string::npos )
+        continue;
+      mValues[section + "/" + trim( l.substr( 0, eq ) )] = trim( l.substr( eq + 1 ) );
+      }
+
+    fclose( fp );
+    return true;
+}
+
+bool TIniFile::hasSection( const string & section ) const
+{
+    return mValues.find( section ) != mValues.end();
+}
+
+string TIniFile::value( const string & key, const string & def ) const
+{
+    map <string, string>::const_iterator it = mValues.find( key );
+    if ( it == mValues.end() )
+      return def;
+    return it->second;
+}
+
+int TIniFile::intValue( const string & key, int def ) const
+{
+    map <string, string>::const_iterator it = mValues.find( key );
+    if ( it == mValues.end() || it->second.empty() )
+      return def;
+    return atoi( it->second.c_str() );
+}
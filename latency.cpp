@@ -0,0 +1,113 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include "latency.h"
+
+double TLatencyClock::nsPerTick()
+{
+#ifdef LATENCY_TSC
+    // ticks of the TSC against the steady clock for 5 ms; thread safe initialization of the static
+    static const double ratio = []() {
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        unsigned long long c0 = __rdtsc();
+        std::chrono::steady_clock::time_point t1;
+        do
+          t1 = std::chrono::steady_clock::now();
+        while ( t1 - t0 < std::chrono::milliseconds( 5 ) );
+        unsigned long long c1 = __rdtsc();
+        return std::chrono::duration<double, std::nano>( t1 - t0 ).count() / (double)( c1 - c0 );
+        }();
+    return ratio;
+#else
+    return 1.0;
+#endif
+}
+
+long long TLatencyClock::realtimeNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+TLatencyHist::TLatencyHist() : mTotal( 0 ), mSum( 0 ), mMax( 0 )
+{
+    for ( int i = 0; i < Buckets; i++ )
+      mCount[i].store( 0, std::memory_order_relaxed );
+}
+
+unsigned long long TLatencyHist::upperEdge( unsigned i )
+{
+    if ( i < ( 1u << SubBits ) )
+      return i;
+    unsigned e = ( i >> SubBits ) + SubBits - 1;
+    unsigned long long m = ( 1u << SubBits ) | ( i & ( ( 1u << SubBits ) - 1 ) );
+    return ( ( m + 1 ) << ( e - SubBits ) ) - 1;
+}
+
+unsigned long long TLatencyHist::percentile( double p ) const
+{
+    unsigned long long total = count();
+    if ( total == 0 )
+      return 0;
+    unsigned long long rank = (unsigned long long)( p / 100.0 * total + 0.5 );
+    if ( rank < 1 )
+      rank = 1;
+    unsigned long long seen = 0;
+    for ( int i = 0; i < Buckets; i++ )
+      {
+      seen += mCount[i].load( std::memory_order_relaxed );
+      if ( seen >= rank )
+        {
+        unsigned long long v = upperEdge( i );
+        unsigned long long m = max();
+        return v < m ? v : m;
+        }
+      }
+    return max();
+}
+
+const char * TLatencyStats::stageName( int s )
+{
+    static const char * names[STAGES] = { "kernel", "extract", "decode", "deliver" };
+    return s >= 0 && s < STAGES ? names[s] : "";
+}
+
+std::string TLatencyStats::report() const
+{
+    std::string r;
+    char line[160];
+    for ( int s = 0; s < STAGES; s++ )
+      {
+      const TLatencyHist & h = stage[s];
+      snprintf( line, sizeof(line), "%-8s count %llu  us p50 %.3f  p99 %.3f  p999 %.3f  max %.3f\n", stageName( s ),
+                h.count(), h.percentile( 50 ) / 1e3, h.percentile( 99 ) / 1e3, h.percentile( 99.9 ) / 1e3, h.max() / 1e3 );
+      r += line;
+      }
+    return r;
+}
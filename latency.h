@@ -0,0 +1,128 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+// Latency histograms of the receive path of a session, HDR style: 32 buckets per power of two (about 3% wide),
+// from 1 ns to 2^36 ns (68 s, longer times count in the last bucket). Recording is a count of leading zeros, a
+// shift and an increment. One thread records, any thread may read at the same time (report() on demand).
+// Intervals are measured with TLatencyClock: the TSC on x86 (a few ns per read), the steady clock elsewhere.
+
+#include <atomic>
+#include <string>
+#include <chrono>
+#if defined(_MSC_VER) && ( defined(_M_X64) || defined(_M_IX86) )
+#include <intrin.h>
+#define LATENCY_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LATENCY_TSC
+#endif
+
+class TLatencyClock
+{
+public:
+    static inline unsigned long long ticks()
+        {
+#ifdef LATENCY_TSC
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+        }
+    static double nsPerTick(); // calibrated on the first call (a few ms)
+    static long long realtimeNs(); // system clock, ns since the epoch (the clock of kernel time stamps)
+};
+
+class TLatencyHist
+{
+public:
+    TLatencyHist();
+
+    inline void record( unsigned long long ns ) // writer thread only
+        {
+        unsigned i = index( ns );
+        mCount[i].store( mCount[i].load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+        mTotal.store( mTotal.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+        mSum.store( mSum.load( std::memory_order_relaxed ) + ns, std::memory_order_relaxed );
+        if ( ns > mMax.load( std::memory_order_relaxed ) )
+          mMax.store( ns, std::memory_order_relaxed );
+        }
+
+    unsigned long long count() const { return mTotal.load( std::memory_order_relaxed ); }
+    unsigned long long max() const { return mMax.load( std::memory_order_relaxed ); }
+    unsigned long long sum() const { return mSum.load( std::memory_order_relaxed ); } // ns, exact (not by bucket)
+    unsigned long long percentile( double p ) const; // ns (upper edge of the bucket), p in 0..100
+
+    static const int SubBits = 5;
+    static const int MaxBits = 36;
+    static const int Buckets = ( MaxBits - SubBits + 1 ) << SubBits;
+
+private:
+    static inline unsigned index( unsigned long long v )
+        {
+        if ( v < ( 1u << SubBits ) )
+          return (unsigned)v;
+        if ( v >> MaxBits )
+          return Buckets - 1;
+#if defined(_MSC_VER)
+        unsigned long e;
+        _BitScanReverse64( &e, v );
+#else
+        unsigned e = 63 - __builtin_clzll( v );
+#endif
+        return ( ( e - SubBits + 1 ) << SubBits ) | ( ( v >> ( e - SubBits ) ) & ( ( 1u << SubBits ) - 1 ) );
+        }
+    static unsigned long long upperEdge( unsigned i );
+
+    std::atomic<unsigned> mCount[Buckets];
+    std::atomic<unsigned long long> mTotal;
+    std::atomic<unsigned long long> mSum;
+    std::atomic<unsigned long long> mMax;
+};
+
+// the stages of a received frame, see iec104_class::setLatencyStats
+class TLatencyStats
+{
+public:
+    enum {
+        KERNEL,  // kernel receive time stamp -> data read by readTCP (needs time stamps from the derived class)
+        EXTRACT, // read -> frame extracted from the receive buffer (the frames before it in the same read included)
+        DECODE,  // frame extracted -> objects decoded
+        DELIVER, // objects decoded -> point table, batch and dataIndication done (read with the next frame's clock)
+        STAGES
+    };
+    TLatencyHist stage[STAGES];
+
+    static const char * stageName( int s );
+    std::string report() const; // a line per stage: count, p50, p99, p999 and max in us
+};
+
+#endif // LATENCY_H
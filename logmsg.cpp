@@ -27,21 +27,31 @@
  * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
  */
 
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include "logmsg.h"
 
 using namespace std;
 
-TLogMsg::TLogMsg()
+TLogMsg::TLogMsg() : mRing( 1024 )
 {
-    mMaxMsg = 1000;
     mDoLog = true;
     mRegTime = false;
     mLevel = 0;
+    mOverflow = OVERFLOW_DROP_REPORT;
+    mDropped = 0;
+    mDroppedToReport = 0;
 }
 
 void TLogMsg::setMaxMsg(unsigned int maxmsg)
 {
-    mMaxMsg = maxmsg;
+    mRing.resize( maxmsg );
+}
+
+void TLogMsg::setOverflowPolicy( TOverflow policy )
+{
+    mOverflow = policy;
 }
 
 void TLogMsg::setLevel(unsigned int level)
@@ -54,17 +64,17 @@ void TLogMsg::activateLog()
     mDoLog = true;
 }
 
+// consumer side
 void TLogMsg::deactivateLog()
 {
-    mLstLog.clear(); // clean lists
-    mLstTime.clear();
     mDoLog = false;
+    mRing.clear(); // clean queue
 }
 
+// consumer side
 void TLogMsg::doLogTime()
 {
-    mLstLog.clear(); // clean lists, sync
-    mLstTime.clear();
+    mRing.clear(); // clean queue, sync
     mRegTime = true;
 }
 
@@ -75,7 +85,7 @@ void TLogMsg::dontLogTime()
 
 bool TLogMsg::haveMsg()
 {
-    return !mLstLog.empty();
+    return !mRing.empty();
 }
 
 bool TLogMsg::isLogging()
@@ -83,50 +93,181 @@ bool TLogMsg::isLogging()
     return mDoLog;
 }
 
+unsigned long long TLogMsg::dropped()
+{
+    return mDropped;
+}
+
+long long TLogMsg::now()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_REALTIME, &ts );
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// pega um slot livre da fila (lado produtor), NULL se estiver cheia
+TLogMsg::TLogEntry * TLogMsg::prepareEntry()
+{
+    TLogEntry * ent;
+
+    if ( mDroppedToReport > 0 )
+    {
+        // avisa das mensagens perdidas antes, precisa de lugar para o aviso e para a nova mensagem
+        if ( mRing.capacity() - mRing.size() < 2 )
+        {
+            mDropped++;
+            mDroppedToReport++;
+            return NULL;
+        }
+        ent = mRing.prepare();
+        ent->time = mRegTime ? now() : 0;
+        ent->fmt = "*** LOG FULL, %u MESSAGES LOST";
+        ent->arg[0] = (unsigned int)mDroppedToReport;
+        ent->nbytes = 0;
+        mRing.commit();
+        mDroppedToReport = 0;
+    }
+
+    ent = mRing.prepare();
+    if ( ent == NULL )
+    {
+        mDropped++;
+        if ( mOverflow == OVERFLOW_DROP_REPORT )
+            mDroppedToReport++;
+        return NULL;
+    }
+
+    ent->time = mRegTime ? now() : 0;
+    return ent;
+}
+
 // coloca a mensagem na fila
 void TLogMsg::pushMsg( const char * msg, unsigned int level )
 {
-    if ( mDoLog && ( mLstLog.size() < mMaxMsg ) && ( mLevel <= level ) ) {
-        mLstLog.push_back( msg );
-        if ( mRegTime ) { // coloca hora na fila, se for o caso
-            mLstTime.push_back( time( NULL ) );
+    if ( !isLogging( level ) )
+        return;
+
+    TLogEntry * ent = prepareEntry();
+    if ( ent == NULL )
+        return;
+    ent->fmt = NULL;
+    ent->nbytes = 0;
+    strncpy( ent->text, msg, maxTextLen );
+    ent->text[maxTextLen] = 0;
+    mRing.commit();
+}
+
+// coloca o evento na fila, sem formatar
+void TLogMsg::addEvent( const char * fmt, TLogArg a0, TLogArg a1, TLogArg a2, TLogArg a3, TLogArg a4, TLogArg a5,
+                        const void * data, int sz )
+{
+    TLogEntry * ent = prepareEntry();
+    if ( ent == NULL )
+        return;
+    ent->fmt = fmt;
+    ent->arg[0] = a0;
+    ent->arg[1] = a1;
+    ent->arg[2] = a2;
+    ent->arg[3] = a3;
+    ent->arg[4] = a4;
+    ent->arg[5] = a5;
+    if ( sz > maxEventBytes )
+        sz = maxEventBytes;
+    if ( sz < 0 )
+        sz = 0;
+    ent->nbytes = sz;
+    if ( sz > 0 )
+        memcpy( ent->bytes, data, sz );
+    mRing.commit();
+}
+
+// formata o evento: cada conversao do formato e' feita com o argumento correspondente
+void TLogMsg::render( const TLogEntry & ent, string & s )
+{
+    char buf[256];
+    char spec[32];
+    const char * p = ent.fmt;
+    int narg = 0;
+
+    while ( *p )
+    {
+        const char * pc = strchr( p, '%' );
+        if ( pc == NULL )
+        {
+            s += p;
+            break;
+        }
+        s.append( p, pc - p );
+        if ( pc[1] == '%' )
+        {
+            s += '%';
+            p = pc + 2;
+            continue;
         }
+
+        // flags, width and precision, up to the conversion character
+        const char * pe = pc + 1;
+        while ( *pe && strchr( "diouxXcs", *pe ) == NULL )
+            pe++;
+        if ( *pe == 0 || pe - pc + 1 >= (int)sizeof(spec) || narg >= maxEventArgs )
+            break;
+        memcpy( spec, pc, pe - pc + 1 );
+        spec[pe - pc + 1] = 0;
+
+        if ( *pe == 's' )
+            snprintf( buf, sizeof(buf), spec, ent.arg[narg].s ? ent.arg[narg].s : "" );
+        else
+            snprintf( buf, sizeof(buf), spec, ent.arg[narg].u );
+        s += buf;
+        narg++;
+        p = pe + 1;
+    }
+
+    for ( int i = 0; i < ent.nbytes; i++ )
+    {
+        snprintf( buf, sizeof(buf), "%02x ", ent.bytes[i] );
+        s += buf;
     }
 }
 
 int TLogMsg::count()
 {
-    return mLstLog.size();
+    return mRing.size();
 }
 
-// Tira mensagem da fila
+// Tira mensagem da fila (lado consumidor)
 string TLogMsg::pullMsg()
 {
-    if ( mLstLog.empty() || !mDoLog )
+    const TLogEntry * ent = mRing.front();   // pega a primeira da fila
+    if ( ent == NULL )
+        return "";
+    if ( !mDoLog )
+    { // pushed after deactivateLog() cleared the ring: discard it, so that haveMsg() loops end
+        mRing.pop();
         return "";
+    }
 
-    string s = mLstLog.front();   // pega a primeira da fila
-    mLstLog.pop_front();          // retira-a da fila
-
-    // se tem registro de hora, pega a hora e formata para exibir antes da mensagem
-    if (mRegTime){
-        char buffer [201];
-        static time_t hora_ant;
-        time_t hora = mLstTime.front();
-        mLstTime.pop_front();
-        if (hora != hora_ant)
-          {
-          struct tm * timeinfo;
-          timeinfo = localtime ( &hora );
-          // strftime ( buffer,200,"%d/%m %H:%M:%S ",timeinfo );
-          strftime ( buffer,200,"%H:%M:%S ",timeinfo );
-          s = buffer + s;
-          }
-        else
-          s = "         " + s;
-        hora_ant = hora;
+    string s;
+
+    // se tem registro de hora, formata para exibir antes da mensagem
+    if ( mRegTime && ent->time != 0 )
+    {
+        char buffer[32];
+        time_t hora = ent->time / 1000000;
+        struct tm timeinfo;
+        localtime_r( &hora, &timeinfo );
+        strftime( buffer, sizeof(buffer), "%H:%M:%S", &timeinfo );
+        s = buffer;
+        snprintf( buffer, sizeof(buffer), ".%03d ", (int)( ent->time / 1000 % 1000 ) );
+        s += buffer;
     }
 
+    if ( ent->fmt == NULL )
+        s += ent->text;
+    else
+        render( *ent, s );
+
+    mRing.pop();          // retira-a da fila
+
     return s;
 }
-
@@ -31,34 +31,92 @@
 #define LOGMSG_H
 
 // Buffered  message
+// Messages are kept in a lock-free ring of preallocated slots: one thread (the protocol) may push
+// while another one (the user interface) pulls, no allocation is made when pushing.
 
-#include <time.h>
-#include <list>
+#include <atomic>
 #include <string>
+#include "spscring.h"
+
+// argument of a log event: a number or a pointer to a string that lives forever (a literal)
+struct TLogArg {
+    TLogArg() { u = 0; }
+    TLogArg( unsigned int v ) { u = v; }
+    TLogArg( int v ) { u = v; }
+    TLogArg( const char * v ) { s = v; }
+    union {
+        unsigned int u;
+        const char * s;
+    };
+};
 
 class TLogMsg
 {
 public:
+    static const int maxEventArgs = 6;
+    static const int maxEventBytes = 25;
+    static const int maxTextLen = 200; // longer text messages are truncated
+
+    // what to do with a message when the ring is full
+    enum TOverflow {
+        OVERFLOW_DROP,       // discard it
+        OVERFLOW_DROP_REPORT // discard it and, when there is room again, push a message telling how many were lost
+    };
+
     TLogMsg();
     void pushMsg(const char * msg, unsigned int level=0); // level: 0=less important
+    // Log events are recorded as a format and raw arguments, the text is rendered only when pulled.
+    // fmt is printf style (%s takes a TLogArg string, other conversions an unsigned) and is kept by pointer, so it must be a literal.
+    inline void pushEvent( unsigned int level, const char * fmt,
+                           TLogArg a0 = TLogArg(), TLogArg a1 = TLogArg(), TLogArg a2 = TLogArg(),
+                           TLogArg a3 = TLogArg(), TLogArg a4 = TLogArg(), TLogArg a5 = TLogArg() )
+    {
+        if ( isLogging( level ) )
+            addEvent( fmt, a0, a1, a2, a3, a4, a5, NULL, 0 );
+    }
+    // event followed by an hexadecimal dump of up to maxEventBytes bytes of data
+    inline void pushDump( unsigned int level, const char * fmt, TLogArg a0, const void * data, int sz )
+    {
+        if ( isLogging( level ) )
+            addEvent( fmt, a0, TLogArg(), TLogArg(), TLogArg(), TLogArg(), TLogArg(), data, sz );
+    }
     std::string pullMsg();
     void activateLog();
     void deactivateLog();
     void doLogTime();
     void dontLogTime();
-    void setMaxMsg(unsigned int maxmsg);
+    void setMaxMsg(unsigned int maxmsg); // capacity of the ring (rounded up to a power of two), call before use
+    void setOverflowPolicy( TOverflow policy );
     bool haveMsg();
     void setLevel(unsigned int nivel); // set exibition level
     bool isLogging();
+    inline bool isLogging( unsigned int level ) // would a message of this level be kept?
+        { return mDoLog.load( std::memory_order_relaxed ) && ( mLevel.load( std::memory_order_relaxed ) <= level ); }
     int count();
+    unsigned long long dropped(); // number of messages lost because the ring was full
 
 private:
-    std::list <std::string> mLstLog;
-    std::list <time_t> mLstTime;
-    unsigned int mMaxMsg;
-    bool mDoLog;
-    bool mRegTime;
-    unsigned int mLevel; // exibition level 0=all, 1 an on, exibit more information progressively
+    struct TLogEntry {
+        long long time; // microseconds since the epoch
+        const char * fmt; // NULL: plain text message
+        TLogArg arg[maxEventArgs];
+        unsigned char nbytes;
+        unsigned char bytes[maxEventBytes];
+        char text[maxTextLen + 1];
+    };
+    TLogEntry * prepareEntry();
+    void addEvent( const char * fmt, TLogArg a0, TLogArg a1, TLogArg a2, TLogArg a3, TLogArg a4, TLogArg a5,
+                   const void * data, int sz );
+    static void render( const TLogEntry & ent, std::string & s );
+    static long long now();
+
+    TSpscRing <TLogEntry> mRing;
+    std::atomic<bool> mDoLog;
+    std::atomic<bool> mRegTime;
+    std::atomic<unsigned int> mLevel; // exibition level 0=all, 1 an on, exibit more information progressively
+    TOverflow mOverflow;
+    std::atomic<unsigned long long> mDropped; // total lost messages
+    unsigned long long mDroppedToReport; // lost messages not yet reported, producer side only
 };
 
 #endif // LOGMSG_H
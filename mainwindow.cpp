@@ -29,6 +29,7 @@
 
 #include <QDir>
 #include <QCloseEvent>
+#include <QHeaderView>
 #include <string>
 #include <time.h>
 #include "mainwindow.h"
@@ -41,6 +42,8 @@ MainWindow::MainWindow(QWidget *parent)
 {
     BDTR_Logar = 1;
     i104.mLog.deactivateLog();
+    mLog.deactivateLog();
+    mLog.doLogTime();
 
     // busca configuracoes no arquivo ini
     QSettings settings( "./qtester104.ini", QSettings::IniFormat );
@@ -53,11 +56,21 @@ MainWindow::MainWindow(QWidget *parent)
     IPEscravo = settings.value( "RTU1/IP_ADDRESS", "" ).toString();
     i104.setSecondaryIP ( (char *)IPEscravo.toStdString().c_str() );
     i104.setPortTCP( settings.value( "RTU1/TCP_PORT", i104.getPortTCP() ).toInt() );
+    i104.setK( settings.value( "RTU1/K", i104.getK() ).toInt() );
+    i104.setW( settings.value( "RTU1/W", i104.getW() ).toInt() );
+    i104.setT0( settings.value( "RTU1/T0", i104.getT0() ).toUInt() );
+    i104.setT1( settings.value( "RTU1/T1", i104.getT1() ).toUInt() );
+    i104.setT2( settings.value( "RTU1/T2", i104.getT2() ).toUInt() );
+    i104.setT3( settings.value( "RTU1/T3", i104.getT3() ).toUInt() );
 
     // this is for using with the OSHMI HMI in a dual architecture
     QSettings settings_bdtr( "./ihm.ini", QSettings::IniFormat );
     BDTR_host_dual = settings_bdtr.value( "REDUNDANCIA/IP_OUTRO_IHM", "" ).toString();
     BDTR_host = "127.0.0.1";
+    mBdtrFwd.setOrigin( BDTR_orig );
+    mBdtrFwd.addDestination( BDTR_host.toString().toStdString().c_str(), BDTR_porta );
+    if ( BDTR_HaveDualHost() )
+      mBdtrFwd.addDestination( BDTR_host_dual.toString().toStdString().c_str(), BDTR_porta );
     BDTR_CntDnToBePrimary = BDTR_CntToBePrimary;
 
     ui->setupUi( this );
@@ -78,6 +91,7 @@ MainWindow::MainWindow(QWidget *parent)
     udps = new QUdpSocket();
     udps->bind( BDTR_porta_escuta );
     udps->open( QIODevice::ReadWrite );
+    mBdtrFwd.useSocket( (TBdtrForwarder::TSocket)udps->socketDescriptor() ); // points leave from BDTR_porta_escuta, like the other BDTR messages
 
     QString qs;
     ui->leIPRemoto->setText( IPEscravo );
@@ -90,35 +104,40 @@ MainWindow::MainWindow(QWidget *parent)
     ui->leIPRemoto->setText( IPEscravo );
 
     tmLogMsg = new QTimer();
+    tmPoints = new QTimer();
     tmBDTR_kamsg = new QTimer();
+    tmBDTR_flush = new QTimer();
+    tmBDTR_flush->setSingleShot( true );
+    tmBDTR_flush->setInterval( 0 );
 
     connect( udps, SIGNAL(readyRead()), this, SLOT(slot_BDTR_pronto_para_ler()) );
     connect( tmLogMsg, SIGNAL(timeout()), this, SLOT(slot_timer_logmsg()) );
+    connect( tmPoints, SIGNAL(timeout()), this, SLOT(slot_timer_points()) );
     connect( tmBDTR_kamsg, SIGNAL(timeout()), this, SLOT(slot_timer_BDTR_kamsg()) );
-    connect( &i104, SIGNAL(signal_dataIndication(iec_obj *, int)), this, SLOT(slot_dataIndication(iec_obj *, int)) );
+    connect( tmBDTR_flush, SIGNAL(timeout()), this, SLOT(slot_BDTR_flush()) );
+    connect( &i104, SIGNAL(signal_dataReady()), this, SLOT(slot_dataReady()) );
     connect( &i104, SIGNAL(signal_interrogationActConfIndication()), this, SLOT(slot_interrogationActConfIndication()) );
     connect( &i104, SIGNAL(signal_interrogationActTermIndication()), this, SLOT(slot_interrogationActTermIndication()) );
     connect( &i104, SIGNAL(signal_tcp_connect()), this, SLOT(slot_tcpconnect()) );
     connect( &i104, SIGNAL(signal_tcp_disconnect()), this, SLOT(slot_tcpdisconnect()) );
-    connect( &i104, SIGNAL(signal_commandActConfIndication(iec_obj *)), this, SLOT(slot_commandActConfIndication(iec_obj *)) );
-    connect( &i104, SIGNAL(signal_commandActTermIndication(iec_obj *)), this, SLOT(slot_commandActTermIndication(iec_obj *)) );
+    connect( &i104, SIGNAL(signal_commandActConfIndication(iec_obj)), this, SLOT(slot_commandActConfIndication(iec_obj)) );
+    connect( &i104, SIGNAL(signal_commandActTermIndication(iec_obj)), this, SLOT(slot_commandActTermIndication(iec_obj)) );
 
     ui->pbGI->setEnabled(false);
     ui->pbSendCommandsButton->setEnabled( false );
 
-    ui->twPontos->clear();
+    // the model keeps the rows sorted by address, the view paints only the visible ones with a fixed row height
+    mPointModel = new TPointModel( this );
+    ui->twPontos->setModel( mPointModel );
     ui->twPontos->setSortingEnabled ( false );
-    ui->twPontos->setColumnCount( 6 );
-    ui->twPontos->sortByColumn( 0 );
+    ui->twPontos->verticalHeader()->setSectionResizeMode( QHeaderView::Fixed );
+    ui->twPontos->verticalHeader()->setDefaultSectionSize( ui->twPontos->fontMetrics().height() + 4 );
 
     if ( IPEscravo != "" )
       on_pbConnect_clicked();
 
-    QStringList colunas;
-    colunas << "Address" << "Value" << "Type" << "Cause" << "Flags" << "Count";
-    ui->twPontos->setHorizontalHeaderLabels( colunas );
-
     tmLogMsg->start(1000);
+    tmPoints->start( PointsRefreshMs );
 
     if ( BDTR_HaveDualHost() )
     {
@@ -139,21 +158,21 @@ MainWindow::~MainWindow()
 {
     delete ui;
     delete tmLogMsg;
+    delete tmPoints;
     delete tmBDTR_kamsg;
+    delete tmBDTR_flush;
 }
 
 void MainWindow::on_pbGI_clicked()
 {
-    i104.solicitGI();
+    i104.postGI();
 }
 
 void MainWindow::on_pbConnect_clicked()
 {
-    if ( i104.tmKeepAlive->isActive() )
+    if ( i104.isStarted() )
     {
-        i104.tmKeepAlive->stop();
-        i104.tcps->close();
-        i104.slot_tcpdisconnect();
+        i104.stop();
     }
     else
     {
@@ -176,17 +195,10 @@ void MainWindow::on_pbConnect_clicked()
         ui->pbConnect->setText( "Give up..." );
         ui->lbStatus->setText( "<font color='green'>TRYING TO CONNECT!</font>" );
 
-        mapPtItem_ColAddress.clear();
-        mapPtItem_ColValue.clear();
-        mapPtItem_ColType.clear();
-        mapPtItem_ColCause.clear();
-        mapPtItem_ColFlags.clear();
-        mapPtItem_ColCount.clear();
-        ui->twPontos->clearContents();
-        ui->twPontos->setRowCount ( 0 );
+        mPointModel->clear();
         ui->lwLog->clear();
 
-        i104.tmKeepAlive->start(1000);
+        i104.start();
     }
 }
 
@@ -204,10 +216,13 @@ void MainWindow::slot_BDTR_pronto_para_ler()
     quint16 port;
     bytesrec = udps->readDatagram ( (char *)br, sizeof(br), &address, &port );
 
-    sprintf( buf+strlen(buf), "%3d: ", bytesrec );
-    for ( int i=0; i< bytesrec; i++ )
-        sprintf (buf+strlen(buf), "%02x ", br[i]);
-    BDTR_Loga( buf );
+    if ( BDTR_Logar && mLog.isLogging( 0 ) ) // don't format if it will not be logged
+    {
+        sprintf( buf+strlen(buf), "%3d: ", bytesrec );
+        for ( int i=0; i< bytesrec; i++ )
+            sprintf (buf+strlen(buf), "%02x ", br[i]);
+        BDTR_Loga( buf );
+    }
 
     int Tipo = br[0] & T_MASC;
 
@@ -221,7 +236,7 @@ void MainWindow::slot_BDTR_pronto_para_ler()
             if ( msg->TIPO == REQ_GRUPO && msg->ID == 0 ) // GI
             {
                 BDTR_Loga( "--> BDTR: REQ GI" );
-                i104.solicitGI();
+                i104.postGI();
             }
             if ( msg->TIPO == REQ_GRUPO && msg->ID == 255 ) // request group 255: show form
             {
@@ -309,7 +324,7 @@ void MainWindow::slot_BDTR_pronto_para_ler()
                  if (enviar)
                     {
                     // forward command to IEC104
-                    i104.sendCommand( &obj );
+                    i104.postCommand( obj );
                     LastCommandAddress = obj.address;
                     // Vai enviar ack pelo BDTR ao receber o activation em nvel de 104
                     }
@@ -339,191 +354,16 @@ void MainWindow::slot_BDTR_pronto_para_ler()
     }
 }
 
+// points are packed by the forwarder with the points of the asdus that came before, see slot_dataReady
 void MainWindow::BDTR_processPoints( iec_obj *obj, int numpoints )
 {
+    if ( !mBdtrFwd.forward( obj, numpoints ) )
+         mLog.pushMsg( "--> IEC104 UNSUPPORTED TYPE, NOT FORWARDED TO BDTR" );
+}
 
-    TFA_Qual qfa;
-    int tam_msg;
-
-    // Ateno, vou deixar o bit T_CONV do cdigo da mensagem para sinalizar varredor sem banco
-
-    switch ( obj->type )
-      {
-      case iec104_class::M_DP_TB_1: // duplo com tag
-      case iec104_class::M_SP_TB_1: // simples com tag
-        {
-        msg_dig_tag *msgdigtag;
-
-        tam_msg = sizeof( A_dig_tag ) * numpoints + sizeof( msg_dig_tag ) - sizeof( A_dig_tag );
-        msgdigtag = (msg_dig_tag*)malloc( tam_msg );
-        msgdigtag->COD = T_DIG_TAG;
-        if ( obj->cause == iec104_class::CYCLIC )
-          msgdigtag->COD |= T_CIC;
-        if ( obj->cause == iec104_class::SPONTANEOUS )
-          msgdigtag->COD |= T_SPONT;
-        msgdigtag->NRPT = numpoints;
-        msgdigtag->ORIG = BDTR_orig;
-
-        for ( int cntpnt=0; cntpnt < numpoints; cntpnt++, obj++ )
-          {
-          // converte o qualificador do IEC para formato A do PABD
-          qfa.Byte = 0;
-          qfa.Subst = obj->bl || obj->sb;
-          qfa.Tipo = TFA_TIPODIG;
-          qfa.Falha = obj->iv || obj->nt;
-          qfa.FalhaTag = obj->timetag.iv;
-
-          if ( obj->type == iec104_class::M_DP_TB_1 || obj->type == iec104_class::M_DP_NA_1 )
-            {
-            qfa.Duplo = obj->dp;
-            }
-          else
-            { // simples para duplo
-            qfa.Estado = !obj->sp;
-            qfa.EstadoH = obj->sp;
-            }
-
-          msgdigtag->PONTO[cntpnt].ID = obj->address;
-          msgdigtag->PONTO[cntpnt].UTR = obj->ca;
-          msgdigtag->PONTO[cntpnt].STAT = qfa.Byte;
-          msgdigtag->PONTO[cntpnt].TAG.ANO = 2000+obj->timetag.year;
-          msgdigtag->PONTO[cntpnt].TAG.MES = obj->timetag.month;
-          msgdigtag->PONTO[cntpnt].TAG.DIA = obj->timetag.mday;
-          msgdigtag->PONTO[cntpnt].TAG.HORA = obj->timetag.hour;
-          msgdigtag->PONTO[cntpnt].TAG.MINUTO = obj->timetag.min;
-          msgdigtag->PONTO[cntpnt].TAG.MSEGS = obj->timetag.msec;
-          }
-
-        udps->writeDatagram ( (const char *) msgdigtag, tam_msg, BDTR_host, BDTR_porta );
-        if ( BDTR_HaveDualHost() )
-          udps->writeDatagram ( (const char *) msgdigtag, tam_msg, BDTR_host_dual, BDTR_porta );
-
-        free( msgdigtag );
-        }
-        break;
-
-      case iec104_class::M_DP_NA_1: // duplo sem tag
-      case iec104_class::M_SP_NA_1: // simples sem tag
-        {
-        msg_dig *msgdig;
-        tam_msg = sizeof(A_dig) * numpoints + sizeof( msg_dig ) - sizeof( A_dig );
-        msgdig = (msg_dig*)malloc( tam_msg );
-        msgdig->COD = T_DIG;
-        if ( obj->cause == iec104_class::CYCLIC )
-          msgdig->COD |= T_CIC;
-        if ( obj->cause == iec104_class::SPONTANEOUS )
-          msgdig->COD |= T_SPONT;
-        msgdig->NRPT = numpoints;
-        msgdig->ORIG = BDTR_orig;
-
-        for (int cntpnt=0; cntpnt < numpoints; cntpnt++, obj++)
-          {
-          // converte o qualificador do IEC para formato A do PABD
-          qfa.Byte = 0;
-          qfa.Subst = obj->bl || obj->sb;
-          qfa.Tipo = TFA_TIPODIG;
-          qfa.Falha = obj->iv || obj->nt;
-          if ( obj->type == iec104_class::M_DP_TB_1 || obj->type == iec104_class::M_DP_NA_1 )
-            {
-            qfa.Duplo = obj->dp;
-            }
-          else
-            { // simples para duplo
-            qfa.Estado = !obj->sp;
-            qfa.EstadoH = obj->sp;
-            }
-
-          msgdig->PONTO[cntpnt].ID = obj->address;
-          msgdig->PONTO[cntpnt].STAT = qfa.Byte;
-          }
-
-        udps->writeDatagram ( (const char *) msgdig, tam_msg, BDTR_host, BDTR_porta );
-        if ( BDTR_HaveDualHost() )
-            udps->writeDatagram ( (const char *) msgdig, tam_msg, BDTR_host_dual, BDTR_porta );
-        free(msgdig);
-        }
-        break;
-
-      case iec104_class::M_ST_NA_1: // tap
-      case iec104_class::M_ME_NA_1: // 9
-      case iec104_class::M_ME_NB_1: // 11
-        {
-        msg_ana *msgana;
-
-        tam_msg = sizeof( A_ana ) * numpoints + sizeof( msg_ana ) - sizeof( A_ana );
-        msgana = (msg_ana*) malloc( tam_msg );
-        if ( obj->type == iec104_class::M_ME_NA_1 )
-          msgana->COD = T_NORM;
-        else
-          msgana->COD = T_ANA;
-        if ( obj->cause == iec104_class::CYCLIC )
-          msgana->COD |= T_CIC;
-        if ( obj->cause == iec104_class::SPONTANEOUS )
-          msgana->COD |= T_SPONT;
-        msgana->NRPT = numpoints;
-        msgana->ORIG = BDTR_orig;
-
-        for ( int cntpnt=0; cntpnt < numpoints; cntpnt++, obj++ )
-          {
-          // converte o qualificador do IEC para formato A do PABD
-          qfa.Byte = 0;
-          qfa.Subst = obj->bl || obj->sb;
-          qfa.Tipo = TFA_TIPOANA;
-          qfa.Falha = obj->iv || obj->nt || obj->ov;
-          if (obj->type == iec104_class::M_ST_NA_1) // tap
-             qfa.Falha =  qfa.Falha || obj->t; // transient = falha
-
-          msgana->PONTO[cntpnt].ID = obj->address;
-          msgana->PONTO[cntpnt].STAT = qfa.Byte;
-          msgana->PONTO[cntpnt].VALOR = obj->value;
-          }
-
-        udps->writeDatagram ( (const char *) msgana, tam_msg, BDTR_host, BDTR_porta );
-        if ( BDTR_HaveDualHost() )
-           udps->writeDatagram ( (const char *) msgana, tam_msg, BDTR_host_dual, BDTR_porta );
-        free(msgana);
-        }
-        break;
-
-      case iec104_class::M_ME_NC_1: // 13
-        {
-        msg_float *msgflt;
-
-        tam_msg = sizeof(A_float) * numpoints + sizeof(msg_float) - sizeof(A_float);
-        msgflt = (msg_float*)malloc( tam_msg );
-        msgflt->COD = T_FLT;
-        if ( obj->cause == iec104_class::CYCLIC )
-          msgflt->COD |= T_CIC;
-        if ( obj->cause == iec104_class::SPONTANEOUS )
-          msgflt->COD |= T_SPONT;
-
-        msgflt->NRPT = numpoints;
-        msgflt->ORIG = BDTR_orig;
-
-        for ( int cntpnt=0; cntpnt < numpoints; cntpnt++, obj++ )
-          {
-          // qualifier converte o qualificador do IEC para formato A do PABD/BDTR
-          qfa.Byte = 0;
-          qfa.Subst = obj->bl || obj->sb;
-          qfa.Tipo = TFA_TIPOANA;
-          qfa.Falha = obj->iv || obj->nt || obj->ov;
-
-          msgflt->PONTO[cntpnt].ID = obj->address;
-          msgflt->PONTO[cntpnt].STAT = qfa.Byte;
-          msgflt->PONTO[cntpnt].VALOR = obj->value;
-          }
-
-        udps->writeDatagram ( (const char *) msgflt, tam_msg, BDTR_host, BDTR_porta );
-        if ( BDTR_HaveDualHost() )
-            udps->writeDatagram ( (const char *) msgflt, tam_msg, BDTR_host_dual, BDTR_porta );
-        free( msgflt );
-        }
-        break;
-
-      default:
-         i104.mLog.pushMsg( "--> IEC104 UNSUPPORTED TYPE, NOT FORWARDED TO BDTR" );
-         break;
-      }
+void MainWindow::slot_BDTR_flush()
+{
+    mBdtrFwd.flush();
 }
 
 // Envio de comando
@@ -557,7 +397,7 @@ void MainWindow::on_pbSendCommandsButton_clicked()
     obj.qu = ui->cbCmdDuration->currentText().left(1).toInt();
     obj.se = (int)ui->cbSBO->isChecked();
 
-    i104.sendCommand( &obj );
+    i104.postCommand( obj );
     LastCommandAddress = obj.address;
 }
 
@@ -565,101 +405,43 @@ void MainWindow::BDTR_Loga( QString str, int id )
 {
     if  (BDTR_Logar && id == 0 )
     {
-        i104.mLog.pushMsg( (char*) str.toStdString().c_str(), 0 );
+        mLog.pushMsg( (char*) str.toStdString().c_str(), 0 );
         if ( ui->cbAutoScroll->isChecked() )
           ui->lwLog->scrollToBottom();
     }
 }
 
-void MainWindow::slot_dataIndication( iec_obj *obj, int numpoints )
+// drains the point queue of the protocol thread, a group has objects of the same type and cause
+// every event goes to BDTR, the points table is refreshed by slot_timer_points
+void MainWindow::slot_dataReady()
 {
-    char buf[1000];
-    int rw = -1;
-    bool inserted = false;
-    QTableWidgetItem *pitem;
-    static const char* dblmsg[] = { "tra ","off ","on ","ind " };
+    iec_obj obj[127];
+    int numpoints;
 
-    BDTR_processPoints( obj, numpoints );
-
-    for (int i=0; i< numpoints; i++, obj++)
-    {
-        sprintf( buf, "%05u", obj->address );
+    while ( ( numpoints = i104.pullPoints( obj, 127 ) ) > 0 )
+        BDTR_processPoints( obj, numpoints );
 
-        pitem = NULL;
-        pitem = mapPtItem_ColAddress[obj->address];
-        if ( pitem == NULL )
-        {
-                // insere
-                rw = ui->twPontos->rowCount();
-                ui->twPontos->insertRow( rw );
-                QTableWidgetItem *newItem = new QTableWidgetItem( buf );
-                ui->twPontos->setItem( rw, 0, newItem );
-                newItem->setFlags( Qt::ItemIsSelectable );
-                mapPtItem_ColAddress[obj->address] = newItem;
-
-                newItem = new QTableWidgetItem( buf );
-                ui->twPontos->setItem( rw, 1, newItem );
-                newItem->setFlags( Qt::ItemIsSelectable );
-                mapPtItem_ColValue[obj->address] = newItem;
-
-                newItem = new QTableWidgetItem( buf );
-                ui->twPontos->setItem( rw, 2, newItem );
-                newItem->setFlags( Qt::ItemIsSelectable );
-                mapPtItem_ColType[obj->address] = newItem;
-
-                newItem = new QTableWidgetItem( buf );
-                ui->twPontos->setItem( rw, 3, newItem );
-                newItem->setFlags( Qt::ItemIsSelectable );
-                mapPtItem_ColCause[obj->address] = newItem;
-
-                newItem = new QTableWidgetItem( buf );
-                ui->twPontos->setItem( rw, 4, newItem );
-                newItem->setFlags( Qt::ItemIsSelectable );
-                mapPtItem_ColFlags[obj->address] = newItem;
-
-                newItem = new QTableWidgetItem( buf );
-                ui->twPontos->setItem( rw, 5, newItem );
-                newItem->setFlags( Qt::ItemIsSelectable );
-                newItem->setText( "0" );
-                mapPtItem_ColCount[obj->address] = newItem;
-
-                inserted = true;
-        }
-
-        sprintf( buf, "%f", obj->value );
-        mapPtItem_ColValue[obj->address]->setText( buf );
-        sprintf( buf, "%d", obj->type );
-        mapPtItem_ColType[obj->address]->setText( buf );
-        sprintf( buf, "%d", obj->cause );
-        mapPtItem_ColCause[obj->address]->setText( buf );
-        sprintf( buf, "%d", 1+mapPtItem_ColCount[obj->address]->text().toInt() );
-        mapPtItem_ColCount[obj->address]->setText( buf );
-
-        switch (obj->type)
-          {
-          case iec104_class::M_SP_TB_1: // 1
-          case iec104_class::M_SP_NA_1: // 30
-              sprintf( buf, "%s%s%s%s%s", obj->scs?"on ":"off ", obj->iv?"iv ":"", obj->bl?"bl ":"", obj->sb?"sb ":"", obj->nt?"nt ":"" );
-              break;
-          case iec104_class::M_DP_NA_1: // 3
-          case iec104_class::M_DP_TB_1: // 31
-              sprintf( buf, "%s%s%s%s%s", dblmsg[obj->dcs], obj->iv?"iv ":"", obj->bl?"bl ":"", obj->sb?"sb ":"", obj->nt?"nt ":"" );
-              break;
-          case iec104_class::M_ST_NA_1: // 5
-              sprintf( buf, "%s%s%s%s%s%s", obj->ov?"ov ":"", obj->iv?"iv ":"", obj->bl?"bl ":"", obj->sb?"sb ":"", obj->nt?"nt ":"", obj->t?"t ":"" );
-              break;
-          case iec104_class::M_ME_NA_1: // 9
-          case iec104_class::M_ME_NB_1: // 11
-          case iec104_class::M_ME_NC_1: // 13
-              sprintf( buf, "%s%s%s%s%s", obj->ov?"ov ":"", obj->iv?"iv ":"", obj->bl?"bl ":"", obj->sb?"sb ":"", obj->nt?"nt ":"" );
-              break;
-          }
-
-        mapPtItem_ColFlags[obj->address]->setText( buf );
-    }
+    // what is packed goes when the events already queued are processed (more points may come with them)
+    if ( mBdtrFwd.pending() && !tmBDTR_flush->isActive() )
+        tmBDTR_flush->start();
+}
 
-if ( inserted )
-    ui->twPontos->sortItems ( 0 );
+// refreshes the rows of the points updated since the last tick, the latest state of each point is read from the point table:
+// the work depends on how many points changed, not on how many messages came
+void MainWindow::slot_timer_points()
+{
+    unsigned changed[256];
+    unsigned n;
+    TPointData pt;
+
+    mChangedPoints.clear();
+    while ( ( n = i104.getPointTable()->pullChanged( changed, 256 ) ) > 0 )
+        for ( unsigned i = 0; i < n; i++ )
+            if ( i104.getPointTable()->readSlot( changed[i], pt ) )
+                mChangedPoints.push_back( pt );
+
+    if ( !mChangedPoints.empty() )
+        mPointModel->update( &mChangedPoints[0], (int)mChangedPoints.size() );
 }
 
 void MainWindow::slot_timer_logmsg()
@@ -673,17 +455,16 @@ void MainWindow::slot_timer_logmsg()
 
     // adjust size of rows and columns
     if ( ! ( ++count%15 ) )
-        if ( rowant < ui->twPontos->rowCount() )
+        if ( rowant < mPointModel->rowCount() )
         {
-        rowant = ui->twPontos->rowCount();
-        ui->twPontos->resizeRowsToContents();
-        ui->twPontos->resizeColumnsToContents();
+        rowant = mPointModel->rowCount();
+        ui->twPontos->resizeColumnsToContents(); // samples a bounded number of rows (resizeContentsPrecision)
         }
 
-    // if ( !i104.mLog.haveMsg() && i104.tmKeepAlive->isActive() )
+    // if ( !i104.mLog.haveMsg() && i104.isStarted() )
     //  i104.mLog.pushMsg( "." );
 
-    if ( i104.mLog.haveMsg() )
+    if ( i104.mLog.haveMsg() || mLog.haveMsg() )
     {
       if (ui->lwLog->count() > 5000)
       {
@@ -695,6 +476,10 @@ void MainWindow::slot_timer_logmsg()
       {
           ui->lwLog->addItem( i104.mLog.pullMsg().c_str() );
       }
+      while ( mLog.haveMsg() )
+      {
+          ui->lwLog->addItem( mLog.pullMsg().c_str() );
+      }
       if (ui->cbAutoScroll->isChecked())
         ui->lwLog->scrollToBottom();
     }
@@ -751,7 +536,7 @@ void MainWindow::slot_tcpdisconnect()
     ui->pbGI->setEnabled( false );
     ui->pbSendCommandsButton->setEnabled( false );
 
-    if ( i104.tmKeepAlive->isActive() )
+    if ( i104.isStarted() )
     {
         ui->pbConnect->setText( "Give up" );
         ui->leIPRemoto->setEnabled( false );
@@ -767,20 +552,21 @@ void MainWindow::slot_tcpdisconnect()
     }
 }
 
-void MainWindow::slot_commandActConfIndication( iec_obj *obj )
+void MainWindow::slot_commandActConfIndication( iec_obj cmd )
 {
+iec_obj *obj = &cmd;
 bool is_select = false;
 
     if ( LastCommandAddress == obj->address )
     {
-        i104.mLog.pushMsg("    COMMAND ACT CONF INDICATION");
+        mLog.pushMsg("    COMMAND ACT CONF INDICATION");
         is_select = ( obj->se == iec104_class::SELECT );
 
         // if confirmed select, execute
         if ( obj->se == iec104_class::SELECT && obj->pn == iec104_class::POSITIVE )
         {
             obj->se = iec104_class::EXECUTE;
-            i104.sendCommand( obj );
+            i104.postCommand( *obj );
         }
 
         // respond to BDTR only if it's not a select or if its a negative response
@@ -825,10 +611,10 @@ bool is_select = false;
     }
 };
 
-void MainWindow::slot_commandActTermIndication( iec_obj *obj )
+void MainWindow::slot_commandActTermIndication( iec_obj obj )
 {
-    if ( LastCommandAddress == obj->address )
-      i104.mLog.pushMsg("    COMMAND ACT TERM INDICATION");
+    if ( LastCommandAddress == obj.address )
+      mLog.pushMsg("    COMMAND ACT TERM INDICATION");
 };
 
 void MainWindow::closeEvent( QCloseEvent *event )
@@ -880,7 +666,13 @@ void MainWindow::slot_timer_BDTR_kamsg()
 void MainWindow::on_cbLog_clicked()
 {
     if ( ui->cbLog->isChecked() )
+        {
         i104.mLog.activateLog();
+        mLog.activateLog();
+        }
     else
+        {
         i104.mLog.deactivateLog();
+        mLog.deactivateLog();
+        }
 }
@@ -37,11 +37,13 @@
 #include <QPushButton>
 #include <QTimer>
 #include <QSettings>
-#include <QTableWidgetItem>
-#include <map>
+#include <vector>
 #include "bdtr.h"
 #include "iec104_class.h"
 #include "qiec104.h"
+#include "pointtable.h"
+#include "pointmodel.h"
+#include "bdtrfwd.h"
 
 namespace Ui
 {
@@ -67,25 +69,26 @@ private slots:
     void slot_timer_logmsg(); // timer for log messages
     void slot_timer_BDTR_kamsg(); // timer for sending keepalive BDTR messages
     void slot_BDTR_pronto_para_ler();  // BDTR: sinal para leitura de dados no tcp do BDTR
-    void slot_dataIndication( iec_obj *obj, int numpoints );
+    void slot_BDTR_flush(); // BDTR: sends the points packed so far
+    void slot_dataReady(); // points queued by the protocol thread
+    void slot_timer_points(); // timer to refresh the points changed since the last time
     void slot_interrogationActConfIndication();
     void slot_interrogationActTermIndication();
     void slot_tcpconnect();         // tcp connect for iec104
     void slot_tcpdisconnect();      // tcp disconnect for iec104
-    void slot_commandActConfIndication( iec_obj *obj );
-    void slot_commandActTermIndication( iec_obj *obj );
+    void slot_commandActConfIndication( iec_obj cmd );
+    void slot_commandActTermIndication( iec_obj obj );
 
 private:
-    std::map <int, QTableWidgetItem *> mapPtItem_ColAddress; // map of points to cells of table
-    std::map <int, QTableWidgetItem *> mapPtItem_ColValue;
-    std::map <int, QTableWidgetItem *> mapPtItem_ColType;
-    std::map <int, QTableWidgetItem *> mapPtItem_ColCause;
-    std::map <int, QTableWidgetItem *> mapPtItem_ColFlags;
-    std::map <int, QTableWidgetItem *> mapPtItem_ColCount;
+    TPointModel *mPointModel; // rows of the points table
+    std::vector<TPointData> mChangedPoints; // points changed since the last refresh
 
     Ui::MainWindow *ui;
     QTimer *tmLogMsg; // timer to show log messages
+    QTimer *tmPoints; // timer to refresh the points table
+    static const int PointsRefreshMs = 100; // points table refresh period
     QIec104 i104;
+    TLogMsg mLog; // messages from this thread, i104.mLog is fed only by the protocol thread
 
     unsigned LastCommandAddress;
     int SendCommands;             // 1 = allow sending commands, 0 = don't send commands
@@ -100,6 +103,8 @@ private:
     int BDTR_CntDnToBePrimary; // countdown to be primary when not receiving keepalive messages
     int BDTR_Logar; // controla log das mensagens BDTR
     QTimer *tmBDTR_kamsg; // timer to send keep alive messages to the dual host
+    QTimer *tmBDTR_flush; // BDTR: zero timer, sends the packed points when the event loop is idle
+    TBdtrForwarder mBdtrFwd; // BDTR: points packed in datagrams to BDTR_host and BDTR_host_dual
     static const int BDTR_seconds_kamsg = 7;
     QUdpSocket *udps; // BDTR: udp socket
     QHostAddress BDTR_host; // endereo IP do cliente BDTR (normalmente a prpria mquina)
@@ -0,0 +1,187 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include "metrics.h"
+#include "latency.h"
+
+namespace {
+
+std::string labelValue( const std::string & s )
+{
+    std::string r;
+    for ( size_t i = 0; i < s.size(); i++ )
+      {
+      if ( s[i] == '\\' || s[i] == '"' )
+        r += '\\';
+      if ( s[i] == '\n' )
+        {
+        r += "\\n";
+        continue;
+        }
+      r += s[i];
+      }
+    return r;
+}
+
+void header( std::string & out, const char * name, const char * type, const char * help )
+{
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+// name{session="s"<extra>} value
+void sample( std::string & out, const char * name, const std::string & session, const char * extra, unsigned long long v )
+{
+    char num[32];
+    snprintf( num, sizeof(num), "%llu", v );
+    out += name;
+    out += "{session=\"";
+    out += session;
+    out += '"';
+    out += extra;
+    out += "} ";
+    out += num;
+    out += '\n';
+}
+
+typedef TCounter TSessionCounters::*TCounterField;
+
+void counterMetric( std::string & out, const std::vector<TMetricsSource> & sessions, const std::vector<std::string> & names,
+                    const char * name, const char * type, const char * help, TCounterField f )
+{
+    header( out, name, type, help );
+    for ( size_t i = 0; i < sessions.size(); i++ )
+      sample( out, name, names[i], "", ( sessions[i].counters->*f ).get() );
+}
+
+} // namespace
+
+void writePrometheus( std::string & out, const std::vector<TMetricsSource> & sessions )
+{
+    std::vector<std::string> names;
+    for ( size_t i = 0; i < sessions.size(); i++ )
+      names.push_back( labelValue( sessions[i].name ) );
+
+    static const char * dirs[2] = { ",direction=\"rx\"", ",direction=\"tx\"" };
+    static const char * formats[3] = { ",format=\"I\"", ",format=\"S\"", ",format=\"U\"" };
+    char extra[64];
+
+    header( out, "iec104_frames_total", "counter", "APDUs by direction and format." );
+    for ( size_t i = 0; i < sessions.size(); i++ )
+      {
+      const TSessionCounters & c = *sessions[i].counters;
+      const TCounter * fr[3] = { c.iFrames, c.sFrames, c.uFrames };
+      for ( int d = 0; d < 2; d++ )
+        for ( int f = 0; f < 3; f++ )
+          {
+          snprintf( extra, sizeof(extra), "%s%s", dirs[d], formats[f] );
+          sample( out, "iec104_frames_total", names[i], extra, fr[f][d].get() );
+          }
+      }
+
+    header( out, "iec104_bytes_total", "counter", "Bytes of APDUs by direction." );
+    for ( size_t i = 0; i < sessions.size(); i++ )
+      for ( int d = 0; d < 2; d++ )
+        sample( out, "iec104_bytes_total", names[i], dirs[d], sessions[i].counters->bytes[d].get() );
+
+    header( out, "iec104_objects_total", "counter", "Information objects decoded, by type id." );
+    for ( size_t i = 0; i < sessions.size(); i++ )
+      for ( int t = 0; t < 256; t++ )
+        {
+        unsigned long long v = sessions[i].counters->objects[t].get();
+        if ( v == 0 )
+          continue; // types never seen are left out
+        snprintf( extra, sizeof(extra), ",type=\"%d\"", t );
+        sample( out, "iec104_objects_total", names[i], extra, v );
+        }
+
+    counterMetric( out, sessions, names, "iec104_sequence_errors_total", "counter", "Received I-frames out of sequence.", &TSessionCounters::seqErrors );
+    counterMetric( out, sessions, names, "iec104_invalid_nr_total", "counter", "Acknowledgements of I-frames not sent.", &TSessionCounters::invalidNR );
+    counterMetric( out, sessions, names, "iec104_invalid_frames_total", "counter", "Frames without start byte or with invalid length.", &TSessionCounters::invalidFrames );
+    counterMetric( out, sessions, names, "iec104_asdu_size_errors_total", "counter", "ASDUs whose size does not match the number of objects.", &TSessionCounters::sizeErrors );
+    counterMetric( out, sessions, names, "iec104_unexpected_ca_total", "counter", "ASDUs from an unexpected common address.", &TSessionCounters::unexpectedCA );
+    counterMetric( out, sessions, names, "iec104_connects_total", "counter", "TCP connections established.", &TSessionCounters::connects );
+    counterMetric( out, sessions, names, "iec104_disconnects_total", "counter", "TCP connections closed.", &TSessionCounters::disconnects );
+    counterMetric( out, sessions, names, "iec104_t1_expiries_total", "counter", "Sent I-frames not acknowledged in t1.", &TSessionCounters::t1Expiries );
+    counterMetric( out, sessions, names, "iec104_startdt_timeouts_total", "counter", "STARTDT activations not confirmed in t1.", &TSessionCounters::startdtTimeouts );
+    counterMetric( out, sessions, names, "iec104_acked_frames_total", "counter", "Sent I-frames acknowledged by the slave.", &TSessionCounters::ackedFrames );
+    counterMetric( out, sessions, names, "iec104_ack_wait_milliseconds_total", "counter", "Sum of the send to acknowledge times of the acknowledged I-frames.", &TSessionCounters::ackWaitMs );
+    counterMetric( out, sessions, names, "iec104_connected", "gauge", "1 while the TCP connection is up.", &TSessionCounters::connected );
+    counterMetric( out, sessions, names, "iec104_unacked_frames", "gauge", "Sent I-frames not acknowledged yet.", &TSessionCounters::unacked );
+    counterMetric( out, sessions, names, "iec104_tx_queued_frames", "gauge", "I-frames waiting for room in the k window.", &TSessionCounters::txQueued );
+    counterMetric( out, sessions, names, "iec104_rx_unacked_frames", "gauge", "Received I-frames not acknowledged yet.", &TSessionCounters::rxUnacked );
+    counterMetric( out, sessions, names, "iec104_tx_buffered_bytes", "gauge", "Bytes waiting to be written to the socket.", &TSessionCounters::txBuffered );
+
+    bool anyLatency = false;
+    for ( size_t i = 0; i < sessions.size(); i++ )
+      anyLatency = anyLatency || sessions[i].latency != NULL;
+    if ( !anyLatency )
+      return;
+
+    static const double quantiles[3] = { 0.5, 0.99, 0.999 };
+    header( out, "iec104_rx_latency_seconds", "summary", "Receive path latency of the frames by stage." );
+    for ( size_t i = 0; i < sessions.size(); i++ )
+      {
+      if ( sessions[i].latency == NULL )
+        continue;
+      for ( int s = 0; s < TLatencyStats::STAGES; s++ )
+        {
+        const TLatencyHist & h = sessions[i].latency->stage[s];
+        char value[32];
+        for ( int q = 0; q < 3; q++ )
+          {
+          snprintf( extra, sizeof(extra), ",stage=\"%s\",quantile=\"%g\"", TLatencyStats::stageName( s ), quantiles[q] );
+          snprintf( value, sizeof(value), "%.9f\n", h.percentile( quantiles[q] * 100 ) / 1e9 );
+          out += "iec104_rx_latency_seconds{session=\"";
+          out += names[i];
+          out += '"';
+          out += extra;
+          out += "} ";
+          out += value;
+          }
+        snprintf( extra, sizeof(extra), ",stage=\"%s\"", TLatencyStats::stageName( s ) );
+        snprintf( value, sizeof(value), "%.9f\n", h.sum() / 1e9 );
+        out += "iec104_rx_latency_seconds_sum{session=\"";
+        out += names[i];
+        out += '"';
+        out += extra;
+        out += "} ";
+        out += value;
+        sample( out, "iec104_rx_latency_seconds_count", names[i], extra, h.count() );
+        }
+      }
+}
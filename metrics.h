@@ -0,0 +1,92 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+// Counters of a session (iec104_class::getCounters) and their rendering in the Prometheus text format.
+// The session thread is the only writer: an update is a relaxed load and store, no locked instruction, and any
+// thread (a metrics endpoint, see metricsrv.h) may read at the same time.
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+class TLatencyStats;
+
+class TCounter
+{
+public:
+    TCounter() : v( 0 ) {}
+    inline void add( unsigned long long n = 1 ) { v.store( v.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed ); }
+    inline void set( unsigned long long n ) { v.store( n, std::memory_order_relaxed ); } // gauges
+    inline unsigned long long get() const { return v.load( std::memory_order_relaxed ); }
+private:
+    std::atomic<unsigned long long> v;
+};
+
+struct TSessionCounters
+{
+    enum { RX, TX };
+    TCounter iFrames[2], sFrames[2], uFrames[2]; // apdus by format and direction
+    TCounter bytes[2];
+    TCounter objects[256]; // information objects decoded, by type id
+
+    TCounter seqErrors; // N(S) of a received I-frame out of order
+    TCounter invalidNR; // N(R) acknowledging frames not sent
+    TCounter invalidFrames; // no start byte or length out of range
+    TCounter sizeErrors; // asdu size does not match the number of objects
+    TCounter unexpectedCA; // asdu from another common address
+
+    TCounter connects, disconnects;
+    TCounter t1Expiries; // sent I-frame not acknowledged in t1, the connection is closed
+    TCounter startdtTimeouts; // STARTDTCON not received in t1
+    TCounter ackedFrames; // sent I-frames acknowledged by the slave
+    TCounter ackWaitMs; // sum of the send to acknowledge times of ackedFrames (ms)
+
+    // gauges
+    TCounter connected; // 1 while the tcp connection is up
+    TCounter unacked; // sent I-frames not acknowledged yet (ack lag)
+    TCounter txQueued; // I-frames waiting for room in the k window
+    TCounter rxUnacked; // received I-frames not acknowledged yet
+    TCounter txBuffered; // bytes accepted and not written to the socket yet (set by the derived class, if it buffers)
+};
+
+// one session in the output: label session="name"; latency may be NULL
+struct TMetricsSource
+{
+    std::string name;
+    const TSessionCounters * counters;
+    const TLatencyStats * latency;
+};
+
+// Prometheus text exposition (version 0.0.4) of the sessions, appended to out
+void writePrometheus( std::string & out, const std::vector<TMetricsSource> & sessions );
+
+#endif // METRICS_H
@@ -0,0 +1,265 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <chrono>
+#include "metricsrv.h"
+
+TMetricsServer::TMetricsServer() : mFd( -1 )
+{
+    mWake[0] = mWake[1] = -1;
+}
+
+TMetricsServer::~TMetricsServer()
+{
+    stop();
+}
+
+bool TMetricsServer::fail( const char * what )
+{
+    mError = std::string( what ) + ": " + strerror( errno );
+    if ( mFd >= 0 )
+      close( mFd );
+    mFd = -1;
+    return false;
+}
+
+bool TMetricsServer::start( const std::string & where, std::function<std::string()> render )
+{
+    stop();
+    mRender = render;
+
+    if ( where.find( '/' ) != std::string::npos )
+      {
+      struct sockaddr_un sun;
+      memset( &sun, 0, sizeof(sun) );
+      sun.sun_family = AF_UNIX;
+      if ( where.size() >= sizeof(sun.sun_path) )
+        {
+        mError = "socket path too long";
+        return false;
+        }
+      strcpy( sun.sun_path, where.c_str() );
+      mFd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+      if ( mFd < 0 )
+        return fail( "socket" );
+      struct stat st;
+      if ( lstat( where.c_str(), &st ) == 0 )
+        {
+        if ( !S_ISSOCK( st.st_mode ) )
+          {
+          mError = "not a socket, not replaced: " + where;
+          close( mFd );
+          mFd = -1;
+          return false;
+          }
+        unlink( where.c_str() ); // left by a previous run
+        }
+      if ( bind( mFd, (struct sockaddr *)&sun, sizeof(sun) ) < 0 )
+        return fail( "bind" );
+      mUnixPath = where;
+      }
+    else
+      {
+      std::string host = "127.0.0.1", port = where;
+      size_t colon = where.rfind( ':' );
+      if ( colon != std::string::npos )
+        {
+        host = where.substr( 0, colon );
+        port = where.substr( colon + 1 );
+        }
+      struct sockaddr_in sin;
+      memset( &sin, 0, sizeof(sin) );
+      sin.sin_family = AF_INET;
+      sin.sin_port = htons( atoi( port.c_str() ) );
+      if ( inet_pton( AF_INET, host.c_str(), &sin.sin_addr ) != 1 || ( ntohl( sin.sin_addr.s_addr ) >> 24 ) != 127 || sin.sin_port == 0 )
+        {
+        mError = "not a loopback address and port: " + where;
+        return false;
+        }
+      mFd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+      if ( mFd < 0 )
+        return fail( "socket" );
+      int on = 1;
+      setsockopt( mFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on) );
+      if ( bind( mFd, (struct sockaddr *)&sin, sizeof(sin) ) < 0 )
+        return fail( "bind" );
+      }
+
+    if ( listen( mFd, 16 ) < 0 )
+      return fail( "listen" );
+    if ( pipe( mWake ) < 0 )
+      return fail( "pipe" );
+
+    mThread = std::thread( &TMetricsServer::run, this );
+    return true;
+}
+
+void TMetricsServer::stop()
+{
+    if ( mThread.joinable() )
+      {
+      char c = 0;
+      if ( write( mWake[1], &c, 1 ) < 0 )
+        {} // the thread is gone already
+      mThread.join();
+      }
+    for ( int i = 0; i < 2; i++ )
+      if ( mWake[i] >= 0 )
+        {
+        close( mWake[i] );
+        mWake[i] = -1;
+        }
+    if ( mFd >= 0 )
+      {
+      close( mFd );
+      mFd = -1;
+      }
+    if ( !mUnixPath.empty() )
+      {
+      unlink( mUnixPath.c_str() );
+      mUnixPath.clear();
+      }
+}
+
+void TMetricsServer::run()
+{
+    // signals go to the threads of the application
+    sigset_t all;
+    sigfillset( &all );
+    pthread_sigmask( SIG_BLOCK, &all, NULL );
+
+    struct pollfd pfd[2];
+    pfd[0].fd = mFd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = mWake[0];
+    pfd[1].events = POLLIN;
+
+    while ( true )
+      {
+      if ( poll( pfd, 2, -1 ) < 0 )
+        {
+        if ( errno == EINTR )
+          continue;
+        return;
+        }
+      if ( pfd[1].revents )
+        return;
+      if ( pfd[0].revents & POLLIN )
+        {
+        int fd = accept4( mFd, NULL, NULL, SOCK_CLOEXEC );
+        if ( fd >= 0 )
+          {
+          serve( fd );
+          close( fd );
+          }
+        }
+      }
+}
+
+// waits until fd is ready for events, false at the deadline, on error or when stop() is called
+bool TMetricsServer::waitFor( int fd, short events, std::chrono::steady_clock::time_point deadline )
+{
+    struct pollfd pfd[2];
+    pfd[0].fd = fd;
+    pfd[0].events = events;
+    pfd[1].fd = mWake[0];
+    pfd[1].events = POLLIN;
+    while ( true )
+      {
+      long long ms = std::chrono::duration_cast<std::chrono::milliseconds>( deadline - std::chrono::steady_clock::now() ).count();
+      if ( ms <= 0 )
+        return false;
+      int n = poll( pfd, 2, (int)ms );
+      if ( n < 0 && errno == EINTR )
+        continue;
+      if ( n <= 0 || pfd[1].revents )
+        return false;
+      return true; // ready, or an error the next read or send reports
+      }
+}
+
+// reads the request head and answers with the whole text; the client has a second for the whole exchange,
+// however it trickles the bytes, so a slow or silent client can't hold the server
+void TMetricsServer::serve( int fd )
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 1 );
+
+    std::string req;
+    char buf[1024];
+    while ( req.find( "\r\n\r\n" ) == std::string::npos && req.find( "\n\n" ) == std::string::npos )
+      {
+      if ( !waitFor( fd, POLLIN, deadline ) )
+        return;
+      ssize_t n = recv( fd, buf, sizeof(buf), MSG_DONTWAIT );
+      if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) )
+        continue;
+      if ( n <= 0 || req.size() > 16384 )
+        return;
+      req.append( buf, n );
+      }
+
+    std::string resp;
+    if ( req.compare( 0, 4, "GET " ) != 0 && req.compare( 0, 5, "HEAD " ) != 0 )
+      resp = "HTTP/1.0 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    else
+      {
+      std::string body = mRender();
+      char head[160];
+      snprintf( head, sizeof(head), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", body.size() );
+      resp = head;
+      if ( req.compare( 0, 4, "GET " ) == 0 )
+        resp += body;
+      }
+
+    size_t off = 0;
+    while ( off < resp.size() )
+      {
+      if ( !waitFor( fd, POLLOUT, deadline ) )
+        return;
+      ssize_t n = send( fd, resp.data() + off, resp.size() - off, MSG_NOSIGNAL | MSG_DONTWAIT );
+      if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) )
+        continue;
+      if ( n <= 0 )
+        return;
+      off += n;
+      }
+}
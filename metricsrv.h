@@ -0,0 +1,75 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef METRICSRV_H
+#define METRICSRV_H
+
+// Local metrics endpoint: a thread answers every HTTP request (any path) with the text of a render function,
+// as Prometheus text exposition. It listens on a loopback TCP port or a unix socket, never on a public address.
+// Requests are served one at a time, a client has a second for its request and the answer; render() runs in
+// the server thread, so it must only read what is safe to read from another thread (TSessionCounters,
+// TLatencyStats). POSIX only.
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+
+class TMetricsServer
+{
+public:
+    TMetricsServer();
+    ~TMetricsServer();
+
+    // where: "port" or "127.0.0.1:port" (loopback tcp), or a unix socket path (contains a '/'; a socket left
+    // there is replaced, any other file is an error);
+    // false if it can't listen, the error is in getError()
+    bool start( const std::string & where, std::function<std::string()> render );
+    void stop();
+    const std::string & getError() const { return mError; }
+
+private:
+    TMetricsServer( const TMetricsServer & );
+    TMetricsServer & operator=( const TMetricsServer & );
+
+    bool fail( const char * what );
+    void run();
+    void serve( int fd );
+    bool waitFor( int fd, short events, std::chrono::steady_clock::time_point deadline );
+
+    int mFd; // listening socket
+    int mWake[2]; // pipe that stops the thread
+    std::string mUnixPath; // removed on stop
+    std::string mError;
+    std::function<std::string()> mRender;
+    std::thread mThread;
+};
+
+#endif // METRICSRV_H
@@ -0,0 +1,220 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include "pointmodel.h"
+#include "iec104_class.h"
+
+TPointModel::TPointModel( QObject *parent ) : QAbstractTableModel( parent )
+{
+}
+
+int TPointModel::rowCount( const QModelIndex &parent ) const
+{
+    return parent.isValid() ? 0 : (int)mRows.size();
+}
+
+int TPointModel::columnCount( const QModelIndex &parent ) const
+{
+    return parent.isValid() ? 0 : COL_NUM;
+}
+
+QVariant TPointModel::headerData( int section, Qt::Orientation orientation, int role ) const
+{
+    static const char * colunas[] = { "Address", "Value", "Type", "Cause", "Flags", "Count" };
+
+    if ( role != Qt::DisplayRole )
+        return QVariant();
+    if ( orientation == Qt::Vertical )
+        return section + 1;
+    if ( section < 0 || section >= COL_NUM )
+        return QVariant();
+    return QString( colunas[section] );
+}
+
+QVariant TPointModel::data( const QModelIndex &index, int role ) const
+{
+    if ( role != Qt::DisplayRole || !index.isValid() || index.row() >= (int)mRows.size() )
+        return QVariant();
+
+    const TRow &row = mRows[index.row()];
+    switch ( index.column() )
+      {
+      case COL_ADDRESS:
+          return QString( "%1" ).arg( (unsigned)( row.key >> 16 ), 5, 10, QChar( '0' ) );
+      case COL_VALUE:
+          return QString::number( row.value, 'f', 6 );
+      case COL_TYPE:
+          return row.type;
+      case COL_CAUSE:
+          return row.cause;
+      case COL_FLAGS:
+          return flagsText( row );
+      case COL_COUNT:
+          return row.count;
+      }
+    return QVariant();
+}
+
+QString TPointModel::flagsText( const TRow &row ) const
+{
+    static const char* dblmsg[] = { "tra ","off ","on ","ind " };
+    const char * ov = ( row.quality & iec104_class::QDS_OV ) ? "ov " : "";
+    const char * iv = ( row.quality & iec104_class::QDS_IV ) ? "iv " : "";
+    const char * bl = ( row.quality & iec104_class::QDS_BL ) ? "bl " : "";
+    const char * sb = ( row.quality & iec104_class::QDS_SB ) ? "sb " : "";
+    const char * nt = ( row.quality & iec104_class::QDS_NT ) ? "nt " : "";
+    char buf[50];
+
+    buf[0] = 0;
+    switch ( row.type )
+      {
+      case iec104_class::M_SP_NA_1: // 1
+      case iec104_class::M_SP_TB_1: // 30
+          sprintf( buf, "%s%s%s%s%s", row.value?"on ":"off ", iv, bl, sb, nt );
+          break;
+      case iec104_class::M_DP_NA_1: // 3
+      case iec104_class::M_DP_TB_1: // 31
+          sprintf( buf, "%s%s%s%s%s", dblmsg[(int)row.value & 3], iv, bl, sb, nt );
+          break;
+      case iec104_class::M_ST_NA_1: // 5
+      case iec104_class::M_ST_TB_1: // 32
+          sprintf( buf, "%s%s%s%s%s%s", ov, iv, bl, sb, nt, row.transient?"t ":"" );
+          break;
+      case iec104_class::M_ME_NA_1: // 9
+      case iec104_class::M_ME_NB_1: // 11
+      case iec104_class::M_ME_NC_1: // 13
+      case iec104_class::M_ME_TD_1: // 34
+      case iec104_class::M_ME_TE_1: // 35
+      case iec104_class::M_ME_TF_1: // 36
+          sprintf( buf, "%s%s%s%s%s", ov, iv, bl, sb, nt );
+          break;
+      }
+    return QString( buf );
+}
+
+void TPointModel::setRow( TRow &row, const TPointData &pt )
+{
+    row.key = makeKey( pt );
+    row.value = pt.value;
+    row.count = pt.count;
+    row.type = pt.type;
+    row.cause = pt.cause;
+    row.quality = pt.quality;
+    row.transient = pt.transient;
+}
+
+int TPointModel::find( unsigned long long key ) const
+{
+    TRow k;
+    k.key = key;
+    std::vector<TRow>::const_iterator it = std::lower_bound( mRows.begin(), mRows.end(), k, keyLess );
+    if ( it == mRows.end() || it->key != key )
+        return -1;
+    return (int)( it - mRows.begin() );
+}
+
+void TPointModel::update( const TPointData *pts, int numpoints )
+{
+    int first = -1;
+    int last = -1;
+
+    mNew.clear();
+    for ( int i = 0; i < numpoints; i++ )
+      {
+      int rw = find( makeKey( pts[i] ) );
+      if ( rw < 0 )
+        {
+        mNew.resize( mNew.size() + 1 );
+        setRow( mNew.back(), pts[i] );
+        continue;
+        }
+      setRow( mRows[rw], pts[i] );
+      if ( first < 0 || rw < first )
+        first = rw;
+      if ( rw > last )
+        last = rw;
+      }
+
+    // one signal for all the updated rows, the view repaints only what is visible of the range
+    if ( first >= 0 )
+        emit dataChanged( index( first, 0 ), index( last, COL_NUM - 1 ) );
+
+    if ( mNew.empty() )
+        return;
+
+    // new points in key order, the last state of a point given more than once
+    std::stable_sort( mNew.begin(), mNew.end(), keyLess );
+    unsigned n = 0;
+    for ( unsigned i = 0; i < mNew.size(); i++ )
+      {
+      if ( n > 0 && mNew[n - 1].key == mNew[i].key )
+        n--;
+      mNew[n++] = mNew[i];
+      }
+    mNew.resize( n );
+
+    // runs of new points that go to the same place
+    std::vector< std::pair<int, int> > runs; // ( row, first new point of the run )
+    for ( unsigned i = 0; i < mNew.size(); i++ )
+      {
+      int rw = (int)( std::lower_bound( mRows.begin(), mRows.end(), mNew[i], keyLess ) - mRows.begin() );
+      if ( runs.empty() || runs.back().first != rw )
+        runs.push_back( std::make_pair( rw, (int)i ) );
+      }
+
+    if ( runs.size() > (unsigned)MaxInsertRuns )
+      { // scattered all over the table: one merge and a reset are cheaper than many insertions
+      beginResetModel();
+      size_t mid = mRows.size();
+      mRows.insert( mRows.end(), mNew.begin(), mNew.end() );
+      std::inplace_merge( mRows.begin(), mRows.begin() + mid, mRows.end(), keyLess );
+      endResetModel();
+      return;
+      }
+
+    // from the last run to the first, so that the rows of the runs not yet inserted don't move
+    for ( int r = (int)runs.size() - 1; r >= 0; r-- )
+      {
+      int rw = runs[r].first;
+      int from = runs[r].second;
+      int to = ( r + 1 < (int)runs.size() ) ? runs[r + 1].second : (int)mNew.size();
+      beginInsertRows( QModelIndex(), rw, rw + to - from - 1 );
+      mRows.insert( mRows.begin() + rw, mNew.begin() + from, mNew.begin() + to );
+      endInsertRows();
+      }
+}
+
+void TPointModel::clear()
+{
+    beginResetModel();
+    mRows.clear();
+    endResetModel();
+}
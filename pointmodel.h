@@ -0,0 +1,82 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef POINTMODEL_H
+#define POINTMODEL_H
+
+#include <QAbstractTableModel>
+#include <vector>
+#include "pointtable.h"
+
+// Table model of the points shown in the main window: one compact row per point, kept sorted by address.
+// The view asks only for the cells it paints, nothing is allocated per cell.
+// update() takes the latest state of a group of points (e.g. the changes of one refresh tick):
+// known points are updated in place with one dataChanged() range, new points are sorted and merged,
+// a group of new points that sort after the others (the usual general interrogation) is one rowsInserted() range.
+
+class TPointModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit TPointModel( QObject *parent = 0 );
+
+    enum { COL_ADDRESS, COL_VALUE, COL_TYPE, COL_CAUSE, COL_FLAGS, COL_COUNT, COL_NUM };
+
+    int rowCount( const QModelIndex &parent = QModelIndex() ) const;
+    int columnCount( const QModelIndex &parent = QModelIndex() ) const;
+    QVariant data( const QModelIndex &index, int role = Qt::DisplayRole ) const;
+    QVariant headerData( int section, Qt::Orientation orientation, int role = Qt::DisplayRole ) const;
+
+    void update( const TPointData *pts, int numpoints ); // latest state of points, new ones are inserted
+    void clear(); // remove all rows
+
+private:
+    struct TRow {
+        unsigned long long key; // ( ioa << 16 ) | ca, the sort order
+        float value;
+        unsigned count;
+        unsigned char type;
+        unsigned char cause;
+        unsigned char quality;
+        unsigned char transient;
+    };
+
+    static unsigned long long makeKey( const TPointData &pt ) { return ( (unsigned long long)pt.ioa << 16 ) | pt.ca; }
+    static void setRow( TRow &row, const TPointData &pt );
+    static bool keyLess( const TRow &a, const TRow &b ) { return a.key < b.key; }
+    int find( unsigned long long key ) const; // row of the point, -1 if not there
+    QString flagsText( const TRow &row ) const;
+
+    std::vector<TRow> mRows; // sorted by key
+    std::vector<TRow> mNew; // new points of the current update
+    static const int MaxInsertRuns = 64; // more separate places to insert than this: reset the model instead
+};
+
+#endif // POINTMODEL_H
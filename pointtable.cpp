@@ -0,0 +1,191 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <chrono>
+#include <string.h>
+#include "pointtable.h"
+
+TPointTable::TPointTable( unsigned maxpoints ) : mChanged( 16 )
+{
+    unsigned sz = 16;
+    while ( sz < maxpoints + maxpoints / 3 )
+      sz <<= 1;
+    mSlots = new TSlot[sz];
+    mMask = sz - 1;
+    mMaxPoints = maxpoints;
+    mSize = 0;
+    mDropped = 0;
+    mChanged.resize( sz );
+    for ( unsigned i = 0; i < sz; i++ )
+      {
+      mSlots[i].key.store( emptyKey, std::memory_order_relaxed );
+      mSlots[i].seq.store( 0, std::memory_order_relaxed );
+      mSlots[i].queued.store( false, std::memory_order_relaxed );
+      memset( &mSlots[i].data, 0, sizeof( TPointData ) );
+      }
+}
+
+TPointTable::~TPointTable()
+{
+    delete[] mSlots;
+}
+
+long long TPointTable::nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+bool TPointTable::update( const iec_obj * obj, int numpoints )
+{
+    long long now = nowUs();
+    bool ok = true;
+    for ( int i = 0; i < numpoints; i++ )
+      ok &= update( obj[i], now );
+    return ok;
+}
+
+bool TPointTable::update( const iec_obj & obj, long long now_us )
+{
+    unsigned char q = iec104_class::qualityOf( obj );
+
+    unsigned long long key = makeKey( obj.ca, obj.address );
+    TSlot * s;
+
+    // only this thread inserts: no other writer can take the slot found empty
+    unsigned i;
+    for ( i = hash( key ); ; i = ( i + 1 ) & mMask )
+      {
+      s = &mSlots[i];
+      unsigned long long k = s->key.load( std::memory_order_relaxed );
+      if ( k == key )
+        break;
+      if ( k == emptyKey )
+        {
+        if ( mSize.load( std::memory_order_relaxed ) >= mMaxPoints )
+          {
+          mDropped.fetch_add( 1, std::memory_order_relaxed );
+          return false;
+          }
+        // new point: the record is complete before readers can find the key
+        TPointData & d = s->data;
+        d.ca = obj.ca;
+        d.ioa = obj.address & 0xFFFFFF;
+        d.value = obj.value;
+        d.quality = q;
+        d.transient = obj.t;
+        d.timetag = obj.timetag;
+        d.type = obj.type;
+        d.cause = obj.cause;
+        d.count = 1;
+        d.changed = now_us;
+        d.updated = now_us;
+        s->key.store( key, std::memory_order_release );
+        mSize.fetch_add( 1, std::memory_order_release );
+        markChanged( i );
+        return true;
+        }
+      }
+
+    unsigned seq = s->seq.load( std::memory_order_relaxed );
+    s->seq.store( seq + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+
+    TPointData & d = s->data;
+    if ( d.value != obj.value || d.quality != q )
+      d.changed = now_us;
+    d.value = obj.value;
+    d.quality = q;
+    d.transient = obj.t;
+    d.timetag = obj.timetag;
+    d.type = obj.type;
+    d.cause = obj.cause;
+    d.count++;
+    d.updated = now_us;
+
+    s->seq.store( seq + 2, std::memory_order_release );
+    markChanged( i );
+    return true;
+}
+
+// queue the slot for the consumer unless it is already queued
+// the flag is exchanged on both sides: when the writer finds it set, the consumer's clear comes after this update,
+// so the consumer reads it (a plain load first would not order the seq store before it, and could lose the update)
+void TPointTable::markChanged( unsigned slot )
+{
+    if ( !mSlots[slot].queued.exchange( true, std::memory_order_acq_rel ) )
+      mChanged.push( slot );
+}
+
+unsigned TPointTable::pullChanged( unsigned * changed, unsigned max )
+{
+    unsigned n = 0;
+    const unsigned * p;
+    while ( n < max && ( p = mChanged.front() ) != NULL )
+      {
+      unsigned slot = *p;
+      mChanged.pop();
+      mSlots[slot].queued.exchange( false, std::memory_order_acq_rel ); // updates from now on queue it again
+      changed[n++] = slot;
+      }
+    return n;
+}
+
+bool TPointTable::copy( const TSlot & s, TPointData & pt ) const
+{
+    for ( ;; )
+      {
+      unsigned seq = s.seq.load( std::memory_order_acquire );
+      if ( seq & 1 )
+        continue; // being written
+      memcpy( &pt, &s.data, sizeof( TPointData ) );
+      std::atomic_thread_fence( std::memory_order_acquire );
+      if ( s.seq.load( std::memory_order_relaxed ) == seq )
+        return true;
+      }
+}
+
+bool TPointTable::read( unsigned short ca, unsigned int ioa, TPointData & pt ) const
+{
+    unsigned long long key = makeKey( ca, ioa );
+    for ( unsigned i = hash( key ); ; i = ( i + 1 ) & mMask )
+      {
+      unsigned long long k = mSlots[i].key.load( std::memory_order_acquire );
+      if ( k == key )
+        return copy( mSlots[i], pt );
+      if ( k == emptyKey )
+        return false;
+      }
+}
+
+bool TPointTable::readSlot( unsigned slot, TPointData & pt ) const
+{
+    if ( slot > mMask || mSlots[slot].key.load( std::memory_order_acquire ) == emptyKey )
+      return false;
+    return copy( mSlots[slot], pt );
+}
@@ -0,0 +1,111 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef POINTTABLE_H
+#define POINTTABLE_H
+
+// Real time point database: the last state of every point, keyed by ( common address, information object address ).
+// Open addressing with linear probing over a flat array allocated once (fixed capacity, points are never removed).
+// One thread writes (the protocol), any number of threads read at the same time: each record has a sequence lock,
+// a reader copies the record and retries if it was being written.
+// Updated records are also queued once (until pulled) for one consumer, e.g. a display refreshed at a fixed rate:
+// the work of the consumer depends on the number of points that changed, not on the message rate.
+
+#include <atomic>
+#include "iec104_class.h"
+#include "spscring.h"
+
+// state of one point, plain data
+struct TPointData {
+    unsigned short ca;          // common address of asdu   ASDU地址
+    unsigned int ioa;           // 3 byte address           3字节地址
+    float value;                // value (state for single and double points)   值
+    cp56time2a timetag;         // time tag of the last update, zero if the type has none   最后更新的时间标签
+    unsigned char type;         // iec type of the last update                  最后更新的IEC类型
+    unsigned char cause;        // cause of the last update
+    unsigned char quality;      // quality descriptor bits (iec104_class::QDS_*)  品质描述词
+    unsigned char transient;    // step position in transient state (M_ST)      步位置处于瞬变状态
+    unsigned int count;         // updates received                             收到的更新数
+    long long changed;          // local time (us since epoch) of the last change of value or quality   值或品质最后变化的本地时间
+    long long updated;          // local time (us since epoch) of the last update                    最后更新的本地时间
+};
+
+class TPointTable
+{
+public:
+    // room for maxpoints points (the array is sized for a load factor of at most 3/4)
+    explicit TPointTable( unsigned maxpoints = 65536 );
+    ~TPointTable();
+
+    static long long nowUs(); // local time, us since epoch
+
+    // ---- writer side (a single thread) ----
+    // store the objects decoded from one asdu, false if some did not fit
+    bool update( const iec_obj * obj, int numpoints );
+    bool update( const iec_obj & obj, long long now_us );
+
+    // ---- reader side (any thread) ----
+    bool read( unsigned short ca, unsigned int ioa, TPointData & pt ) const; // false if the point is unknown
+    unsigned size() const { return mSize.load( std::memory_order_acquire ); } // points in the table
+    // iteration: slots 0 .. slotCount()-1, false for empty slots
+    unsigned slotCount() const { return mMask + 1; }
+    bool readSlot( unsigned slot, TPointData & pt ) const;
+    unsigned long long dropped() const { return mDropped.load( std::memory_order_relaxed ); } // updates of points that did not fit
+
+    // ---- changes (a single consumer thread) ----
+    // up to max slots updated since they were last pulled, each once, in order of the first update; read them with readSlot()
+    unsigned pullChanged( unsigned * changed, unsigned max );
+
+private:
+    TPointTable( const TPointTable & );
+    TPointTable & operator=( const TPointTable & );
+
+    static const unsigned long long emptyKey = ~0ULL;
+
+    struct TSlot {
+        std::atomic<unsigned long long> key; // ( ca << 24 ) | ioa, emptyKey if free
+        std::atomic<unsigned> seq; // odd while the record is being written
+        std::atomic<bool> queued; // in mChanged, not pulled yet
+        TPointData data;
+    };
+
+    static unsigned long long makeKey( unsigned short ca, unsigned int ioa ) { return ( (unsigned long long)ca << 24 ) | ( ioa & 0xFFFFFF ); }
+    unsigned hash( unsigned long long key ) const { return (unsigned)( ( key * 0x9E3779B97F4A7C15ULL ) >> 32 ) & mMask; }
+    bool copy( const TSlot & s, TPointData & pt ) const;
+    void markChanged( unsigned slot );
+
+    TSlot * mSlots;
+    unsigned mMask;
+    unsigned mMaxPoints;
+    std::atomic<unsigned> mSize;
+    std::atomic<unsigned long long> mDropped;
+    TSpscRing<unsigned> mChanged; // a slot is queued at most once, so it can't fill up
+};
+
+#endif // POINTTABLE_H
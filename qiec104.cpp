@@ -35,32 +35,92 @@ QIec104::QIec104( QObject *parent ) :
 {
 mEnding = false;
 mAllowConnect = true;
+mStarted = false;
+mDataReadyPending = false;
+mPointsDropped = 0;
+mPoints.resize( 65536 );
 SendCommands = 0;
+setPointTable( &mPointTable );
 mLog.activateLog();
 mLog.doLogTime();
 
-tcps = new QTcpSocket();
-tmKeepAlive = new QTimer();
+qRegisterMetaType <iec_obj> ( "iec_obj" );
+
+// children move with this object to the protocol thread
+tcps = new QTcpSocket( this );
+tmWheel = new QTimer( this );
+tmWheel->setSingleShot( true );
+tmWheel->setTimerType( Qt::PreciseTimer );
 
 connect( tcps, SIGNAL(readyRead()), this, SLOT(slot_tcpreadytoread()) );
 connect( tcps, SIGNAL(connected()), this, SLOT(slot_tcpconnect()) );
 connect( tcps, SIGNAL(disconnected()), this, SLOT(slot_tcpdisconnect()) );
-connect( tcps, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(slot_tcperror(QAbstractSocket::SocketError)),Qt::DirectConnection );
-connect( tmKeepAlive, SIGNAL(timeout()), this, SLOT(slot_keep_alive()) );
+connect( tcps, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(slot_tcperror(QAbstractSocket::SocketError)) );
+connect( tmWheel, SIGNAL(timeout()), this, SLOT(slot_timer_wheel()) );
 
-tcps->moveToThread( &tcpThread );
+moveToThread( &tcpThread );
 tcpThread.start( QThread::TimeCriticalPriority );
 }
 
 QIec104::~QIec104()
 {
-delete tmKeepAlive;
-delete tcps;
+if ( tcpThread.isRunning() )
+  terminate();
 }
 
+// called in the protocol thread, the objects are copied to the point queue as a whole asdu
 void QIec104::dataIndication( iec_obj *obj, int numpoints )
 {
-    emit signal_dataIndication( obj, numpoints );
+    if ( mPoints.capacity() - mPoints.size() < (unsigned)numpoints )
+      {
+      mPointsDropped += numpoints;
+      mLog.pushEvent( 0, "*** POINT QUEUE FULL, %d OBJECTS DISCARDED", numpoints );
+      }
+    else
+      {
+      for ( int i = 0; i < numpoints; i++ )
+        mPoints.push( obj[i] );
+      }
+
+    if ( !mDataReadyPending.exchange( true ) )
+      emit signal_dataReady();
+}
+
+int QIec104::pullPoints( iec_obj *obj, int max )
+{
+    const iec_obj * p = mPoints.front();
+
+    if ( p == NULL )
+      {
+      // rearm the signal, then look again for points queued before the flag was cleared
+      mDataReadyPending = false;
+      p = mPoints.front();
+      if ( p == NULL )
+        return 0;
+      }
+
+    // a group has the same type, cause and common address, as delivered by the protocol
+    int n = 0;
+    unsigned char type = p->type;
+    unsigned char cause = p->cause;
+    unsigned short ca = p->ca;
+    while ( n < max && p != NULL && p->type == type && p->cause == cause && p->ca == ca )
+      {
+      obj[n++] = *p;
+      mPoints.pop();
+      p = mPoints.front();
+      }
+    return n;
+}
+
+void QIec104::setPointQueueSize( unsigned size )
+{
+    mPoints.resize( size );
+}
+
+unsigned long long QIec104::getPointsDropped()
+{
+    return mPointsDropped;
 }
 
 void QIec104::connectTCP()
@@ -79,9 +139,7 @@ void QIec104::slot_tcperror( QAbstractSocket::SocketError socketError )
 {
   if ( socketError != QAbstractSocket::SocketTimeoutError )
     {
-    char buf[100];
-    sprintf( buf, "SocketError: %d", socketError );
-    mLog.pushMsg( (const char *)buf );
+    mLog.pushEvent( 0, "SocketError: %d", (int)socketError );
     }
 }
 
@@ -104,20 +162,43 @@ void QIec104::sendTCP( char * data, int sz )
 void QIec104::slot_tcpconnect()
 {
     tcps->setSocketOption( QAbstractSocket::LowDelayOption, 1 );
+    runTimers();
     onConnectTCP();
+    scheduleTimers();
     emit signal_tcp_connect();
 }
 
 void QIec104::slot_tcpdisconnect()
 {
+    runTimers();
     onDisconnectTCP();
+    scheduleTimers();
     emit signal_tcp_disconnect();
 }
 
-void QIec104::slot_keep_alive()
+// bring the wheel to the current time before an event, so timers started by the event are exact
+void QIec104::runTimers()
+{
+    getTimerWheel()->advance( TTimerWheel::nowMs() );
+}
+
+// sleep until the next timer of the wheel
+void QIec104::scheduleTimers()
+{
+    int ms = getTimerWheel()->nextExpiry();
+    if ( ms < 0 || mEnding )
+      tmWheel->stop();
+    else
+      tmWheel->start( ms );
+}
+
+void QIec104::slot_timer_wheel()
 {
     if ( !mEnding )
-      onTimerSecond();
+      {
+      runTimers();
+      scheduleTimers();
+      }
 }
 
 void  QIec104::interrogationActConfIndication()
@@ -132,18 +213,88 @@ void  QIec104::interrogationActTermIndication()
 
 void QIec104::commandActConfIndication( iec_obj *obj )
 {
-    emit signal_commandActConfIndication( obj );
+    emit signal_commandActConfIndication( *obj );
 }
 
 void QIec104::commandActTermIndication( iec_obj *obj )
 {
-    emit signal_commandActTermIndication( obj );
+    emit signal_commandActTermIndication( *obj );
+}
+
+void QIec104::start()
+{
+    mStarted = true;
+    QMetaObject::invokeMethod( this, "slot_start", Qt::QueuedConnection );
+}
+
+void QIec104::stop()
+{
+    // cleared here so the disconnect signal that follows already sees the engine stopped
+    mStarted = false;
+    QMetaObject::invokeMethod( this, "slot_stop", Qt::QueuedConnection );
+}
+
+bool QIec104::isStarted()
+{
+    return mStarted;
+}
+
+void QIec104::postGI()
+{
+    QMetaObject::invokeMethod( this, "slot_solicitGI", Qt::QueuedConnection );
+}
+
+void QIec104::postCommand( iec_obj obj )
+{
+    QMetaObject::invokeMethod( this, "slot_sendCommand", Qt::QueuedConnection, Q_ARG( iec_obj, obj ) );
+}
+
+void QIec104::slot_start()
+{
+    runTimers();
+    startConnecting();
+    scheduleTimers();
+}
+
+void QIec104::slot_stop()
+{
+    runTimers();
+    stopConnecting();
+    // close() emits disconnected() (slot_tcpdisconnect) by itself when the socket was connected
+    bool wasConnected = tcps->state() == QAbstractSocket::ConnectedState;
+    tcps->close();
+    if ( !wasConnected )
+      slot_tcpdisconnect();
+}
+
+void QIec104::slot_solicitGI()
+{
+    runTimers();
+    solicitGI();
+    scheduleTimers();
+}
+
+void QIec104::slot_sendCommand( iec_obj obj )
+{
+    runTimers();
+    sendCommand( &obj );
+    scheduleTimers();
+}
+
+void QIec104::slot_terminate()
+{
+    stopConnecting();
+    tmWheel->stop();
+    tcps->close();
+    // give the object back to the main thread, so it can be destroyed after the protocol thread ends
+    moveToThread( QApplication::instance()->thread() );
 }
 
 void QIec104::terminate()
 {
 mEnding = true;
-tcps->close();
+mStarted = false;
+QMetaObject::invokeMethod( this, "slot_terminate", Qt::BlockingQueuedConnection );
 tcpThread.quit();
 tcpThread.wait( 1000 );
 if ( tcpThread.isRunning() )
@@ -154,23 +305,20 @@ if ( tcpThread.isRunning() )
 
 void QIec104::slot_tcpreadytoread()
 {
-if ( tcps->bytesAvailable() < 6 )
-  return;
-
+// reads all available data and processes every complete apdu, partial frames are kept for the next signal
+runTimers();
 packetReadyTCP();
-
-int cnt = 0;
-// espera para ver se chega mais alguma coisa pela rede
-while ( (tcps->bytesAvailable() > 5) && (cnt++ < 10) )
-  {
-  tcps->waitForReadyRead( 10 );
-  packetReadyTCP();
-  }
+scheduleTimers();
 }
 
 void QIec104::disable_connect()
 {
     mAllowConnect = false;
+    QMetaObject::invokeMethod( this, "slot_disable_connect", Qt::QueuedConnection );
+}
+
+void QIec104::slot_disable_connect()
+{
     if ( tcps->state() == QAbstractSocket::ConnectedState )
       disconnectTCP();
 }
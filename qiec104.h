@@ -33,8 +33,20 @@
 #include <QObject>
 #include <QTimer>
 #include <QThread>
+#include <QMetaType>
 #include <QtNetwork/QTcpSocket>
+#include <atomic>
 #include <iec104_class.h>
+#include "spscring.h"
+#include "pointtable.h"
+
+Q_DECLARE_METATYPE( iec_obj )
+
+// The whole protocol engine (this object, its socket and timers) lives on its own thread, so the
+// user interface can never delay the protocol. Functions that act on the engine from other
+// threads (start, stop, postGI, postCommand...) are queued to the protocol thread.
+// Decoded points are passed to the consumer through a bounded queue: signal_dataReady() is
+// emitted when the queue becomes non empty, the consumer then calls pullPoints() until it returns 0.
 
 class QIec104 : public QObject, public iec104_class
 {
@@ -44,20 +56,28 @@ public:
     explicit QIec104(QObject *parent = 0);
     ~QIec104();
     int SendCommands; // 1 = allow sending commands, 0 = don't send commands
-    QTimer *tmKeepAlive; // 1 second timer
-    QTcpSocket *tcps; // socket for iec104 (tcp)
     void terminate();
     void disable_connect();
     void enable_connect();
 
+    // ---- callable from any thread ----
+    void start(); // start trying to connect and keep the connection
+    void stop(); // stop retrying and disconnect
+    bool isStarted();
+    void postGI(); // queue a general interrogation
+    void postCommand( iec_obj obj ); // queue a command
+    int pullPoints( iec_obj *obj, int max ); // consumer of the point queue, see above
+    void setPointQueueSize( unsigned size ); // call before start
+    unsigned long long getPointsDropped(); // objects discarded because the point queue was full
+
 signals:
-    void signal_dataIndication( iec_obj *obj, int numpoints );
+    void signal_dataReady();
     void signal_interrogationActConfIndication();
     void signal_interrogationActTermIndication();
     void signal_tcp_connect();
     void signal_tcp_disconnect();
-    void signal_commandActConfIndication(iec_obj *obj);
-    void signal_commandActTermIndication(iec_obj *obj);
+    void signal_commandActConfIndication( iec_obj obj );
+    void signal_commandActTermIndication( iec_obj obj );
 
 public slots:
     void slot_tcpdisconnect(); // tcp disconnect for iec104
@@ -66,10 +86,20 @@ private slots:
     void slot_tcpconnect(); // tcp connect for iec104
     void slot_tcpreadytoread(); // ready to read data on iec104 tcp socket
     void slot_tcperror( QAbstractSocket::SocketError socketError ); // show errors of tcp
-    void slot_keep_alive(); // timer de 1s
+    void slot_timer_wheel(); // next protocol timer due
+    void slot_start();
+    void slot_stop();
+    void slot_solicitGI();
+    void slot_sendCommand( iec_obj obj );
+    void slot_disable_connect();
+    void slot_terminate();
 
 private:
     QThread tcpThread;
+    QTimer *tmWheel; // single shot, fires when the next timer of the wheel is due
+    void runTimers();
+    void scheduleTimers();
+    QTcpSocket *tcps; // socket for iec104 (tcp)
 
     // redefine for iec104_class
     void connectTCP();
@@ -81,8 +111,14 @@ private:
     void commandActConfIndication( iec_obj *obj );
     void commandActTermIndication( iec_obj *obj );
     void dataIndication(iec_obj *obj, int numpoints);
-    bool mEnding;
-    bool mAllowConnect;
+    std::atomic<bool> mEnding;
+    std::atomic<bool> mAllowConnect;
+    std::atomic<bool> mStarted;
+
+    TPointTable mPointTable; // last state of every point, written by the protocol thread, read by anyone
+    TSpscRing <iec_obj> mPoints; // decoded points from the protocol thread to the consumer
+    std::atomic<bool> mDataReadyPending; // signal_dataReady() emitted and not consumed yet
+    std::atomic<unsigned long long> mPointsDropped;
 };
 
 
@@ -0,0 +1,437 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include "reactor104.h"
+#include "inifile.h"
+
+using namespace std;
+
+TSession104::TSession104( TReactor104 * reactor, const string & name ) :
+    mReactor( reactor ), mOwner( reactor ), mAdopting( false ), mName( name ), mFd( -1 ), mGen( 0 ), mEvents( 0 ),
+    mConnecting( false ), mConnected( false ), mBroken( false ), mTxHead( 0 )
+{
+    // many sessions per process: small log rings, off until asked for
+    mLog.setMaxMsg( 64 );
+    mLog.deactivateLog();
+    setTimerWheel( reactor->getTimerWheel() );
+}
+
+TSession104::~TSession104()
+{
+    stopConnecting();
+    if ( mFd >= 0 )
+      close( mFd );
+}
+
+void TSession104::connectTCP()
+{
+    disconnectTCP();
+
+    if ( !mAdopting && mReactor->deferConnect( this ) )
+      return;
+
+    struct sockaddr_in addr;
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons( getPortTCP() );
+    if ( inet_pton( AF_INET, getSecondaryIP(), &addr.sin_addr ) != 1 )
+      {
+      mLog.pushMsg( "*** INVALID IP ADDRESS" );
+      return;
+      }
+
+    mFd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if ( mFd < 0 )
+      {
+      mLog.pushEvent( 0, "*** SOCKET ERROR %d", errno );
+      return;
+      }
+    int one = 1;
+    setsockopt( mFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+    if ( getLatencyStats() != NULL ) // kernel receive time of the data, for the first latency stage
+      {
+      int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+      setsockopt( mFd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof( flags ) );
+      }
+
+    if ( connect( mFd, (struct sockaddr *)&addr, sizeof( addr ) ) == 0 )
+      mConnecting = false;
+    else
+    if ( errno == EINPROGRESS )
+      mConnecting = true;
+    else
+      {
+      mLog.pushEvent( 0, "*** CONNECT ERROR %d", errno );
+      close( mFd );
+      mFd = -1;
+      return;
+      }
+
+    struct epoll_event ev;
+    ev.events = mEvents = mConnecting ? EPOLLOUT : EPOLLIN;
+    ev.data.ptr = this;
+    epoll_ctl( mReactor->mEpfd, EPOLL_CTL_ADD, mFd, &ev );
+
+    if ( !mConnecting )
+      {
+      mConnected = true;
+      onConnectTCP();
+      if ( mReactor->mSink )
+        mReactor->mSink->connectionIndication( this, true );
+      }
+}
+
+void TSession104::disconnectTCP()
+{
+    if ( mFd >= 0 )
+      {
+      epoll_ctl( mReactor->mEpfd, EPOLL_CTL_DEL, mFd, NULL );
+      close( mFd );
+      mFd = -1;
+      mGen.store( mGen.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+      }
+    mEvents = 0;
+    mConnecting = false;
+    mBroken = false;
+    mTxBuf.clear();
+    mTxHead = 0;
+    counters.txBuffered.set( 0 );
+
+    if ( mConnected )
+      {
+      mConnected = false;
+      onDisconnectTCP();
+      if ( mReactor->mSink )
+        mReactor->mSink->connectionIndication( this, false );
+      }
+}
+
+int TSession104::readTCP( char * buf, int szmax )
+{
+    if ( mFd < 0 || mBroken )
+      return 0;
+
+    ssize_t n;
+    if ( getLatencyStats() == NULL )
+      n = recv( mFd, buf, szmax, 0 );
+    else
+      { // with the time stamp of the data
+      struct iovec iov;
+      iov.iov_base = buf;
+      iov.iov_len = szmax;
+      union { // aligned for the struct cmsghdr the CMSG macros cast it to
+        char buf[CMSG_SPACE( sizeof( struct scm_timestamping ) )];
+        struct cmsghdr align;
+      } control;
+      struct msghdr msg;
+      memset( &msg, 0, sizeof( msg ) );
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control.buf;
+      msg.msg_controllen = sizeof( control.buf );
+      n = recvmsg( mFd, &msg, 0 );
+      for ( struct cmsghdr * c = CMSG_FIRSTHDR( &msg ); n > 0 && c != NULL; c = CMSG_NXTHDR( &msg, c ) )
+        if ( c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_TIMESTAMPING )
+          {
+          const struct scm_timestamping * ts = (const struct scm_timestamping *)CMSG_DATA( c );
+          setRxKernelTime( (long long)ts->ts[0].tv_sec * 1000000000 + ts->ts[0].tv_nsec );
+          }
+      }
+    if ( n > 0 )
+      return n;
+    if ( n == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) )
+      mBroken = true; // closed by the peer or error: disconnect when the event ends
+    return 0;
+}
+
+void TSession104::sendTCP( char * data, int sz )
+{
+    if ( mFd < 0 || !mConnected || mBroken )
+      return;
+
+    ssize_t n = 0;
+    if ( mTxHead == mTxBuf.size() ) // nothing waiting, else keep the order
+      {
+      n = send( mFd, data, sz, MSG_NOSIGNAL );
+      if ( n < 0 )
+        {
+        if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+          {
+          mBroken = true; // epoll will report the error, the connection is closed there
+          return;
+          }
+        n = 0;
+        }
+      }
+
+    if ( n < sz )
+      {
+      if ( mTxBuf.size() - mTxHead + sz - n > txbuf_max )
+        {
+        mLog.pushMsg( "*** SEND BUFFER OVERFLOW" );
+        mBroken = true;
+        return;
+        }
+      mTxBuf.insert( mTxBuf.end(), data + n, data + sz );
+      counters.txBuffered.set( mTxBuf.size() - mTxHead );
+      updateEvents();
+      }
+}
+
+void TSession104::flushTx()
+{
+    while ( mTxHead < mTxBuf.size() )
+      {
+      ssize_t n = send( mFd, &mTxBuf[mTxHead], mTxBuf.size() - mTxHead, MSG_NOSIGNAL );
+      if ( n < 0 )
+        {
+        if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+          mBroken = true;
+        break;
+        }
+      mTxHead += n;
+      }
+
+    if ( mTxHead == mTxBuf.size() )
+      {
+      mTxBuf.clear();
+      mTxHead = 0;
+      }
+    counters.txBuffered.set( mTxBuf.size() - mTxHead );
+    updateEvents();
+}
+
+void TSession104::updateEvents()
+{
+    if ( mFd < 0 )
+      return;
+
+    unsigned events = EPOLLOUT;
+    if ( !mConnecting )
+      events = ( mTxHead < mTxBuf.size() ) ? ( EPOLLIN | EPOLLOUT ) : EPOLLIN;
+    if ( events != mEvents )
+      {
+      struct epoll_event ev;
+      ev.events = mEvents = events;
+      ev.data.ptr = this;
+      epoll_ctl( mReactor->mEpfd, EPOLL_CTL_MOD, mFd, &ev );
+      }
+}
+
+void TSession104::onEvent( unsigned events )
+{
+    if ( mConnecting )
+      {
+      int err = 0;
+      socklen_t len = sizeof( err );
+      getsockopt( mFd, SOL_SOCKET, SO_ERROR, &err, &len );
+      if ( err != 0 )
+        {
+        mLog.pushEvent( 0, "*** CONNECT ERROR %d", err );
+        disconnectTCP(); // t0 retries
+        return;
+        }
+      mConnecting = false;
+      mConnected = true;
+      updateEvents();
+      onConnectTCP();
+      if ( mReactor->mSink )
+        mReactor->mSink->connectionIndication( this, true );
+      return;
+      }
+
+    if ( events & EPOLLOUT )
+      flushTx();
+
+    if ( events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) )
+      packetReadyTCP();
+
+    if ( mBroken || ( events & ( EPOLLHUP | EPOLLERR ) ) )
+      disconnectTCP();
+}
+
+void TSession104::dataIndication( iec_obj * obj, int numpoints )
+{
+    if ( mReactor->mSink )
+      mReactor->mSink->pointIndication( this, obj, numpoints );
+}
+
+TReactor104::TReactor104() : mSink( NULL ), mStop( false )
+{
+    mEpfd = epoll_create1( EPOLL_CLOEXEC );
+    mWakeFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // NULL is the wake up event
+    epoll_ctl( mEpfd, EPOLL_CTL_ADD, mWakeFd, &ev );
+}
+
+TReactor104::~TReactor104()
+{
+    for ( size_t i = 0; i < mSessions.size(); i++ )
+      delete mSessions[i];
+    close( mWakeFd );
+    close( mEpfd );
+}
+
+TSession104 * TReactor104::addSession( const string & name )
+{
+    TSession104 * s = new TSession104( this, name );
+    mSessions.push_back( s );
+    return s;
+}
+
+int TReactor104::loadIni( const char * filename )
+{
+    TIniFile ini;
+    if ( !ini.load( filename ) )
+      return -1;
+
+    int cnt = 0;
+    for ( int n = 1; ; n++ )
+      {
+      string sec = "RTU" + to_string( n );
+      if ( !ini.hasSection( sec ) )
+        break;
+      configureSession( addSession( sec ), ini, sec );
+      cnt++;
+      }
+
+    return cnt;
+}
+
+void TReactor104::configureSession( TSession104 * s, const TIniFile & ini, const string & sec )
+{
+    s->setPrimaryAddress( ini.intValue( "IEC104/PRIMARY_ADDRESS", 1 ) );
+    s->setSecondaryAddress( ini.intValue( sec + "/SECONDARY_ADDRESS", 1 ) );
+    string ip = ini.value( sec + "/IP_ADDRESS" );
+    s->setSecondaryIP( (char *)ip.c_str() );
+    s->setPortTCP( ini.intValue( sec + "/TCP_PORT", s->getPortTCP() ) );
+    s->setK( ini.intValue( sec + "/K", s->getK() ) );
+    s->setW( ini.intValue( sec + "/W", s->getW() ) );
+    s->setT0( ini.intValue( sec + "/T0", s->getT0() ) );
+    s->setT1( ini.intValue( sec + "/T1", s->getT1() ) );
+    s->setT2( ini.intValue( sec + "/T2", s->getT2() ) );
+    s->setT3( ini.intValue( sec + "/T3", s->getT3() ) );
+}
+
+void TReactor104::adopt( TSession104 * s )
+{
+    s->mReactor = this;
+    s->mOwner.store( this, std::memory_order_release );
+    s->setTimerWheel( &mWheel );
+    s->mAdopting = true;
+    s->startConnecting();
+    s->mAdopting = false;
+}
+
+void TReactor104::startAll()
+{
+    mWheel.advance( TTimerWheel::nowMs() );
+    for ( size_t i = 0; i < mSessions.size(); i++ )
+      mSessions[i]->startConnecting();
+}
+
+void TReactor104::runOnce( int maxwait_ms )
+{
+    struct epoll_event ev[maxEvents];
+
+    mWheel.advance( TTimerWheel::nowMs() );
+    int tmo = mWheel.nextExpiry();
+    if ( tmo < 0 || tmo > maxwait_ms )
+      tmo = maxwait_ms;
+
+    int n = epoll_wait( mEpfd, ev, maxEvents, tmo );
+
+    // the socket of each event, before anything can close it
+    unsigned gen[maxEvents];
+    for ( int i = 0; i < n; i++ )
+      if ( ev[i].data.ptr != NULL )
+        gen[i] = ( (TSession104 *)ev[i].data.ptr )->mGen.load( std::memory_order_relaxed );
+
+    // timers first: they also bring the wheel to now, so timers started by the events are exact
+    mWheel.advance( TTimerWheel::nowMs() );
+
+    int handled = 0;
+    for ( int i = 0; i < n; i++ )
+      {
+      if ( ev[i].data.ptr == NULL )
+        {
+        uint64_t v;
+        if ( read( mWakeFd, &v, sizeof( v ) ) < 0 )
+          {} // nothing pending
+        continue;
+        }
+      TSession104 * s = (TSession104 *)ev[i].data.ptr;
+      // the socket was closed since epoll_wait (t0 reconnect, t1, an earlier event): the event is not for the
+      // current socket, which may even be connecting in another reactor of a pool
+      if ( s->mGen.load( std::memory_order_relaxed ) != gen[i] )
+        continue;
+      s->onEvent( ev[i].events );
+      handled++;
+      }
+
+    onLoop( handled );
+    if ( mSink )
+      mSink->flush();
+}
+
+void TReactor104::run()
+{
+    // a stop() made before run() is not lost
+    while ( !mStop )
+      runOnce( 1000 );
+    mStop = false;
+}
+
+void TReactor104::stop()
+{
+    mStop = true;
+    wake();
+}
+
+void TReactor104::wake()
+{
+    uint64_t v = 1;
+    if ( write( mWakeFd, &v, sizeof( v ) ) < 0 )
+      {} // counter full: already woken
+}
@@ -0,0 +1,152 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef REACTOR104_H
+#define REACTOR104_H
+
+// Headless multi RTU master: one epoll loop drives many iec104_class sessions over nonblocking sockets.
+// All sessions of a reactor share its timer wheel, the loop sleeps in epoll_wait until the next socket
+// event or the next protocol timer. Everything runs in the thread that calls run(), only stop() may be
+// called from another thread.
+// Linux only (epoll, eventfd).
+// A session is run by one reactor at a time (its owner); a disconnected session may be adopted by another
+// reactor, see TReactorPool.
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "iec104_class.h"
+#include "timerwheel.h"
+
+class TReactor104;
+class TSession104;
+class TIniFile;
+
+// receives what the sessions of a reactor decode, called in the reactor thread
+class TPointSink
+{
+public:
+    virtual ~TPointSink() {}
+    // obj is valid only during the call (see iec104_class::dataIndication)
+    virtual void pointIndication( TSession104 * session, iec_obj * obj, int numpoints ) = 0;
+    virtual void connectionIndication( TSession104 * /*session*/, bool /*connected*/ ) {}
+    // after the events of each wakeup of the reactor: send what pointIndication buffered
+    virtual void flush() {}
+};
+
+class TSession104 : public iec104_class
+{
+public:
+    TSession104( TReactor104 * reactor, const std::string & name );
+    ~TSession104();
+    const std::string & getName() { return mName; }
+    bool isConnected() { return mConnected; }
+    TReactor104 * getReactor() { return mOwner.load( std::memory_order_acquire ); } // owner, may be read from any thread
+
+private:
+    friend class TReactor104;
+
+    // redefine for iec104_class
+    void connectTCP();
+    void disconnectTCP();
+    int readTCP( char * buf, int szmax );
+    void sendTCP( char * data, int sz );
+    void dataIndication( iec_obj * obj, int numpoints );
+
+    void onEvent( unsigned events ); // epoll events of the socket
+    void updateEvents(); // wait for writable only while connecting or with data to send
+    void flushTx();
+
+    static const size_t txbuf_max = 1 << 20; // peer not reading for this long: drop the connection
+
+    TReactor104 * mReactor; // owner, written only on adoption
+    std::atomic<TReactor104 *> mOwner; // copy of mReactor for other threads
+    bool mAdopting; // adopt() in progress: connect here, don't defer
+    std::string mName;
+    int mFd;
+    std::atomic<unsigned> mGen; // incremented when the socket is closed, see TReactor104::runOnce
+    unsigned mEvents; // registered epoll events
+    bool mConnecting; // nonblocking connect in progress
+    bool mConnected;
+    bool mBroken; // socket error or closed by the peer, disconnect after the current event
+    std::vector <char> mTxBuf; // data the socket did not accept yet
+    size_t mTxHead;
+};
+
+class TReactor104
+{
+public:
+    TReactor104();
+    virtual ~TReactor104();
+
+    // creates a session for each section [RTU1] .. [RTUn] of the file (stops at the first missing one),
+    // with the keys of qtester104.ini; returns the number of sessions created or -1 if the file can't be read
+    int loadIni( const char * filename );
+    TSession104 * addSession( const std::string & name );
+    int sessionCount() { return (int)mSessions.size(); }
+    TSession104 * session( int i ) { return mSessions[i]; }
+    void setPointSink( TPointSink * sink ) { mSink = sink; }
+    TPointSink * getPointSink() { return mSink; }
+    TTimerWheel * getTimerWheel() { return &mWheel; }
+
+    void startAll(); // all sessions start connecting
+    void run(); // loop until stop()
+    void runOnce( int maxwait_ms ); // wait at most maxwait_ms for events and process them
+    void stop(); // thread safe
+    void wake(); // thread safe, makes epoll_wait return
+
+    // sets the parameters of a session from the section of an ini file (keys of qtester104.ini)
+    static void configureSession( TSession104 * s, const TIniFile & ini, const std::string & section );
+
+protected:
+    // make this reactor the owner of a disconnected session that no reactor is running, and start connecting it
+    void adopt( TSession104 * s );
+    // a session wants to connect: return true to take over the attempt (the session stops its t0 timer and
+    // waits to be adopted), false to connect now in this reactor
+    virtual bool deferConnect( TSession104 * /*s*/ ) { return false; }
+    // called in the loop after processing the events of each epoll_wait; nevents counts the socket events
+    // handled (not the wake ups), 0 when only timers or a wake() ran
+    virtual void onLoop( int /*nevents*/ ) {}
+
+private:
+    friend class TSession104;
+
+    TReactor104( const TReactor104 & );
+    TReactor104 & operator=( const TReactor104 & );
+
+    static const int maxEvents = 256;
+    int mEpfd;
+    int mWakeFd; // eventfd to wake epoll_wait
+    TTimerWheel mWheel;
+    std::vector <TSession104 *> mSessions;
+    TPointSink * mSink;
+    std::atomic<bool> mStop;
+};
+
+#endif // REACTOR104_H
@@ -0,0 +1,40 @@
+# -------------------------------------------------
+# Headless IEC 60870-5-104 master: protocol, timer wheel, the epoll reactor and its thread pool (Linux only)
+# include( ../reactor104.pri ) from a project that does not need Qt
+# -------------------------------------------------
+INCLUDEPATH += $$PWD
+SOURCES += $$PWD/iec104_class.cpp \
+    $$PWD/logmsg.cpp \
+    $$PWD/alloccnt.cpp \
+    $$PWD/timerwheel.cpp \
+    $$PWD/pointtable.cpp \
+    $$PWD/squnpack.cpp \
+    $$PWD/cp56time.cpp \
+    $$PWD/apdurec.cpp \
+    $$PWD/latency.cpp \
+    $$PWD/metrics.cpp \
+    $$PWD/metricsrv.cpp \
+    $$PWD/inifile.cpp \
+    $$PWD/reactor104.cpp \
+    $$PWD/reactorpool.cpp \
+    $$PWD/bdtrfwd.cpp
+HEADERS += $$PWD/iec104_types.h \
+    $$PWD/iec104_class.h \
+    $$PWD/logmsg.h \
+    $$PWD/alloccnt.h \
+    $$PWD/spscring.h \
+    $$PWD/timerwheel.h \
+    $$PWD/pointtable.h \
+    $$PWD/squnpack.h \
+    $$PWD/cp56time.h \
+    $$PWD/apdurec.h \
+    $$PWD/latency.h \
+    $$PWD/metrics.h \
+    $$PWD/metricsrv.h \
+    $$PWD/inifile.h \
+    $$PWD/reactor104.h \
+    $$PWD/reactorpool.h \
+    $$PWD/bdtrfwd.h \
+    $$PWD/bdtr.h
+QMAKE_CXXFLAGS += -pthread
+LIBS += -pthread
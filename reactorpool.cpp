@@ -0,0 +1,253 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include "reactorpool.h"
+#include "inifile.h"
+
+using namespace std;
+
+void TWorker104::push( const TJob104 & job )
+{
+    {
+    lock_guard <mutex> lock( mMutex );
+    mJobs.push_back( job );
+    mQueued = (int)mJobs.size();
+    }
+    wake();
+}
+
+bool TWorker104::steal( TJob104 & job )
+{
+    lock_guard <mutex> lock( mMutex );
+    // only connection attempts move, a GI stays with the owner of the session
+    for ( deque <TJob104>::reverse_iterator it = mJobs.rbegin(); it != mJobs.rend(); ++it )
+      if ( it->type == TJob104::CONNECT )
+        {
+        job = *it;
+        mJobs.erase( ( ++it ).base() );
+        mQueued = (int)mJobs.size();
+        return true;
+        }
+    return false;
+}
+
+// the session gives up its timer and waits in the queue, whoever runs the job becomes the owner
+bool TWorker104::deferConnect( TSession104 * s )
+{
+    s->stopConnecting();
+    TJob104 job;
+    job.type = TJob104::CONNECT;
+    job.session = s;
+    {
+    lock_guard <mutex> lock( mMutex );
+    mJobs.push_back( job );
+    mQueued = (int)mJobs.size();
+    }
+    if ( mQueued > 1 )
+      mPool->wakeHelper( this );
+    return true;
+}
+
+void TWorker104::runJob( const TJob104 & job )
+{
+    switch ( job.type )
+    {
+    case TJob104::CONNECT:
+        adopt( job.session );
+        break;
+    case TJob104::GI:
+        // the session may have moved while the job waited: GI only where it is connected now
+        if ( job.session->getReactor() == this && job.session->isConnected() )
+          job.session->solicitGI();
+        break;
+    }
+}
+
+void TWorker104::onLoop( int nevents )
+{
+    // own jobs, only those queued before now: a connect that fails at once queues again
+    int n = mQueued;
+    while ( n-- > 0 )
+      {
+      TJob104 job;
+      {
+      lock_guard <mutex> lock( mMutex );
+      if ( mJobs.empty() )
+        break;
+      job = mJobs.front();
+      mJobs.pop_front();
+      mQueued = (int)mJobs.size();
+      }
+      runJob( job );
+      }
+
+    // nothing to do here, no queued job and no socket ready in this wakeup: help the busiest worker.
+    // A worker whose sockets keep it busy does not steal, even with an empty queue.
+    TJob104 job;
+    if ( mQueued == 0 && nevents == 0 && mPool->stealFor( this, job ) )
+      runJob( job );
+}
+
+TReactorPool::TReactorPool( int nworkers ) : mNextHelper( 0 ), mStolen( 0 ), mNextWorker( 0 )
+{
+    cpu_set_t allowed;
+    if ( nworkers <= 0 && sched_getaffinity( 0, sizeof( allowed ), &allowed ) == 0 )
+      nworkers = CPU_COUNT( &allowed ); // one per cpu the process may run on
+    if ( nworkers <= 0 )
+      nworkers = thread::hardware_concurrency();
+    if ( nworkers <= 0 )
+      nworkers = 1;
+    for ( int i = 0; i < nworkers; i++ )
+      mWorkers.push_back( new TWorker104( this, i ) );
+}
+
+TReactorPool::~TReactorPool()
+{
+    stop();
+    // sessions first, they stop their timers in the wheels of the workers
+    for ( size_t i = 0; i < mSessions.size(); i++ )
+      delete mSessions[i];
+    for ( size_t i = 0; i < mWorkers.size(); i++ )
+      delete mWorkers[i];
+}
+
+TSession104 * TReactorPool::addSession( const string & name )
+{
+    TSession104 * s = new TSession104( mWorkers[mNextWorker], name );
+    mNextWorker = ( mNextWorker + 1 ) % mWorkers.size();
+    mSessions.push_back( s );
+    return s;
+}
+
+int TReactorPool::loadIni( const char * filename )
+{
+    TIniFile ini;
+    if ( !ini.load( filename ) )
+      return -1;
+
+    int cnt = 0;
+    for ( int n = 1; ; n++ )
+      {
+      string sec = "RTU" + to_string( n );
+      if ( !ini.hasSection( sec ) )
+        break;
+      TReactor104::configureSession( addSession( sec ), ini, sec );
+      cnt++;
+      }
+
+    return cnt;
+}
+
+void TReactorPool::setPointSink( TPointSink * sink )
+{
+    for ( size_t i = 0; i < mWorkers.size(); i++ )
+      mWorkers[i]->setPointSink( sink );
+}
+
+void TReactorPool::start()
+{
+    if ( !mThreads.empty() )
+      return;
+
+    // first connection of each session: a job of its initial owner
+    for ( size_t i = 0; i < mSessions.size(); i++ )
+      {
+      TJob104 job;
+      job.type = TJob104::CONNECT;
+      job.session = mSessions[i];
+      static_cast <TWorker104 *>( mSessions[i]->getReactor() )->push( job );
+      }
+
+    // pin to the cpus the process may use (taskset, cgroup cpusets), not to cpus 0..n-1
+    vector <int> cpuList;
+    cpu_set_t allowed;
+    CPU_ZERO( &allowed );
+    if ( sched_getaffinity( 0, sizeof( allowed ), &allowed ) == 0 )
+      for ( int c = 0; c < CPU_SETSIZE; c++ )
+        if ( CPU_ISSET( c, &allowed ) )
+          cpuList.push_back( c );
+
+    for ( size_t i = 0; i < mWorkers.size(); i++ )
+      {
+      mThreads.push_back( thread( &TReactor104::run, mWorkers[i] ) );
+      if ( !cpuList.empty() )
+        {
+        cpu_set_t cpus;
+        CPU_ZERO( &cpus );
+        CPU_SET( cpuList[i % cpuList.size()], &cpus );
+        pthread_setaffinity_np( mThreads.back().native_handle(), sizeof( cpus ), &cpus );
+        }
+      }
+}
+
+void TReactorPool::stop()
+{
+    for ( size_t i = 0; i < mWorkers.size(); i++ )
+      mWorkers[i]->stop();
+    for ( size_t i = 0; i < mThreads.size(); i++ )
+      mThreads[i].join();
+    mThreads.clear();
+}
+
+void TReactorPool::requestGI( TSession104 * s )
+{
+    TJob104 job;
+    job.type = TJob104::GI;
+    job.session = s;
+    static_cast <TWorker104 *>( s->getReactor() )->push( job );
+}
+
+void TReactorPool::wakeHelper( TWorker104 * busy )
+{
+    if ( mWorkers.size() < 2 )
+      return;
+    unsigned i = mNextHelper++ % mWorkers.size();
+    if ( mWorkers[i] == busy )
+      i = ( i + 1 ) % mWorkers.size();
+    mWorkers[i]->wake();
+}
+
+bool TReactorPool::stealFor( TWorker104 * thief, TJob104 & job )
+{
+    TWorker104 * victim = NULL;
+    int most = 0;
+    for ( size_t i = 0; i < mWorkers.size(); i++ )
+      if ( mWorkers[i] != thief && mWorkers[i]->queued() > most )
+        {
+        most = mWorkers[i]->queued();
+        victim = mWorkers[i];
+        }
+
+    if ( victim == NULL || !victim->steal( job ) )
+      return false;
+    mStolen++;
+    return true;
+}
@@ -0,0 +1,116 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef REACTORPOOL_H
+#define REACTORPOOL_H
+
+// Pool of reactor threads pinned to cores, sessions are spread among them.
+// A session is owned by one worker, which runs its socket, decoding and timers. Every connection attempt
+// (the first one and the t0 retries) is a job in the owner's queue: the owner takes jobs from the front,
+// idle workers steal from the back of the busiest queue and become the new owner of the session.
+// A session can only change owner while it is disconnected, when no timer nor socket refers to it.
+// Linux only.
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "reactor104.h"
+
+class TReactorPool;
+
+struct TJob104 {
+    enum { CONNECT, GI };
+    int type;
+    TSession104 * session;
+};
+
+class TWorker104 : public TReactor104
+{
+public:
+    TWorker104( TReactorPool * pool, int index ) : mPool( pool ), mIndex( index ), mQueued( 0 ) {}
+    void push( const TJob104 & job ); // any thread
+    int queued() { return mQueued; }
+    bool steal( TJob104 & job ); // take the newest job, called by another worker
+
+protected:
+    bool deferConnect( TSession104 * s );
+    void onLoop( int nevents );
+
+private:
+    friend class TReactorPool;
+    void runJob( const TJob104 & job );
+
+    TReactorPool * mPool;
+    int mIndex;
+    std::mutex mMutex;
+    std::deque <TJob104> mJobs;
+    std::atomic<int> mQueued;
+};
+
+class TReactorPool
+{
+public:
+    TReactorPool( int nworkers = 0 ); // 0 = one worker per cpu of the process affinity mask
+    ~TReactorPool();
+
+    // creates the sessions of [RTU1] .. [RTUn] spread among the workers, see TReactor104::loadIni
+    int loadIni( const char * filename );
+    TSession104 * addSession( const std::string & name );
+    int sessionCount() { return (int)mSessions.size(); }
+    TSession104 * session( int i ) { return mSessions[i]; }
+    int workerCount() { return (int)mWorkers.size(); }
+    TWorker104 * worker( int i ) { return mWorkers[i]; }
+    // called by all workers at the same time: the sink must be thread safe (or set one per worker)
+    void setPointSink( TPointSink * sink );
+
+    void start(); // start the worker threads, all sessions start connecting
+    void stop(); // stop and join the workers
+    void requestGI( TSession104 * s ); // any thread, done by the owner of the session
+    unsigned long long stolenCount() { return mStolen; }
+
+private:
+    friend class TWorker104;
+
+    TReactorPool( const TReactorPool & );
+    TReactorPool & operator=( const TReactorPool & );
+
+    void wakeHelper( TWorker104 * busy ); // wake another worker to steal from a busy one
+    bool stealFor( TWorker104 * thief, TJob104 & job );
+
+    std::vector <TWorker104 *> mWorkers;
+    std::vector <std::thread> mThreads;
+    std::vector <TSession104 *> mSessions;
+    std::atomic<unsigned> mNextHelper;
+    std::atomic<unsigned long long> mStolen;
+    int mNextWorker; // round robin for new sessions
+};
+
+#endif // REACTORPOOL_H
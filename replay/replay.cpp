@@ -0,0 +1,175 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+// Feeds the APDUs received from the RTUs in a capture (see apdurec.h) back through iec104_class::parseAPDU,
+// one decoder per TCP connection of the capture, at maximum speed (a throughput benchmark of the field traffic)
+// or at the original pace (-r). The capture is loaded in memory first, so only decoding is timed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "iec104_class.h"
+#include "apdurec.h"
+
+using namespace std;
+
+class TReplaySession : public iec104_class
+{
+public:
+    TReplaySession() : objects( 0 ) { mLog.deactivateLog(); }
+    void decode( const iec_apdu * papdu, int sz ) { parseAPDU( papdu, sz, false ); }
+    unsigned long long objects;
+private:
+    void connectTCP() {}
+    void disconnectTCP() {}
+    int readTCP( char *, int ) { return 0; }
+    void sendTCP( char *, int ) {}
+    void dataIndication( iec_obj *, int numpoints ) { objects += numpoints; }
+};
+
+struct TReplayFrame {
+    unsigned session;
+    long long timeNs;
+    size_t offset; // in the data of all frames
+    int sz;
+};
+
+static long long steadyNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+int main( int argc, char * argv[] )
+{
+    bool realtime = false;
+    int loops = 1;
+    const char * filename = NULL;
+    for ( int i = 1; i < argc; i++ )
+      {
+      if ( strcmp( argv[i], "-r" ) == 0 )
+        realtime = true;
+      else if ( strcmp( argv[i], "-n" ) == 0 && i + 1 < argc )
+        loops = atoi( argv[++i] );
+      else
+        filename = argv[i];
+      }
+    if ( filename == NULL || loops < 1 )
+      {
+      printf( "replay104 [-r] [-n loops] capture.pcap\n"
+              "  -r   original pace (default: as fast as possible)\n"
+              "  -n   times the capture is replayed (1)\n" );
+      return 1;
+      }
+
+    TApduReader rd;
+    if ( !rd.open( filename ) )
+      {
+      fprintf( stderr, "%s is not a pcap capture of a supported link type\n", filename );
+      return 1;
+      }
+
+    // frames from the RTUs, the common address of each connection from its first asdu
+    vector <unsigned char> data;
+    vector <TReplayFrame> frames;
+    vector <int> ca;
+    unsigned long long sent = 0;
+    TApduFrame f;
+    while ( rd.next( f ) )
+      {
+      if ( f.dir != TApduRecorder::RX )
+        {
+        sent++;
+        continue;
+        }
+      if ( f.session >= ca.size() )
+        ca.resize( f.session + 1, -1 );
+      if ( ca[f.session] < 0 && f.sz > 6 + 4 && ( f.data[2] & 1 ) == 0 )
+        ca[f.session] = f.data[10] | f.data[11] << 8;
+      TReplayFrame rf;
+      rf.session = f.session;
+      rf.timeNs = f.timeNs;
+      rf.offset = data.size();
+      rf.sz = f.sz;
+      data.insert( data.end(), f.data, f.data + f.sz );
+      frames.push_back( rf );
+      }
+    if ( frames.empty() )
+      {
+      fprintf( stderr, "no APDU received from an RTU in %s\n", filename );
+      return 1;
+      }
+    // slack after the last frame: a frame is viewed as a whole iec_apdu
+    data.resize( data.size() + sizeof( iec_apdu ) );
+
+    vector <TReplaySession *> sessions( ca.size() );
+    for ( size_t s = 0; s < sessions.size(); s++ )
+      {
+      sessions[s] = new TReplaySession();
+      sessions[s]->setSecondaryAddress( ca[s] < 0 ? 1 : ca[s] );
+      }
+
+    printf( "%s: %zu connections, %zu APDUs received, %llu sent, %llu skipped\n", filename, sessions.size(),
+            frames.size(), sent, rd.getSkipped() );
+
+    long long t0 = steadyNs();
+    for ( int l = 0; l < loops; l++ )
+      {
+      long long start = steadyNs();
+      for ( size_t i = 0; i < frames.size(); i++ )
+        {
+        const TReplayFrame & rf = frames[i];
+        if ( realtime )
+          {
+          long long due = start + ( rf.timeNs - frames[0].timeNs );
+          long long wait = due - steadyNs();
+          if ( wait > 0 )
+            std::this_thread::sleep_for( std::chrono::nanoseconds( wait ) );
+          }
+        sessions[rf.session]->decode( (const iec_apdu *)&data[rf.offset], rf.sz );
+        }
+      }
+    long long ns = steadyNs() - t0;
+
+    unsigned long long objects = 0, asdus = 0;
+    for ( size_t s = 0; s < sessions.size(); s++ )
+      {
+      objects += sessions[s]->objects;
+      asdus += sessions[s]->getDecodedAsduCount();
+      delete sessions[s];
+      }
+    double sec = ns / 1e9;
+    printf( "%d x: %llu asdus, %llu objects in %.3f s: %.0f APDU/s, %.0f objects/s, %.1f ns/object\n",
+            loops, asdus, objects, sec, frames.size() * loops / sec, objects / sec,
+            objects ? (double)ns / objects : 0.0 );
+    return 0;
+}
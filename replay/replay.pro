@@ -0,0 +1,9 @@
+# -------------------------------------------------
+# Replay of IEC104 captures through the decoder (no Qt), run ./replay104 [-r] [-n loops] capture.pcap
+# -------------------------------------------------
+TEMPLATE = app
+TARGET = replay104
+CONFIG += console
+CONFIG -= qt app_bundle
+include( ../reactor104.pri )
+SOURCES += replay.cpp
@@ -0,0 +1,759 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+// Loopback IEC 60870-5-104 slave for load testing the master on one box.
+// Listens on localhost and serves any number of masters, each one as an independent RTU: answers STARTDT,
+// STOPDT and TESTFR, confirms GI (then sends every point with cause 20 and the termination) and commands,
+// and streams spontaneous traffic of the configured types at the configured rate, in sequenced (SQ) or
+// addressed ASDUs, steady or in bursts. Frames are sent only inside the k window of the master.
+// Every interval it prints the objects/s sent and the ack latency: time from queuing an I-frame until the
+// master acknowledges it (so it includes the w / t2 acknowledge policy of the master).
+// Linux only (epoll).
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+#include "iec104_types.h"
+#include "cp56time.h"
+
+using namespace std;
+
+struct TSimConfig {
+    unsigned short port;
+    unsigned short ca;
+    vector <unsigned char> types; // ASDUs cycle through these types
+    int points; // per type
+    double rate; // spontaneous objects/s per connection, 0 = as fast as the k window allows
+    int burst; // objects released at once every burst/rate seconds, 0 = steady flow
+    bool sq;
+    int k;
+    double interval; // report, s
+    double duration; // s, 0 = until interrupted
+};
+
+static TSimConfig cfg;
+static volatile sig_atomic_t stopRequested = 0;
+
+static const int MaxAsdu = 249; // 253 bytes of apdu after the length minus the control field
+static const int AsduHeader = 6; // type, vsq, cause, originator, 2 bytes common address
+static const int SeqMod = 32768;
+
+enum { COT_SPONT = 3, COT_ACT = 6, COT_ACTCON = 7, COT_DEACT = 8, COT_DEACTCON = 9, COT_ACTTERM = 10,
+       COT_INROGEN = 20, COT_UNKNOWN_TYPE = 44, COT_NEGATIVE = 0x40 };
+
+// totals of all connections, reset every report
+struct TSimStats {
+    unsigned long long objects;
+    unsigned long long asdus;
+    unsigned long long behind; // objects of the offered rate that could not be sent (window or socket full)
+    unsigned long long commands;
+    vector <int> latency; // us
+};
+static TSimStats stats;
+
+static long long monoUs()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// bytes of an information element, without its address
+static int elementSize( unsigned char type )
+{
+    switch ( type )
+      {
+      case 1: case 3: return 1;
+      case 9: case 11: return 3;
+      case 13: return 5;
+      case 30: case 31: return 8;
+      case 34: case 35: return 10;
+      case 36: return 12;
+      }
+    return 0;
+}
+
+static int maxObjects( unsigned char type, bool sq )
+{
+    int room = MaxAsdu - AsduHeader;
+    int n = sq ? ( room - 3 ) / elementSize( type ) : room / ( 3 + elementSize( type ) );
+    return n > 127 ? 127 : n;
+}
+
+// information element of point i of a generated value v
+static unsigned char * putElement( unsigned char * p, unsigned char type, unsigned v, const cp56time2a & t )
+{
+    switch ( type )
+      {
+      case 1: case 30:
+        *p++ = v & 1;
+        break;
+      case 3: case 31:
+        *p++ = 1 + ( v & 1 );
+        break;
+      case 9: case 11: case 34: case 35:
+        {
+        unsigned short mv = ( type == 9 || type == 34 ) ? ( v * 37 ) & 0x7FFF : v & 0x7FFF;
+        memcpy( p, &mv, 2 );
+        p[2] = 0;
+        p += 3;
+        }
+        break;
+      case 13: case 36:
+        {
+        float f = ( v % 10000 ) * 0.1f;
+        memcpy( p, &f, 4 );
+        p[4] = 0;
+        p += 5;
+        }
+        break;
+      }
+    if ( type >= 30 )
+      {
+      memcpy( p, &t, 7 );
+      p += 7;
+      }
+    return p;
+}
+
+class TSimConn
+{
+public:
+    TSimConn( int fd ) : mFd( fd ), mStarted( false ), mVS( 0 ), mVR( 0 ), mAck( 0 ), mRxUnack( 0 ), mTxHead( 0 ),
+        mEvents( EPOLLIN ), mGiNext( -1 ), mCredits( 0 ), mNextBurstUs( 0 ), mLastUs( monoUs() ), mCursor( 0 ),
+        mTypeIdx( 0 ), mGen( 0 ), mSentUs( SeqMod )
+        {}
+    ~TSimConn() { close( mFd ); }
+
+    int fd() { return mFd; }
+    bool onEvent( unsigned events, int epfd ); // false: connection to be closed
+    void pump( long long now ); // send what the window allows
+    void updateEvents( int epfd );
+
+private:
+    bool onFrame( const unsigned char * f, int len, long long now );
+    bool ackReceived( unsigned short nr, long long now );
+    void onAsdu( const unsigned char * a, int len );
+    void sendU( unsigned char ctrl );
+    void sendS();
+    void sendI( const unsigned char * asdu, int len, long long now );
+    bool windowOpen() { return ( ( mVS - mAck ) & ( SeqMod - 1 ) ) < cfg.k && mTx.size() - mTxHead < 65536; }
+    int buildGI( unsigned char * a );
+    int buildSpont( unsigned char * a, int maxobj );
+    bool flushTx();
+
+    int mFd;
+    bool mStarted; // STARTDT received
+    unsigned short mVS; // next N(S)
+    unsigned short mVR; // next expected N(S) from the master
+    unsigned short mAck; // oldest N(S) not acknowledged by the master
+    int mRxUnack;
+    vector <unsigned char> mRx;
+    vector <unsigned char> mTx;
+    size_t mTxHead;
+    unsigned mEvents;
+    deque <string> mCtrl; // confirmations, sent before any data
+    int mGiNext; // next point of the running GI, -1 = none
+    double mCredits; // spontaneous objects that may be sent now
+    long long mNextBurstUs;
+    long long mLastUs;
+    unsigned mCursor; // next point of the spontaneous flow
+    unsigned mTypeIdx;
+    unsigned mGen; // changes the values from one ASDU to the next
+    vector <long long> mSentUs; // queue time of each N(S)
+    TCp56Time mCp56;
+};
+
+bool TSimConn::onEvent( unsigned events, int epfd )
+{
+    long long now = monoUs();
+
+    if ( events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) )
+      {
+      unsigned char buf[65536];
+      for ( ;; )
+        {
+        ssize_t n = read( mFd, buf, sizeof( buf ) );
+        if ( n == 0 )
+          return false;
+        if ( n < 0 )
+          {
+          if ( errno == EAGAIN || errno == EWOULDBLOCK )
+            break;
+          if ( errno == EINTR )
+            continue;
+          return false;
+          }
+        mRx.insert( mRx.end(), buf, buf + n );
+        }
+
+      size_t pos = 0;
+      while ( mRx.size() - pos >= 2 )
+        {
+        if ( mRx[pos] != 0x68 || mRx[pos + 1] < 4 )
+          {
+          fprintf( stderr, "framing error, closing\n" );
+          return false;
+          }
+        int len = mRx[pos + 1];
+        if ( mRx.size() - pos < (size_t)len + 2 )
+          break;
+        if ( !onFrame( &mRx[pos + 2], len, now ) )
+          return false;
+        pos += len + 2;
+        }
+      mRx.erase( mRx.begin(), mRx.begin() + pos );
+      }
+
+    pump( now );
+    if ( mRxUnack > 0 ) // nothing to piggyback the ack on
+      sendS();
+    if ( !flushTx() )
+      return false;
+    updateEvents( epfd );
+    return true;
+}
+
+bool TSimConn::onFrame( const unsigned char * f, int len, long long now )
+{
+    if ( ( f[0] & 1 ) == 0 ) // I
+      {
+      unsigned short ns = ( f[0] | f[1] << 8 ) >> 1;
+      if ( ns != mVR )
+        {
+        fprintf( stderr, "sequence error, closing\n" );
+        return false;
+        }
+      mVR = ( mVR + 1 ) & ( SeqMod - 1 );
+      mRxUnack++;
+      if ( !ackReceived( ( f[2] | f[3] << 8 ) >> 1, now ) )
+        return false;
+      if ( len > 4 + AsduHeader )
+        onAsdu( f + 4, len - 4 );
+      return true;
+      }
+
+    if ( f[0] == 0x01 ) // S
+      return ackReceived( ( f[2] | f[3] << 8 ) >> 1, now );
+
+    switch ( f[0] ) // U
+      {
+      case 0x07: // STARTDT act
+        mStarted = true;
+        mLastUs = now;
+        mNextBurstUs = now;
+        sendU( 0x0B );
+        break;
+      case 0x13: // STOPDT act
+        mStarted = false;
+        sendU( 0x23 );
+        break;
+      case 0x43: // TESTFR act
+        sendU( 0x83 );
+        break;
+      }
+    return true;
+}
+
+bool TSimConn::ackReceived( unsigned short nr, long long now )
+{
+    if ( ( ( nr - mAck ) & ( SeqMod - 1 ) ) > ( ( mVS - mAck ) & ( SeqMod - 1 ) ) )
+      {
+      fprintf( stderr, "ack of a frame not sent, closing\n" );
+      return false;
+      }
+    for ( ; mAck != nr; mAck = ( mAck + 1 ) & ( SeqMod - 1 ) )
+      stats.latency.push_back( (int)( now - mSentUs[mAck] ) );
+    return true;
+}
+
+// answer to a control direction ASDU
+void TSimConn::onAsdu( const unsigned char * a, int len )
+{
+    string r( (const char *)a, len );
+    unsigned char type = a[0];
+    unsigned char cause = a[2] & 0x3F;
+
+    if ( type < 45 || type > 127 )
+      {
+      r[2] = (char)( COT_UNKNOWN_TYPE | COT_NEGATIVE );
+      mCtrl.push_back( r );
+      return;
+      }
+
+    stats.commands++;
+    if ( cause == COT_DEACT )
+      {
+      r[2] = COT_DEACTCON;
+      mCtrl.push_back( r );
+      return;
+      }
+    if ( cause != COT_ACT )
+      return;
+
+    r[2] = COT_ACTCON;
+    mCtrl.push_back( r );
+
+    // qualifier of the command: its S/E bit tells a select from an execute
+    bool select = false;
+    int q = AsduHeader + 3;
+    switch ( type )
+      {
+      case 48: case 49: case 61: case 62: q += 2; break;
+      case 50: case 63: q += 4; break;
+      }
+    if ( ( type >= 45 && type <= 50 ) || ( type >= 58 && type <= 63 ) )
+      select = q < len && ( a[q] & 0x80 );
+
+    if ( type == 100 ) // GI: the points come between the confirmation and the termination
+      {
+      mGiNext = 0;
+      return;
+      }
+    if ( !select && ( type <= 51 || ( type >= 58 && type <= 64 ) || type == 101 ) )
+      {
+      r[2] = COT_ACTTERM;
+      mCtrl.push_back( r );
+      }
+}
+
+void TSimConn::sendU( unsigned char ctrl )
+{
+    unsigned char f[6] = { 0x68, 4, ctrl, 0, 0, 0 };
+    mTx.insert( mTx.end(), f, f + 6 );
+}
+
+void TSimConn::sendS()
+{
+    unsigned char f[6] = { 0x68, 4, 0x01, 0, (unsigned char)( mVR << 1 ), (unsigned char)( mVR >> 7 ) };
+    mTx.insert( mTx.end(), f, f + 6 );
+    mRxUnack = 0;
+}
+
+void TSimConn::sendI( const unsigned char * asdu, int len, long long now )
+{
+    unsigned char h[6] = { 0x68, (unsigned char)( len + 4 ),
+                           (unsigned char)( mVS << 1 ), (unsigned char)( mVS >> 7 ),
+                           (unsigned char)( mVR << 1 ), (unsigned char)( mVR >> 7 ) };
+    mTx.insert( mTx.end(), h, h + 6 );
+    mTx.insert( mTx.end(), asdu, asdu + len );
+    mSentUs[mVS] = now;
+    mVS = ( mVS + 1 ) & ( SeqMod - 1 );
+    mRxUnack = 0;
+}
+
+// the next ASDU of the GI, all the points of every type, cause 20
+int TSimConn::buildGI( unsigned char * a )
+{
+    unsigned t = mGiNext / cfg.points;
+    unsigned i = mGiNext % cfg.points;
+    unsigned char type = cfg.types[t];
+    int n = min( maxObjects( type, cfg.sq ), cfg.points - (int)i );
+    cp56time2a ts;
+    if ( type >= 30 )
+      mCp56.localNow( ts );
+
+    unsigned ioa = t * cfg.points + i + 1;
+    a[0] = type;
+    a[1] = n | ( cfg.sq ? 0x80 : 0 );
+    a[2] = COT_INROGEN;
+    a[3] = 0;
+    a[4] = cfg.ca & 0xFF;
+    a[5] = cfg.ca >> 8;
+    unsigned char * p = a + AsduHeader;
+    for ( int j = 0; j < n; j++, ioa++ )
+      {
+      if ( j == 0 || !cfg.sq )
+        {
+        p[0] = ioa & 0xFF; p[1] = ( ioa >> 8 ) & 0xFF; p[2] = ioa >> 16;
+        p += 3;
+        }
+      p = putElement( p, type, i + j + mGen, ts );
+      }
+
+    mGiNext += n;
+    if ( mGiNext >= (int)cfg.types.size() * cfg.points )
+      mGiNext = -1;
+    stats.objects += n;
+    return p - a;
+}
+
+// spontaneous ASDU of up to maxobj points, consecutive addresses from the cursor of the flow
+int TSimConn::buildSpont( unsigned char * a, int maxobj )
+{
+    unsigned t = mTypeIdx;
+    unsigned char type = cfg.types[t];
+    mTypeIdx = ( mTypeIdx + 1 ) % cfg.types.size();
+    int n = min( maxObjects( type, cfg.sq ), maxobj );
+    if ( mCursor >= (unsigned)cfg.points )
+      mCursor = 0;
+    if ( cfg.sq ) // a sequence does not wrap
+      n = min( n, cfg.points - (int)mCursor );
+    cp56time2a ts;
+    if ( type >= 30 )
+      mCp56.localNow( ts );
+
+    unsigned tbase = t * cfg.points;
+    a[0] = type;
+    a[1] = n | ( cfg.sq ? 0x80 : 0 );
+    a[2] = COT_SPONT;
+    a[3] = 0;
+    a[4] = cfg.ca & 0xFF;
+    a[5] = cfg.ca >> 8;
+    unsigned char * p = a + AsduHeader;
+    mGen++;
+    for ( int j = 0; j < n; j++ )
+      {
+      unsigned i = mCursor;
+      if ( ++mCursor >= (unsigned)cfg.points )
+        mCursor = 0;
+      if ( j == 0 || !cfg.sq )
+        {
+        unsigned ioa = tbase + i + 1;
+        p[0] = ioa & 0xFF; p[1] = ( ioa >> 8 ) & 0xFF; p[2] = ioa >> 16;
+        p += 3;
+        }
+      p = putElement( p, type, i + mGen, ts );
+      }
+
+    stats.objects += n;
+    return p - a;
+}
+
+void TSimConn::pump( long long now )
+{
+    if ( !mStarted )
+      return;
+
+    // offered load
+    if ( cfg.rate <= 0 )
+      mCredits = 1e9;
+    else if ( cfg.burst > 0 )
+      {
+      long long period = (long long)( cfg.burst * 1e6 / cfg.rate );
+      if ( period < 1 )
+        period = 1; // bursts closer than 1 us: one per us, the loop below must advance
+      while ( now >= mNextBurstUs )
+        {
+        mCredits += cfg.burst;
+        mNextBurstUs += period;
+        }
+      }
+    else
+      mCredits += cfg.rate * ( now - mLastUs ) / 1e6;
+    mLastUs = now;
+
+    unsigned char a[MaxAsdu];
+    while ( windowOpen() )
+      {
+      if ( !mCtrl.empty() )
+        {
+        sendI( (const unsigned char *)mCtrl.front().data(), mCtrl.front().size(), now );
+        mCtrl.pop_front();
+        continue;
+        }
+      if ( mGiNext >= 0 )
+        {
+        sendI( a, buildGI( a ), now );
+        if ( mGiNext < 0 ) // done: terminate it
+          {
+          a[0] = 100; a[1] = 1; a[2] = COT_ACTTERM; a[3] = 0; a[4] = cfg.ca & 0xFF; a[5] = cfg.ca >> 8;
+          a[6] = a[7] = a[8] = 0; a[9] = 20;
+          mCtrl.push_front( string( (const char *)a, 10 ) );
+          }
+        stats.asdus++;
+        continue;
+        }
+      if ( mCredits < 1 )
+        break;
+      int n = (int)min( mCredits, 127.0 );
+      int len = buildSpont( a, n );
+      sendI( a, len, now );
+      mCredits -= a[1] & 0x7F;
+      stats.asdus++;
+      }
+
+    // what the window did not let through is lost, not queued forever
+    double cap = cfg.rate <= 0 ? 1e9 : max( cfg.rate * cfg.interval, (double)cfg.burst );
+    if ( cfg.rate > 0 && mCredits > cap )
+      {
+      stats.behind += (unsigned long long)( mCredits - cap );
+      mCredits = cap;
+      }
+}
+
+bool TSimConn::flushTx()
+{
+    while ( mTxHead < mTx.size() )
+      {
+      ssize_t n = send( mFd, &mTx[mTxHead], mTx.size() - mTxHead, MSG_NOSIGNAL );
+      if ( n < 0 )
+        {
+        if ( errno == EAGAIN || errno == EWOULDBLOCK )
+          break;
+        if ( errno == EINTR )
+          continue;
+        return false;
+        }
+      mTxHead += n;
+      }
+    if ( mTxHead == mTx.size() )
+      {
+      mTx.clear();
+      mTxHead = 0;
+      }
+    return true;
+}
+
+void TSimConn::updateEvents( int epfd )
+{
+    unsigned ev = EPOLLIN | ( mTxHead < mTx.size() ? (unsigned)EPOLLOUT : 0 );
+    if ( ev == mEvents )
+      return;
+    mEvents = ev;
+    struct epoll_event e;
+    e.events = ev;
+    e.data.ptr = this;
+    epoll_ctl( epfd, EPOLL_CTL_MOD, mFd, &e );
+}
+
+static void onSignal( int )
+{
+    stopRequested = 1;
+}
+
+static void usage()
+{
+    printf( "rtusim104 [options]  IEC104 slave on 127.0.0.1 for load testing\n"
+            "  -p port       listen port (2404)\n"
+            "  -a ca         common address (1)\n"
+            "  -t t1,t2,..   types sent, of 1 3 9 11 13 30 31 34 35 36 (13)\n"
+            "  -n points     points per type (1000)\n"
+            "  -r rate       spontaneous objects/s per connection, 0 = as fast as the window allows (1000)\n"
+            "  -b burst      objects sent at once every burst/rate s, 0 = steady (0)\n"
+            "  -s            sequenced ASDUs (SQ=1)\n"
+            "  -k k          window of unacknowledged frames (12)\n"
+            "  -i seconds    report interval (1)\n"
+            "  -d seconds    run time, 0 = until interrupted (0)\n" );
+}
+
+static void report( double elapsed, double dt, int nconn )
+{
+    vector <int> & l = stats.latency;
+    int p50 = 0, p99 = 0, lmax = 0;
+    if ( !l.empty() )
+      {
+      sort( l.begin(), l.end() );
+      p50 = l[l.size() / 2];
+      p99 = l[l.size() * 99 / 100];
+      lmax = l.back();
+      }
+    printf( "%7.1fs conn %d  obj/s %9.0f  asdu/s %8.0f  behind %llu  cmd %llu  ack us p50 %d p99 %d max %d\n",
+            elapsed, nconn, stats.objects / dt, stats.asdus / dt, stats.behind, stats.commands, p50, p99, lmax );
+    fflush( stdout );
+    stats.objects = stats.asdus = stats.behind = stats.commands = 0;
+    l.clear();
+}
+
+int main( int argc, char * argv[] )
+{
+    cfg.port = 2404;
+    cfg.ca = 1;
+    cfg.points = 1000;
+    cfg.rate = 1000;
+    cfg.burst = 0;
+    cfg.sq = false;
+    cfg.k = 12;
+    cfg.interval = 1;
+    cfg.duration = 0;
+    string types = "13";
+
+    for ( int i = 1; i < argc; i++ )
+      {
+      string o = argv[i];
+      if ( o == "-s" )
+        {
+        cfg.sq = true;
+        continue;
+        }
+      if ( o == "-h" || i + 1 >= argc )
+        {
+        usage();
+        return o == "-h" ? 0 : 1;
+        }
+      const char * v = argv[++i];
+      if ( o == "-p" ) cfg.port = atoi( v );
+      else if ( o == "-a" ) cfg.ca = atoi( v );
+      else if ( o == "-t" ) types = v;
+      else if ( o == "-n" ) cfg.points = atoi( v );
+      else if ( o == "-r" ) cfg.rate = atof( v );
+      else if ( o == "-b" ) cfg.burst = atoi( v );
+      else if ( o == "-k" ) cfg.k = atoi( v );
+      else if ( o == "-i" ) cfg.interval = atof( v );
+      else if ( o == "-d" ) cfg.duration = atof( v );
+      else
+        {
+        usage();
+        return 1;
+        }
+      }
+
+    for ( size_t p = 0; p < types.size(); )
+      {
+      int t = atoi( types.c_str() + p );
+      if ( elementSize( t ) == 0 )
+        {
+        fprintf( stderr, "type %d not simulated\n", t );
+        return 1;
+        }
+      cfg.types.push_back( t );
+      p = types.find( ',', p );
+      if ( p == string::npos )
+        break;
+      p++;
+      }
+    if ( cfg.points < 1 || cfg.k < 1 || cfg.k >= SeqMod || cfg.interval <= 0 ||
+         (long long)cfg.types.size() * cfg.points > 0xFFFFFF )
+      {
+      usage();
+      return 1;
+      }
+
+    int lfd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    int on = 1;
+    setsockopt( lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+    struct sockaddr_in sa;
+    memset( &sa, 0, sizeof( sa ) );
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons( cfg.port );
+    sa.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    if ( bind( lfd, (struct sockaddr *)&sa, sizeof( sa ) ) < 0 || listen( lfd, 64 ) < 0 )
+      {
+      fprintf( stderr, "can't listen on 127.0.0.1:%u (errno %d)\n", cfg.port, errno );
+      return 1;
+      }
+
+    int epfd = epoll_create1( EPOLL_CLOEXEC );
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // NULL is the listening socket
+    epoll_ctl( epfd, EPOLL_CTL_ADD, lfd, &ev );
+
+    struct sigaction sig;
+    memset( &sig, 0, sizeof( sig ) );
+    sig.sa_handler = onSignal;
+    sigaction( SIGINT, &sig, NULL );
+    sigaction( SIGTERM, &sig, NULL );
+
+    printf( "rtusim104: 127.0.0.1:%u ca %u, %s x %d points, %s, rate %.0f/s%s\n", cfg.port, cfg.ca, types.c_str(),
+            cfg.points, cfg.sq ? "SQ" : "not SQ", cfg.rate, cfg.rate <= 0 ? " (window)" : "" );
+    fflush( stdout );
+
+    vector <TSimConn *> conns;
+    long long start = monoUs();
+    long long lastReport = start;
+    const int maxEvents = 64;
+    struct epoll_event evs[maxEvents];
+
+    while ( !stopRequested )
+      {
+      long long now = monoUs();
+      if ( cfg.duration > 0 && now - start >= cfg.duration * 1e6 )
+        break;
+      long long nextReport = lastReport + (long long)( cfg.interval * 1e6 );
+      int tmo = (int)( ( nextReport - now + 999 ) / 1000 );
+      if ( cfg.rate > 0 && !conns.empty() && tmo > 1 ) // steady flow: release the credits every ms
+        tmo = 1;
+      if ( tmo < 0 )
+        tmo = 0;
+
+      int n = epoll_wait( epfd, evs, maxEvents, tmo );
+      for ( int i = 0; i < n; i++ )
+        {
+        if ( evs[i].data.ptr == NULL )
+          {
+          int fd;
+          while ( ( fd = accept4( lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC ) ) >= 0 )
+            {
+            setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+            TSimConn * c = new TSimConn( fd );
+            ev.events = EPOLLIN;
+            ev.data.ptr = c;
+            epoll_ctl( epfd, EPOLL_CTL_ADD, fd, &ev );
+            conns.push_back( c );
+            }
+          continue;
+          }
+        TSimConn * c = (TSimConn *)evs[i].data.ptr;
+        if ( !c->onEvent( evs[i].events, epfd ) )
+          {
+          epoll_ctl( epfd, EPOLL_CTL_DEL, c->fd(), NULL );
+          conns.erase( std::find( conns.begin(), conns.end(), c ) );
+          delete c; // not referred by the events still to process: one event per fd per epoll_wait
+          }
+        }
+
+      // steady flow and bursts between socket events
+      now = monoUs();
+      if ( cfg.rate > 0 )
+        for ( size_t i = 0; i < conns.size(); i++ )
+          if ( !conns[i]->onEvent( 0, epfd ) )
+            {
+            epoll_ctl( epfd, EPOLL_CTL_DEL, conns[i]->fd(), NULL );
+            delete conns[i];
+            conns.erase( conns.begin() + i-- );
+            }
+
+      if ( now >= nextReport )
+        {
+        report( ( now - start ) / 1e6, ( now - lastReport ) / 1e6, (int)conns.size() );
+        lastReport = now;
+        }
+      }
+
+    for ( size_t i = 0; i < conns.size(); i++ )
+      delete conns[i];
+    close( epfd );
+    close( lfd );
+    return 0;
+}
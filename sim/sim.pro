@@ -0,0 +1,9 @@
+# -------------------------------------------------
+# Loopback IEC104 RTU simulator for load testing the master (no Qt, Linux only), run ./rtusim104 -h
+# -------------------------------------------------
+TEMPLATE = app
+TARGET = rtusim104
+CONFIG += console
+CONFIG -= qt app_bundle
+include( ../reactor104.pri )
+SOURCES += sim.cpp
@@ -0,0 +1,147 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+// Lock-free single producer / single consumer ring of preallocated slots.
+// One thread may call the producer functions and another thread the consumer functions at the same time.
+// Slots are filled in place: prepare() gives the next free slot, commit() publishes it to the consumer.
+
+#include <atomic>
+
+template <class T>
+class TSpscRing
+{
+public:
+    explicit TSpscRing( unsigned int capacity = 1024 ) : mSlots( NULL ), mMask( 0 ), mHead( 0 ), mTail( 0 )
+    {
+        resize( capacity );
+    }
+
+    ~TSpscRing()
+    {
+        delete[] mSlots;
+    }
+
+    // capacity is rounded up to a power of two, contents are lost; not thread safe, call only when the ring is not in use
+    void resize( unsigned int capacity )
+    {
+        unsigned int sz = 2;
+        while ( sz < capacity )
+            sz <<= 1;
+        delete[] mSlots;
+        mSlots = new T[sz];
+        mMask = sz - 1;
+        mHead.store( 0, std::memory_order_relaxed );
+        mTail.store( 0, std::memory_order_relaxed );
+    }
+
+    unsigned int capacity() const
+    {
+        return mMask + 1;
+    }
+
+    // number of slots in use, exact only when called from one of the two sides
+    unsigned int size() const
+    {
+        return mHead.load( std::memory_order_acquire ) - mTail.load( std::memory_order_acquire );
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    // ---- producer side ----
+
+    // next free slot to be filled, NULL if the ring is full
+    T * prepare()
+    {
+        unsigned int head = mHead.load( std::memory_order_relaxed );
+        if ( head - mTail.load( std::memory_order_acquire ) > mMask )
+            return NULL;
+        return &mSlots[head & mMask];
+    }
+
+    // publish the slot returned by prepare()
+    void commit()
+    {
+        mHead.store( mHead.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+    }
+
+    bool push( const T & v )
+    {
+        T * p = prepare();
+        if ( p == NULL )
+            return false;
+        *p = v;
+        commit();
+        return true;
+    }
+
+    // ---- consumer side ----
+
+    // oldest slot, NULL if the ring is empty
+    T * front()
+    {
+        unsigned int tail = mTail.load( std::memory_order_relaxed );
+        if ( tail == mHead.load( std::memory_order_acquire ) )
+            return NULL;
+        return &mSlots[tail & mMask];
+    }
+
+    // release the slot returned by front()
+    void pop()
+    {
+        mTail.store( mTail.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+    }
+
+    // discard everything published so far
+    void clear()
+    {
+        mTail.store( mHead.load( std::memory_order_acquire ), std::memory_order_release );
+    }
+
+private:
+    TSpscRing( const TSpscRing & );
+    TSpscRing & operator=( const TSpscRing & );
+
+    T * mSlots;
+    unsigned int mMask;
+    // head and tail are written by different threads, keep them in different cache lines
+    // (padding, not alignas: an over-aligned type would not be safe to allocate with new before C++17)
+    char mPad0[64];
+    std::atomic<unsigned int> mHead; // written by the producer
+    char mPad1[64];
+    std::atomic<unsigned int> mTail; // written by the consumer
+    char mPad2[64];
+};
+
+#endif // SPSCRING_H
@@ -0,0 +1,215 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <string.h>
+#include "squnpack.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SQUNPACK_AVX2
+#define SQUNPACK_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define SQUNPACK_SSE2
+#endif
+
+// element layouts: M_SP_NA_1 SIQ; M_ME_NB_1 16 bit value + QDS; M_ME_NC_1 32 bit float + QDS (little endian, as on the wire)
+static const unsigned char SIQ_MASK = 0xF0; // bl, sb, nt, iv (bit 0 is the state)
+static const unsigned char QDS_MASK = 0xF1; // ov, bl, sb, nt, iv
+
+// ---- one element at a time -----------------------------------------------------
+
+void sqUnpack1Scalar( const unsigned char * elem, int num, float * value, unsigned char * quality )
+{
+    for ( int i = 0; i < num; i++ )
+      {
+      value[i] = elem[i] & 0x01;
+      quality[i] = elem[i] & SIQ_MASK;
+      }
+}
+
+void sqUnpack11Scalar( const unsigned char * elem, int num, float * value, unsigned char * quality )
+{
+    for ( int i = 0; i < num; i++, elem += 3 )
+      {
+      value[i] = (unsigned short)( elem[0] | ( elem[1] << 8 ) );
+      quality[i] = elem[2] & QDS_MASK;
+      }
+}
+
+void sqUnpack13Scalar( const unsigned char * elem, int num, float * value, unsigned char * quality )
+{
+    for ( int i = 0; i < num; i++, elem += 5 )
+      {
+      memcpy( &value[i], elem, 4 );
+      quality[i] = elem[4] & QDS_MASK;
+      }
+}
+
+// ---- vector kernels --------------------------------------------------------------
+// Only whole blocks are done by vectors, with loads that stay inside the elements; the rest goes to the scalar loop.
+
+#if defined(SQUNPACK_SSE2)
+// x moved down so that its byte n is byte 0
+#define SQ_BYTES(x, n) _mm_srli_si128( (x), (n) )
+#endif
+
+void sqUnpack1( const unsigned char * elem, int num, float * value, unsigned char * quality )
+{
+    int i = 0;
+#if defined(SQUNPACK_AVX2)
+    const __m256i siqmask = _mm256_set1_epi8( (char)SIQ_MASK );
+    const __m256i one = _mm256_set1_epi32( 1 );
+    for ( ; i + 32 <= num; i += 32 )
+      {
+      __m256i x = _mm256_loadu_si256( (const __m256i *)( elem + i ) );
+      _mm256_storeu_si256( (__m256i *)( quality + i ), _mm256_and_si256( x, siqmask ) );
+      for ( int j = 0; j < 32; j += 8 )
+        {
+        __m256i s = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i *)( elem + i + j ) ) );
+        _mm256_storeu_ps( value + i + j, _mm256_cvtepi32_ps( _mm256_and_si256( s, one ) ) );
+        }
+      }
+#endif
+#if defined(SQUNPACK_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; i + 16 <= num; i += 16 )
+      {
+      __m128i x = _mm_loadu_si128( (const __m128i *)( elem + i ) );
+      _mm_storeu_si128( (__m128i *)( quality + i ), _mm_and_si128( x, _mm_set1_epi8( (char)SIQ_MASK ) ) );
+      __m128i st = _mm_and_si128( x, _mm_set1_epi8( 1 ) );
+      __m128i lo = _mm_unpacklo_epi8( st, zero );
+      __m128i hi = _mm_unpackhi_epi8( st, zero );
+      _mm_storeu_ps( value + i,      _mm_cvtepi32_ps( _mm_unpacklo_epi16( lo, zero ) ) );
+      _mm_storeu_ps( value + i + 4,  _mm_cvtepi32_ps( _mm_unpackhi_epi16( lo, zero ) ) );
+      _mm_storeu_ps( value + i + 8,  _mm_cvtepi32_ps( _mm_unpacklo_epi16( hi, zero ) ) );
+      _mm_storeu_ps( value + i + 12, _mm_cvtepi32_ps( _mm_unpackhi_epi16( hi, zero ) ) );
+      }
+#endif
+    sqUnpack1Scalar( elem + i, num - i, value + i, quality + i );
+}
+
+void sqUnpack11( const unsigned char * elem, int num, float * value, unsigned char * quality )
+{
+    int i = 0;
+#if defined(SQUNPACK_AVX2)
+    // 8 elements (24 bytes) per step, 4 in each 128 bit lane, the lane loads are 16 bytes: 28 bytes must be there
+    const __m256i vshuf = _mm256_setr_epi8( 0, 1, -1, -1, 3, 4, -1, -1, 6, 7, -1, -1, 9, 10, -1, -1,
+                                            0, 1, -1, -1, 3, 4, -1, -1, 6, 7, -1, -1, 9, 10, -1, -1 );
+    const __m256i qshuf = _mm256_setr_epi8( 2, 5, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                            2, 5, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+    for ( ; ( num - i ) * 3 >= 28; i += 8 )
+      {
+      const unsigned char * p = elem + i * 3;
+      __m256i x = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i *)p ) ),
+                                           _mm_loadu_si128( (const __m128i *)( p + 12 ) ), 1 );
+      _mm256_storeu_ps( value + i, _mm256_cvtepi32_ps( _mm256_shuffle_epi8( x, vshuf ) ) );
+      __m256i q = _mm256_shuffle_epi8( x, qshuf );
+      unsigned int q0 = (unsigned int)_mm256_extract_epi32( q, 0 ) & 0xF1F1F1F1;
+      unsigned int q1 = (unsigned int)_mm256_extract_epi32( q, 4 ) & 0xF1F1F1F1;
+      memcpy( quality + i, &q0, 4 );
+      memcpy( quality + i + 4, &q1, 4 );
+      }
+#endif
+#if defined(SQUNPACK_SSE2)
+    // 4 elements (12 bytes) per step with a 16 byte load
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; ( num - i ) * 3 >= 16; i += 4 )
+      {
+      __m128i x = _mm_loadu_si128( (const __m128i *)( elem + i * 3 ) );
+      __m128i v = _mm_unpacklo_epi32( _mm_unpacklo_epi16( x, SQ_BYTES( x, 3 ) ),
+                                      _mm_unpacklo_epi16( SQ_BYTES( x, 6 ), SQ_BYTES( x, 9 ) ) );
+      _mm_storeu_ps( value + i, _mm_cvtepi32_ps( _mm_unpacklo_epi16( v, zero ) ) );
+      __m128i q = _mm_unpacklo_epi16( _mm_unpacklo_epi8( SQ_BYTES( x, 2 ), SQ_BYTES( x, 5 ) ),
+                                      _mm_unpacklo_epi8( SQ_BYTES( x, 8 ), SQ_BYTES( x, 11 ) ) );
+      unsigned int q4 = (unsigned int)_mm_cvtsi128_si32( q ) & 0xF1F1F1F1;
+      memcpy( quality + i, &q4, 4 );
+      }
+#endif
+    sqUnpack11Scalar( elem + i * 3, num - i, value + i, quality + i );
+}
+
+void sqUnpack13( const unsigned char * elem, int num, float * value, unsigned char * quality )
+{
+    int i = 0;
+#if defined(SQUNPACK_AVX2)
+    // 8 elements (40 bytes) per step, 4 in each 128 bit lane: lo has elements 0..2 whole, hi (4 bytes ahead) the 4th
+    const __m256i vlo = _mm256_setr_epi8( 0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 12, 13, -1, -1, -1, -1,
+                                          0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 12, 13, -1, -1, -1, -1 );
+    const __m256i vhi = _mm256_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 11, 12, 13, 14,
+                                          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 11, 12, 13, 14 );
+    const __m256i qlo = _mm256_setr_epi8( 4, 9, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          4, 9, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+    const __m256i qhi = _mm256_setr_epi8( -1, -1, -1, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, -1, -1, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+    for ( ; i + 8 <= num; i += 8 )
+      {
+      const unsigned char * p = elem + i * 5;
+      __m256i lo = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i *)p ) ),
+                                            _mm_loadu_si128( (const __m128i *)( p + 20 ) ), 1 );
+      __m256i hi = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i *)( p + 4 ) ) ),
+                                            _mm_loadu_si128( (const __m128i *)( p + 24 ) ), 1 );
+      __m256i v = _mm256_or_si256( _mm256_shuffle_epi8( lo, vlo ), _mm256_shuffle_epi8( hi, vhi ) );
+      _mm256_storeu_ps( value + i, _mm256_castsi256_ps( v ) );
+      __m256i q = _mm256_or_si256( _mm256_shuffle_epi8( lo, qlo ), _mm256_shuffle_epi8( hi, qhi ) );
+      unsigned int q0 = (unsigned int)_mm256_extract_epi32( q, 0 ) & 0xF1F1F1F1;
+      unsigned int q1 = (unsigned int)_mm256_extract_epi32( q, 4 ) & 0xF1F1F1F1;
+      memcpy( quality + i, &q0, 4 );
+      memcpy( quality + i + 4, &q1, 4 );
+      }
+#endif
+#if defined(SQUNPACK_SSE2)
+    // 4 elements (20 bytes) per step, lo has elements 0..2 whole, hi (4 bytes ahead) the 4th
+    for ( ; i + 4 <= num; i += 4 )
+      {
+      const unsigned char * p = elem + i * 5;
+      __m128i lo = _mm_loadu_si128( (const __m128i *)p );
+      __m128i hi = _mm_loadu_si128( (const __m128i *)( p + 4 ) );
+      __m128i v = _mm_unpacklo_epi64( _mm_unpacklo_epi32( lo, SQ_BYTES( lo, 5 ) ),
+                                      _mm_unpacklo_epi32( SQ_BYTES( lo, 10 ), SQ_BYTES( hi, 11 ) ) );
+      _mm_storeu_ps( value + i, _mm_castsi128_ps( v ) );
+      __m128i q = _mm_unpacklo_epi16( _mm_unpacklo_epi8( SQ_BYTES( lo, 4 ), SQ_BYTES( lo, 9 ) ),
+                                      _mm_unpacklo_epi8( SQ_BYTES( lo, 14 ), SQ_BYTES( hi, 15 ) ) );
+      unsigned int q4 = (unsigned int)_mm_cvtsi128_si32( q ) & 0xF1F1F1F1;
+      memcpy( quality + i, &q4, 4 );
+      }
+#endif
+    sqUnpack13Scalar( elem + i * 5, num - i, value + i, quality + i );
+}
+
+const char * sqUnpackIsa()
+{
+#if defined(SQUNPACK_AVX2)
+    return "avx2";
+#elif defined(SQUNPACK_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
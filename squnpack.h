@@ -0,0 +1,53 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef SQUNPACK_H
+#define SQUNPACK_H
+
+// Vector kernels that unpack the elements of a sequenced asdu (SQ=1) of the types with a fixed, short element:
+// M_SP_NA_1 (1 byte), M_ME_NB_1 (3 bytes) and M_ME_NC_1 (5 bytes). The elements are read straight from the frame
+// and split to a value array and a quality array, several elements per vector operation.
+// The quality byte is the QDS of the element with the reserved bits cleared, that is the iec104_class::QDS_* bits
+// (for single points the state bit is the value and not the overflow bit).
+// The instruction set is chosen at compile time: AVX2 when the compiler targets it (-mavx2), SSE2 on x86/x86-64,
+// plain C++ otherwise. Values are exactly those of the object decoder in iec104_class.
+
+// elem points to the first element (after the 3 byte address), num elements are unpacked
+void sqUnpack1( const unsigned char * elem, int num, float * value, unsigned char * quality );
+void sqUnpack11( const unsigned char * elem, int num, float * value, unsigned char * quality );
+void sqUnpack13( const unsigned char * elem, int num, float * value, unsigned char * quality );
+
+// the same, one element at a time (reference and fallback)
+void sqUnpack1Scalar( const unsigned char * elem, int num, float * value, unsigned char * quality );
+void sqUnpack11Scalar( const unsigned char * elem, int num, float * value, unsigned char * quality );
+void sqUnpack13Scalar( const unsigned char * elem, int num, float * value, unsigned char * quality );
+
+const char * sqUnpackIsa(); // "avx2", "sse2" or "scalar"
+
+#endif // SQUNPACK_H
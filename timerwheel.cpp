@@ -0,0 +1,182 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <chrono>
+#include "timerwheel.h"
+
+TTimerWheel::TTimerWheel()
+{
+    for ( int l = 0; l < levels; l++ )
+      for ( int s = 0; s < slotsPerLevel; s++ )
+        mSlot[l][s].next = mSlot[l][s].prev = &mSlot[l][s];
+    mNow = nowMs();
+    mCount = 0;
+    mAdvancing = false;
+}
+
+TTimerWheel::~TTimerWheel()
+{
+    // leave user timers in a consistent (inactive) state
+    for ( int l = 0; l < levels; l++ )
+      for ( int s = 0; s < slotsPerLevel; s++ )
+        while ( mSlot[l][s].next != &mSlot[l][s] )
+          unlink( mSlot[l][s].next );
+}
+
+unsigned long long TTimerWheel::nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void TTimerWheel::start( TWheelTimer * t, unsigned ms )
+{
+    if ( t->isActive() )
+      unlink( t );
+    t->expires = mNow + ( ms ? ms : 1 );
+    insert( t );
+}
+
+void TTimerWheel::stop( TWheelTimer * t )
+{
+    if ( t->isActive() )
+      unlink( t );
+}
+
+void TTimerWheel::insert( TWheelTimer * t )
+{
+    unsigned long long delta = t->expires - mNow;
+    unsigned long long at = t->expires;
+    int l = 0;
+
+    while ( l < levels - 1 && delta >= ( 1ULL << ( slotBits * ( l + 1 ) ) ) )
+      l++;
+    if ( delta >= ( 1ULL << ( slotBits * levels ) ) )
+      at = mNow + ( 1ULL << ( slotBits * levels ) ) - 1; // beyond the wheel: park in the last slot reachable, rescheduled when cascaded
+
+    TWheelTimer * head = &mSlot[l][( at >> ( slotBits * l ) ) & slotMask];
+    t->next = head;
+    t->prev = head->prev;
+    head->prev->next = t;
+    head->prev = t;
+    mCount++;
+}
+
+void TTimerWheel::unlink( TWheelTimer * t )
+{
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = 0;
+    mCount--;
+}
+
+// move the timers of a slot to lower levels, mNow is the start of the period of the slot
+void TTimerWheel::cascade( int level, int slot )
+{
+    TWheelTimer * head = &mSlot[level][slot];
+    TWheelTimer list;
+
+    if ( head->next == head )
+      return;
+
+    // detach the whole list first, timers may land back in this slot only when parked beyond the wheel
+    list.next = head->next;
+    list.prev = head->prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    head->next = head->prev = head;
+
+    while ( list.next != &list )
+      {
+      TWheelTimer * t = list.next;
+      unlink( t );
+      insert( t );
+      }
+}
+
+void TTimerWheel::advance( unsigned long long now_ms )
+{
+    if ( mAdvancing )
+      return;
+    mAdvancing = true;
+
+    while ( mNow < now_ms )
+      {
+      if ( mCount == 0 )
+        { // nothing to expire, jump
+        mNow = now_ms;
+        break;
+        }
+
+      mNow++;
+      int idx = mNow & slotMask;
+
+      // entering a new period of the upper levels: cascade
+      if ( idx == 0 )
+        for ( int l = 1; l < levels; l++ )
+          {
+          int s = ( mNow >> ( slotBits * l ) ) & slotMask;
+          cascade( l, s );
+          if ( s != 0 )
+            break;
+          }
+
+      TWheelTimer * head = &mSlot[0][idx];
+      while ( head->next != head )
+        {
+        TWheelTimer * t = head->next;
+        unlink( t );
+        if ( t->expires > mNow )
+          { // can't happen: only timers expiring now are in the current slot
+          insert( t );
+          continue;
+          }
+        if ( t->callback )
+          t->callback( t->ctx, t->id );
+        }
+      }
+
+    mAdvancing = false;
+}
+
+int TTimerWheel::nextExpiry() const
+{
+    if ( mCount == 0 )
+      return -1;
+
+    // first non empty slot of the lowest level ahead, else the next cascade
+    for ( int d = 1; d < slotsPerLevel; d++ )
+      {
+      const TWheelTimer * head = &mSlot[0][( mNow + d ) & slotMask];
+      if ( head->next != head )
+        return d;
+      if ( ( ( mNow + d ) & slotMask ) == 0 )
+        return d;
+      }
+    return slotsPerLevel - ( mNow & slotMask );
+}
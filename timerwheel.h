@@ -0,0 +1,97 @@
+/*
+ * This software implements an IEC 60870-5-104 protocol tester.
+ * Copyright ?2010,2011,2012 Ricardo L. Olsen
+ *
+ * Disclaimer
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+// Hierarchical timer wheel, 1 ms resolution.
+// 4 levels of 64 slots cover 64^4 ms (about 4.6 hours), longer timers are rescheduled when cascaded.
+// Timers are intrusive list nodes owned by the user, starting and stopping a timer is O(1) and never allocates.
+// Many connections can share one wheel, driven by a single system timer: call advance() at nextExpiry().
+// Not thread safe: all calls must be made from the thread that drives the wheel.
+
+typedef void (*TTimerCallback)( void * ctx, int id );
+
+class TWheelTimer
+{
+public:
+    TWheelTimer() : next( 0 ), prev( 0 ), expires( 0 ), callback( 0 ), ctx( 0 ), id( 0 ) {}
+    void setCallback( TTimerCallback cb, void * c, int i ) { callback = cb; ctx = c; id = i; }
+    bool isActive() const { return prev != 0; }
+
+private:
+    friend class TTimerWheel;
+    TWheelTimer * next;
+    TWheelTimer * prev;
+    unsigned long long expires; // wheel time (ms) of expiration
+    TTimerCallback callback;
+    void * ctx;
+    int id;
+};
+
+class TTimerWheel
+{
+public:
+    TTimerWheel();
+    ~TTimerWheel();
+
+    static unsigned long long nowMs(); // monotonic clock, ms
+
+    // (re)start a timer to expire ms milliseconds from the current wheel time (at least 1 ms)
+    void start( TWheelTimer * t, unsigned ms );
+    void stop( TWheelTimer * t );
+    // run the callbacks of all timers expired until now_ms (from nowMs()); callbacks may start and stop timers,
+    // a call made from inside a callback returns at once
+    void advance( unsigned long long now_ms );
+    // ms from the current wheel time until advance() must be called again, -1 if no timer is active
+    int nextExpiry() const;
+    unsigned long long now() const { return mNow; }
+    unsigned count() const { return mCount; }
+
+private:
+    TTimerWheel( const TTimerWheel & );
+    TTimerWheel & operator=( const TTimerWheel & );
+
+    static const int levels = 4;
+    static const int slotBits = 6;
+    static const int slotsPerLevel = 1 << slotBits;
+    static const int slotMask = slotsPerLevel - 1;
+
+    void insert( TWheelTimer * t );
+    void unlink( TWheelTimer * t );
+    void cascade( int level, int slot );
+
+    // each slot is a circular list with a sentinel node
+    TWheelTimer mSlot[levels][slotsPerLevel];
+    unsigned long long mNow;
+    unsigned mCount;
+    bool mAdvancing;
+};
+
+#endif // TIMERWHEEL_H